@@ -0,0 +1,18 @@
+#include "FujiBusHealth.h"
+
+namespace esphome {
+namespace fujitsu {
+
+const char *FujiBusHealth::name(FujiBusCounter counter) {
+    static const char *const names[kCount] = {
+        "frames received", "frames for us", "frames sent", "bytes dropped", "response drops",
+        "fifo overflows",  "buffer full",   "parity errors", "frame errors", "breaks",
+        "command retries", "commands abandoned", "frame cache hits", "collisions",
+        "echo errors",     "retransmits", "responses superseded",
+    };
+    size_t i = static_cast<size_t>(counter);
+    return i < kCount ? names[i] : "?";
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "FujiCommands.h"
+#include "FujiFramer.h"
+#include "FujiPlatform.h"
+
+#include <atomic>
+
+namespace esphome {
+namespace fujitsu {
+
+enum class FujiBusCounter : uint8_t {
+    FRAMES_RECEIVED = 0,  // complete frames out of the framer
+    FRAMES_FOR_US,        // of those, addressed to this controller
+    FRAMES_SENT,          // frames written to the bus
+    BYTES_DROPPED,        // bytes the framer threw away resynchronising
+    RESPONSE_DROPS,       // responses lost because the response queue was full
+    FIFO_OVERFLOWS,       // UART_FIFO_OVF
+    BUFFER_FULL,          // UART_BUFFER_FULL
+    PARITY_ERRORS,        // UART_PARITY_ERR
+    FRAME_ERRORS,         // UART_FRAME_ERR
+    BREAKS,               // UART_BREAK
+    COMMAND_RETRIES,      // write-bit frames repeated because the unit had not echoed a change
+    COMMANDS_ABANDONED,   // changes given up on after the last retry
+    FRAME_CACHE_HITS,     // frames answered from the frame cache without decoding
+    COLLISIONS,           // frames of ours another talker drove bits into, going by their echo
+    ECHO_ERRORS,          // frames of ours whose echo had a bit flipped, was cut short or never came
+    RETRANSMITS,          // writes and error detail requests re-sent because their frame was lost
+    RESPONSES_SUPERSEDED, // status replies replaced by a newer one before their slot came
+    COUNT,
+};
+
+// Monotonic bus health counters. Bumped by the transport/UART task with a
+// relaxed add, read from anywhere; they wrap at 2^32.
+class FujiBusHealth {
+   public:
+    static const size_t kCount = static_cast<size_t>(FujiBusCounter::COUNT);
+
+    void count(FujiBusCounter counter, uint32_t n = 1) {
+        this->counters[static_cast<size_t>(counter)].fetch_add(n, std::memory_order_relaxed);
+    }
+    uint32_t get(FujiBusCounter counter) const {
+        return this->counters[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+    }
+    // Copies what only the framer knows; the UART task calls this after each chunk
+    void syncFramer(const FujiFramerStats &stats) {
+        this->counters[static_cast<size_t>(FujiBusCounter::BYTES_DROPPED)].store(stats.bytesDropped,
+                                                                                  std::memory_order_relaxed);
+    }
+    // Likewise for the command pipeline
+    void syncCommands(const FujiCommandStats &stats) {
+        this->counters[static_cast<size_t>(FujiBusCounter::COMMAND_RETRIES)].store(stats.retries,
+                                                                                    std::memory_order_relaxed);
+        this->counters[static_cast<size_t>(FujiBusCounter::COMMANDS_ABANDONED)].store(stats.abandoned,
+                                                                                       std::memory_order_relaxed);
+    }
+
+    static const char *name(FujiBusCounter counter);
+
+   private:
+    std::atomic<uint32_t> counters[kCount] = {};
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -0,0 +1,83 @@
+#include "FujiCapture.h"
+
+#include <string.h>
+
+namespace esphome {
+namespace fujitsu {
+
+static const char kCaptureMagic[7] = {'F', 'U', 'J', 'I', 'C', 'A', 'P'};
+
+void FujiCapture::record(FujiCaptureKind kind, byte arg, const byte *data, size_t len, uint64_t timeUs) {
+    if (!this->enabled) {
+        return;
+    }
+    FujiCaptureRecord rec;
+    rec.timeUs = (uint32_t) timeUs;
+    rec.kind = kind;
+    rec.arg = arg;
+    if (data != nullptr) {
+        memcpy(rec.data, data, len);
+    }
+    this->ring.record(rec);
+}
+
+void FujiCapture::recordRx(const byte *data, size_t len, uint64_t lastByteUs) {
+    while (len > 0) {
+        size_t n = len < kFrameSize ? len : kFrameSize;
+        // Each chunk is stamped with the end of its own last byte
+        this->record(FujiCaptureKind::RX, n, data, n, lastByteUs - (len - n) * kFujiByteTimeUs);
+        data += n;
+        len -= n;
+    }
+}
+
+void FujiCapture::recordTx(const byte *frame, uint64_t startUs) {
+    this->record(FujiCaptureKind::TX, kFrameSize, frame, kFrameSize, startUs);
+}
+
+void FujiCapture::recordIdle(uint64_t timeUs) { this->record(FujiCaptureKind::IDLE, 0, nullptr, 0, timeUs); }
+
+void FujiCapture::recordEvent(byte eventType, uint64_t timeUs) {
+    this->record(FujiCaptureKind::UART_EVENT, eventType, nullptr, 0, timeUs);
+}
+
+void FujiCapture::recordPending(byte fields, const byte *values, uint64_t timeUs) {
+    this->record(FujiCaptureKind::PENDING, fields, values, kFrameSize, timeUs);
+}
+
+void FujiCapture::encodeHeader(byte controllerAddress, byte *out) {
+    memset(out, 0, kCaptureHeaderSize);
+    memcpy(out, kCaptureMagic, sizeof(kCaptureMagic));
+    out[7] = kCaptureVersion;
+    out[8] = controllerAddress;
+}
+
+bool FujiCapture::decodeHeader(const byte *in, byte &controllerAddress) {
+    if (memcmp(in, kCaptureMagic, sizeof(kCaptureMagic)) != 0 || in[7] != kCaptureVersion) {
+        return false;
+    }
+    controllerAddress = in[8];
+    return true;
+}
+
+void FujiCapture::encodeRecord(const FujiCaptureRecord &rec, byte *out) {
+    out[0] = rec.timeUs;
+    out[1] = rec.timeUs >> 8;
+    out[2] = rec.timeUs >> 16;
+    out[3] = rec.timeUs >> 24;
+    out[4] = static_cast<byte>(rec.kind);
+    out[5] = rec.arg;
+    out[6] = 0;
+    out[7] = 0;
+    memcpy(out + 8, rec.data, kFrameSize);
+}
+
+void FujiCapture::decodeRecord(const byte *in, FujiCaptureRecord &rec) {
+    rec.timeUs = (uint32_t) in[0] | (uint32_t) in[1] << 8 | (uint32_t) in[2] << 16 | (uint32_t) in[3] << 24;
+    rec.kind = static_cast<FujiCaptureKind>(in[4]);
+    rec.arg = in[5];
+    memcpy(rec.data, in + 8, kFrameSize);
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "FujiFrame.h"
+#include "FujiPlatform.h"
+#include "FujiRing.h"
+#include "FujiTxScheduler.h"
+
+namespace esphome {
+namespace fujitsu {
+
+// Bus capture: everything the transport saw, at byte level, so a session
+// can be replayed bit for bit through the framer and protocol on a host.
+//
+// File layout (all little endian):
+//   header  16 bytes: "FUJICAP" version(1) controllerAddress(1) reserved(7)
+//   records 16 bytes: timeUs(4) kind(1) arg(1) reserved(2) data(8)
+enum class FujiCaptureKind : uint8_t {
+    RX = 0,          // arg bytes of data received; timeUs is when the last one ended
+    TX = 1,          // a frame written; timeUs is when the write started
+    IDLE = 2,        // the line went quiet (or the driver dropped data); the framer was reset
+    UART_EVENT = 3,  // arg: uart_event_type_t of a non-data event
+    PENDING = 4,     // arg: pending update mask, data: pending values by mask bit; the
+                     // writes in effect for the next frame, recorded when they change
+};
+
+struct FujiCaptureRecord {
+    uint32_t seq = 0;     // position in the ring, not written to files
+    uint32_t timeUs = 0;  // low 32 bits of fujiMicros(); readers unwrap it
+    FujiCaptureKind kind = FujiCaptureKind::RX;
+    byte arg = 0;
+    byte data[kFrameSize] = {};
+};
+
+const size_t kCaptureHeaderSize = 16;
+const size_t kCaptureRecordSize = 16;
+const byte kCaptureVersion = 1;
+
+// Recorder for the transport task. Each call is a copy into a ring slot, so
+// it stays on in production; a reader on another task (the climate's loop(),
+// or a host tool) drains it to wherever the capture is going.
+class FujiCapture {
+   public:
+    static const size_t kSize = 64;
+
+    // Received bytes, split into records of up to 8; lastByteUs is when the
+    // last of them finished arriving
+    void recordRx(const byte *data, size_t len, uint64_t lastByteUs);
+    void recordTx(const byte *frame, uint64_t startUs);
+    void recordIdle(uint64_t timeUs);
+    void recordEvent(byte eventType, uint64_t timeUs);
+    void recordPending(byte fields, const byte *values, uint64_t timeUs);
+
+    bool read(FujiRingCursor &cursor, FujiCaptureRecord &out) const { return this->ring.read(cursor, out); }
+    FujiRingCursor tail() const { return this->ring.tail(); }
+    uint32_t recorded() const { return this->ring.recorded(); }
+
+    // Recording is on unless turned off here
+    volatile bool enabled = true;
+
+    static void encodeHeader(byte controllerAddress, byte *out);
+    // False if this is not a capture header we understand
+    static bool decodeHeader(const byte *in, byte &controllerAddress);
+    static void encodeRecord(const FujiCaptureRecord &rec, byte *out);
+    static void decodeRecord(const byte *in, FujiCaptureRecord &rec);
+
+   private:
+    void record(FujiCaptureKind kind, byte arg, const byte *data, size_t len, uint64_t timeUs);
+
+    FujiRecordRing<FujiCaptureRecord, kSize> ring;
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
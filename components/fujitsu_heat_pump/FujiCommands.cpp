@@ -0,0 +1,131 @@
+#include "FujiCommands.h"
+
+namespace esphome {
+namespace fujitsu {
+
+static const char* TAG = "FujiHeatPump";
+
+void FujiCommandPipeline::request(byte mask, byte value) {
+    size_t bit = fujiMaskOffset(mask);
+    this->values[bit].store(value, std::memory_order_relaxed);
+    this->versions[bit].fetch_add(1, std::memory_order_seq_cst);
+    this->fields.fetch_or(mask, std::memory_order_seq_cst);
+}
+
+byte FujiCommandPipeline::pendingOr(byte pending, byte mask, byte fallback) const {
+    if (pending & mask) {
+        return this->values[fujiMaskOffset(mask)].load(std::memory_order_relaxed);
+    }
+    return fallback;
+}
+
+void FujiCommandPipeline::restore(byte fields, const byte *values) {
+    byte pending = this->pending();
+    for (size_t bit = 1; bit < 8; bit++) {
+        byte mask = 1 << bit;
+        if ((fields & mask) && (!(pending & mask) || this->pendingOr(pending, mask, 0) != values[bit])) {
+            this->request(mask, values[bit]);
+        } else if (!(fields & mask) && (pending & mask)) {
+            this->fields.fetch_and(~mask, std::memory_order_seq_cst);
+        }
+    }
+}
+
+void FujiCommandPipeline::retire(byte mask, uint32_t version) {
+    this->inFlight &= ~mask;
+    this->fields.fetch_and(~mask, std::memory_order_seq_cst);
+    // A requester may have bumped the version between our check and the clear
+    if (this->versions[fujiMaskOffset(mask)].load(std::memory_order_seq_cst) != version) {
+        this->fields.fetch_or(mask, std::memory_order_seq_cst);
+    }
+}
+
+byte FujiCommandPipeline::statusReceived(const FujiFrame &unit, uint32_t nowUs) {
+    byte requested = this->fields.load(std::memory_order_seq_cst);
+    for (size_t bit = 1; bit < 8; bit++) {
+        byte mask = 1 << bit;
+        if (!(requested & mask)) {
+            this->inFlight &= ~mask;
+            continue;
+        }
+        Command &c = this->commands[bit];
+        uint32_t version = this->versions[bit].load(std::memory_order_acquire);
+        if (!(this->inFlight & mask) || version != c.version) {
+            // New change, or a newer one superseding what was in flight
+            uint32_t check;
+            byte value;
+            do {
+                version = this->versions[bit].load(std::memory_order_acquire);
+                value = this->values[bit].load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                check = this->versions[bit].load(std::memory_order_relaxed);
+            } while (version != check);
+            c = Command{version, value, 0, 0};
+            this->inFlight |= mask;
+            continue;
+        }
+        // Only a status after our write says anything about it
+        if (c.attempts > 0 && kUpdateFields[bit].get(unit) == c.value) {
+            this->stats.confirmed++;
+            this->retire(mask, c.version);
+        } else if (c.attempts >= kMaxAttempts && (int32_t)(nowUs - c.nextWriteUs) >= 0) {
+            ESP_LOGW(TAG, "Unit did not take field 0x%02X = %d after %d writes, giving up", mask, c.value,
+                     c.attempts);
+            this->stats.abandoned++;
+            this->retire(mask, c.version);
+        }
+    }
+    return this->inFlight;
+}
+
+bool FujiCommandPipeline::writeDue(uint32_t nowUs) const {
+    for (size_t bit = 1; bit < 8; bit++) {
+        const Command &c = this->commands[bit];
+        if (!(this->inFlight & (1 << bit))) {
+            continue;
+        }
+        if (c.attempts == 0 || (c.attempts < kMaxAttempts && (int32_t)(nowUs - c.nextWriteUs) >= 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+byte FujiCommandPipeline::inFlightOr(byte mask, byte fallback) const {
+    if (this->inFlight & mask) {
+        return this->commands[fujiMaskOffset(mask)].value;
+    }
+    return fallback;
+}
+
+void FujiCommandPipeline::written(uint32_t nowUs) {
+    bool retry = false;
+    for (size_t bit = 1; bit < 8; bit++) {
+        Command &c = this->commands[bit];
+        if (!(this->inFlight & (1 << bit)) || c.attempts >= kMaxAttempts) {
+            continue;
+        }
+        retry |= c.attempts > 0;
+        c.attempts++;
+        uint32_t backoffUs = kRetryBaseUs << (c.attempts - 1);
+        c.nextWriteUs = nowUs + (backoffUs < kRetryMaxUs ? backoffUs : kRetryMaxUs);
+    }
+    if (retry) {
+        this->stats.retries++;
+    }
+}
+
+bool FujiCommandPipeline::writeLost(uint32_t nowUs) {
+    bool lost = false;
+    for (size_t bit = 1; bit < 8; bit++) {
+        Command &c = this->commands[bit];
+        if ((this->inFlight & (1 << bit)) && c.attempts > 0 && c.attempts < kMaxAttempts) {
+            c.nextWriteUs = nowUs;
+            lost = true;
+        }
+    }
+    return lost;
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
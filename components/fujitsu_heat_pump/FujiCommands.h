@@ -0,0 +1,81 @@
+#pragma once
+
+#include "FujiFrame.h"
+#include "FujiPlatform.h"
+
+#include <atomic>
+
+namespace esphome {
+namespace fujitsu {
+
+struct FujiCommandStats {
+    // Changes the unit echoed back
+    uint32_t confirmed = 0;
+    // Write-bit frames repeated for a change the unit had not echoed yet
+    uint32_t retries = 0;
+    // Changes given up on after kMaxAttempts writes
+    uint32_t abandoned = 0;
+};
+
+// Field changes on their way to the unit. Every setState() change gets a new
+// version for its field; the UART task writes it, keeps it pending until a
+// status frame from the unit shows the value, and rewrites it with growing
+// gaps if that does not happen. A newer change to a field replaces the older
+// one; other fields are untouched.
+//
+// Requesters and the UART task never block each other: the value is stored,
+// then the field's version bumped, then its pending bit set. Only the UART
+// task clears pending bits.
+class FujiCommandPipeline {
+   public:
+    // Writes of one change before it is abandoned, and the gap before each retry
+    static const uint8_t kMaxAttempts = 6;
+    static const uint32_t kRetryBaseUs = 1000000;
+    static const uint32_t kRetryMaxUs = 8000000;
+
+    // Any task
+    void request(byte mask, byte value);
+    // Fields with a change not yet echoed by the unit
+    byte pending() const { return this->fields.load(std::memory_order_acquire); }
+    // The requested value for mask if its bit is set in pending, else fallback
+    byte pendingOr(byte pending, byte mask, byte fallback) const;
+    // Puts back a pending set recorded in a capture; changed values count as new changes
+    void restore(byte fields, const byte *values);
+
+    // UART task only. Picks up new changes and retires the ones the unit's
+    // status confirms; returns the fields still in flight.
+    byte statusReceived(const FujiFrame &unit, uint32_t nowUs);
+    // True if a write-bit frame should go out with this response
+    bool writeDue(uint32_t nowUs) const;
+    // The value in flight for mask, else fallback
+    byte inFlightOr(byte mask, byte fallback) const;
+    // A write-bit frame carrying every field in flight was queued
+    void written(uint32_t nowUs);
+    // A write-bit frame never reached the unit intact, so the next response
+    // carries the changes again; false if none of them is still in flight
+    bool writeLost(uint32_t nowUs);
+
+    const FujiCommandStats &getStats() const { return this->stats; }
+
+   private:
+    struct Command {
+        uint32_t version = 0;
+        byte value = 0;
+        uint8_t attempts = 0;
+        uint32_t nextWriteUs = 0;
+    };
+
+    void retire(byte mask, uint32_t version);
+
+    std::atomic<uint32_t> fields{0};
+    std::atomic<uint32_t> values[8] = {};
+    std::atomic<uint32_t> versions[8] = {};
+
+    // UART task state
+    byte inFlight = 0;
+    Command commands[8];
+    FujiCommandStats stats;
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -0,0 +1,103 @@
+#include "FujiEcho.h"
+
+#include <string.h>
+
+namespace esphome {
+namespace fujitsu {
+
+void FujiEchoCheck::sent(const byte *wire, uint64_t startUs) {
+    if (this->count == kMaxOutstanding) {
+        this->finish();
+    }
+    Outstanding &o = this->outstanding[this->count++];
+    memcpy(o.wire, wire, kFrameSize);
+    o.startUs = startUs;
+    o.received = 0;
+    o.collided = false;
+    o.bitError = false;
+}
+
+bool FujiEchoCheck::push(byte b, uint64_t endUs) {
+    while (this->count > 0) {
+        Outstanding &o = this->outstanding[0];
+        if (endUs <= o.startUs) {
+            // Finished before our frame began
+            return false;
+        }
+        if (endUs > o.startUs + kFujiFrameTimeUs + kSlackUs) {
+            // Too late for this frame; it may be the next one's
+            this->finish();
+            continue;
+        }
+        byte want = o.wire[o.received++];
+        if (b != want) {
+            if (b & ~want) {
+                o.bitError = true;
+            } else {
+                o.collided = true;
+            }
+        }
+        if (o.received == kFrameSize) {
+            this->finish();
+        }
+        return true;
+    }
+    return false;
+}
+
+void FujiEchoCheck::expire(uint64_t nowUs) {
+    while (this->count > 0 && nowUs > this->outstanding[0].startUs + kFujiFrameTimeUs + kSlackUs) {
+        this->finish();
+    }
+}
+
+void FujiEchoCheck::finish() {
+    const Outstanding &o = this->outstanding[0];
+    FujiEchoResult result;
+    if (o.received == 0) {
+        if (!this->echoes) {
+            this->stats.unchecked++;
+            result = FujiEchoResult::VERIFIED;
+        } else {
+            this->stats.missing++;
+            result = FujiEchoResult::MISSING;
+        }
+    } else if (o.collided) {
+        // Someone else on the line explains any other damage too
+        this->stats.collisions++;
+        result = FujiEchoResult::COLLISION;
+    } else if (o.bitError || o.received < kFrameSize) {
+        this->stats.bitErrors++;
+        result = FujiEchoResult::BIT_ERROR;
+    } else {
+        this->echoes = true;
+        this->stats.verified++;
+        result = FujiEchoResult::VERIFIED;
+    }
+    if (result != FujiEchoResult::VERIFIED && this->failureCount < kMaxOutstanding) {
+        Failure &f = this->failures[this->failureCount++];
+        f.result = result;
+        memcpy(f.wire, o.wire, kFrameSize);
+    }
+    this->count--;
+    memmove(&this->outstanding[0], &this->outstanding[1], this->count * sizeof(Outstanding));
+}
+
+bool FujiEchoCheck::takeFailure(Failure &out) {
+    if (this->failureCount == 0) {
+        return false;
+    }
+    out = this->failures[0];
+    this->failureCount--;
+    memmove(&this->failures[0], &this->failures[1], this->failureCount * sizeof(Failure));
+    return true;
+}
+
+const char *FujiEchoCheck::name(FujiEchoResult result) {
+    static const char *const names[] = {"verified", "collision", "bit error", "missing"};
+    size_t i = static_cast<size_t>(result);
+    return i < sizeof(names) / sizeof(names[0]) ? names[i] : "?";
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
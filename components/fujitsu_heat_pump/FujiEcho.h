@@ -0,0 +1,88 @@
+#pragma once
+
+#include "FujiFrame.h"
+#include "FujiTxScheduler.h"
+
+namespace esphome {
+namespace fujitsu {
+
+enum class FujiEchoResult : uint8_t {
+    VERIFIED = 0,  // every byte came back as it was sent
+    COLLISION,     // another talker drove bits we left recessive
+    BIT_ERROR,     // a bit we drove came back recessive, or the echo was cut short
+    MISSING,       // nothing came back, on a line that has echoed before
+};
+
+struct FujiEchoStats {
+    uint32_t verified = 0;
+    uint32_t collisions = 0;
+    uint32_t bitErrors = 0;
+    uint32_t missing = 0;
+    // Frames sent before the line was ever seen to echo, so not checked
+    uint32_t unchecked = 0;
+};
+
+// Checks the frames we send against their echo. On the single-wire bus our
+// receiver hears what we transmit, so each frame should come back byte for
+// byte while it goes out. In wire form the idle line is high and a driven low
+// wins, so a byte with extra zero bits means someone else talked over us,
+// while a zero bit of ours coming back as a one is a fault on the line.
+//
+// Echo bytes are told apart from other traffic by when they finished
+// arriving: within a frame time (and a byte of slack) of the write. A line
+// that doesn't echo at all (a USB adapter that mutes its receiver, the
+// simulator) is recognised by never having echoed, and then nothing counts
+// as missing.
+class FujiEchoCheck {
+   public:
+    // Frames written whose echo hasn't finished, e.g. a multi-frame response
+    // whose echo is read in one chunk after the last frame
+    static const size_t kMaxOutstanding = 4;
+    // How long after a frame's last byte its echo may still end
+    static const uint32_t kSlackUs = kFujiByteTimeUs;
+
+    struct Failure {
+        FujiEchoResult result;
+        // The frame as we sent it
+        byte wire[kFrameSize];
+    };
+
+    // We started writing a wire frame at startUs
+    void sent(const byte *wire, uint64_t startUs);
+    // A received byte that finished arriving at endUs; true if it belongs to
+    // the echo of one of our frames, which the framer must not see
+    bool push(byte b, uint64_t endUs);
+    // The line has been quiet up to nowUs: echoes due by then are as complete
+    // as they will get
+    void expire(uint64_t nowUs);
+    // Next frame whose check failed, oldest first; false if there is none
+    bool takeFailure(Failure &out);
+
+    // Whether our receiver hears our own transmissions
+    bool lineEchoes() const { return this->echoes; }
+    const FujiEchoStats &getStats() const { return this->stats; }
+
+    static const char *name(FujiEchoResult result);
+
+   private:
+    struct Outstanding {
+        byte wire[kFrameSize];
+        uint64_t startUs;
+        byte received;
+        bool collided;
+        bool bitError;
+    };
+
+    // Judges the oldest outstanding frame and forgets it
+    void finish();
+
+    Outstanding outstanding[kMaxOutstanding];
+    size_t count = 0;
+    Failure failures[kMaxOutstanding];
+    size_t failureCount = 0;
+    bool echoes = false;
+    FujiEchoStats stats;
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
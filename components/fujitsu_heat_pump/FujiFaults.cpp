@@ -0,0 +1,93 @@
+#include "FujiFaults.h"
+
+#include <stdio.h>
+
+namespace esphome {
+namespace fujitsu {
+
+bool FujiFaults::statusReceived(bool errorBit) {
+    if (this->known && errorBit == this->local.errorBit) {
+        return false;
+    }
+    this->known = true;
+    this->local.errorBit = errorBit;
+    if (errorBit) {
+        this->local.queries++;
+    } else {
+        for (size_t i = 0; i < this->local.count; i++) {
+            this->local.faults[i].active = false;
+        }
+    }
+    this->table.write(this->local);
+    return errorBit;
+}
+
+FujiFault *FujiFaults::find(byte code) {
+    for (size_t i = 0; i < this->local.count; i++) {
+        if (this->local.faults[i].code == code) {
+            return &this->local.faults[i];
+        }
+    }
+    return nullptr;
+}
+
+FujiFault *FujiFaults::freeSlot() {
+    if (this->local.count < FujiFaultTable::kMaxFaults) {
+        return &this->local.faults[this->local.count++];
+    }
+    // Full: the least recently seen fault goes, inactive ones first
+    FujiFault *victim = &this->local.faults[0];
+    for (size_t i = 1; i < this->local.count; i++) {
+        FujiFault *f = &this->local.faults[i];
+        if ((victim->active && !f->active) || (victim->active == f->active && f->lastSeenS < victim->lastSeenS)) {
+            victim = f;
+        }
+    }
+    return victim;
+}
+
+void FujiFaults::detailReceived(byte code, uint64_t nowUs) {
+    uint32_t nowS = nowUs / 1000000;
+    FujiFault *fault = this->find(code);
+    if (fault == nullptr) {
+        fault = this->freeSlot();
+        *fault = FujiFault();
+        fault->code = code;
+        fault->firstSeenS = nowS;
+    }
+    fault->active = true;
+    fault->lastSeenS = nowS;
+    this->table.write(this->local);
+}
+
+void FujiFaults::format(const FujiFaultTable &table, char *buf, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    buf[0] = '\0';
+    if (!table.errorBit) {
+        snprintf(buf, len, "none");
+        return;
+    }
+    size_t used = 0;
+    for (size_t i = 0; i < table.count && used < len; i++) {
+        const FujiFault &f = table.faults[i];
+        if (!f.active) {
+            continue;
+        }
+        uint32_t s = f.firstSeenS;
+        int n = snprintf(buf + used, len - used, "%s0x%02X since %ud %02u:%02u:%02u uptime", used ? ", " : "",
+                         f.code, (unsigned) (s / 86400), (unsigned) (s / 3600 % 24), (unsigned) (s / 60 % 60),
+                         (unsigned) (s % 60));
+        if (n < 0) {
+            break;
+        }
+        used += n;
+    }
+    if (used == 0) {
+        snprintf(buf, len, "no details");
+    }
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
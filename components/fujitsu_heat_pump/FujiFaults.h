@@ -0,0 +1,66 @@
+#pragma once
+
+#include "FujiFrame.h"
+#include "FujiPlatform.h"
+#include "FujiSeqLock.h"
+
+namespace esphome {
+namespace fujitsu {
+
+struct FujiFault {
+    byte code = 0;
+    // Reported by the unit since the error bit last rose
+    bool active = false;
+    // Seconds of uptime, from the 64-bit fujiMicros() so they don't wrap
+    // after 49 days as a millisecond count would
+    uint32_t firstSeenS = 0;
+    uint32_t lastSeenS = 0;
+};
+
+struct FujiFaultTable {
+    static const size_t kMaxFaults = 4;
+
+    // The error bit of the unit's latest status
+    bool errorBit = false;
+    // Error detail requests sent, one per rising edge of the error bit
+    uint32_t queries = 0;
+    byte count = 0;
+    FujiFault faults[kMaxFaults];
+};
+
+// Fault codes from the unit's error detail frames. The UART task asks for the
+// details once each time the error bit in the unit's status rises, records the
+// codes that come back with the time each was first seen, and marks them all
+// inactive when the bit falls. Codes seen before stay in the table (oldest
+// inactive ones make room first) so a recurring fault keeps its first sighting.
+class FujiFaults {
+   public:
+    // UART task only
+    // True if the error bit just rose and an error detail request should go out
+    bool statusReceived(bool errorBit);
+    void detailReceived(byte code, uint64_t nowUs);
+    // The error detail request never reached the unit; the next status with
+    // the error bit set asks again
+    void queryLost() { this->known = false; }
+
+    // Any task
+    FujiFaultTable read() const { return this->table.read(); }
+    // Bumped whenever the table changes
+    uint32_t version() const { return this->table.version(); }
+
+    // Active faults as one line, e.g. "0x12 since 1d 02:03:04 uptime";
+    // "none" without an error, "no details" while the unit hasn't said
+    static void format(const FujiFaultTable &table, char *buf, size_t len);
+
+   private:
+    FujiFault *find(byte code);
+    // An unused entry, or the one to give up for a new code
+    FujiFault *freeSlot();
+
+    bool known = false;
+    FujiFaultTable local;
+    FujiSeqLock<FujiFaultTable> table;
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
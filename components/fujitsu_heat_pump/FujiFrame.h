@@ -0,0 +1,244 @@
+/* This file is based on unreality's FujiHeatPump project */
+#pragma once
+
+#include "FujiPlatform.h"
+
+namespace esphome {
+namespace fujitsu {
+
+const size_t kFrameSize = 8;
+
+constexpr byte fujiMaskOffset(byte mask) {
+    return (mask & 1) ? 0 : 1 + fujiMaskOffset(mask >> 1);
+}
+
+// Location of one field inside a (non-inverted) frame. The shift is derived
+// from the mask, so every field is a single constant shift-and-mask.
+template <byte Index, byte Mask>
+struct FujiField {
+    static_assert(Index < kFrameSize, "field outside of the frame");
+    static_assert(Mask != 0, "field without any bits");
+
+    static constexpr byte index = Index;
+    static constexpr byte mask = Mask;
+    static constexpr byte offset = fujiMaskOffset(Mask);
+
+    static constexpr byte get(const byte *buf) { return (buf[Index] & Mask) >> offset; }
+    static inline void put(byte *buf, byte value) {
+        buf[Index] = (buf[Index] & ~Mask) | ((value << offset) & Mask);
+    }
+};
+
+// Frame layout. There are 2 leading bits in byte 6 and all of byte 7 that are
+// unknown and not modelled here.
+using FujiSourceField = FujiField<0, 0b01111111>;
+using FujiBroadcastField = FujiField<0, 0b10000000>;  // seems like the high bit means it's a broadcast
+using FujiDestField = FujiField<1, 0b01111111>;
+using FujiUnknownBitField = FujiField<1, 0b10000000>;
+using FujiLoginBitField = FujiField<1, 0b00100000>;  // overlaps bit 5 of the destination
+using FujiMessageTypeField = FujiField<2, 0b00110000>;
+using FujiWriteBitField = FujiField<2, 0b00001000>;
+using FujiEnabledField = FujiField<3, 0b00000001>;
+using FujiModeField = FujiField<3, 0b00001110>;
+using FujiFanField = FujiField<3, 0b01110000>;
+using FujiErrorField = FujiField<3, 0b10000000>;
+using FujiTemperatureField = FujiField<4, 0b01111111>;
+using FujiEconomyField = FujiField<4, 0b10000000>;
+using FujiSwingStepField = FujiField<5, 0b00000010>;
+using FujiSwingField = FujiField<5, 0b00000100>;
+using FujiUpdateMagicField = FujiField<5, 0b11110000>;
+using FujiControllerPresentField = FujiField<6, 0b00000001>;
+using FujiControllerTempField = FujiField<6, 0b00111110>;
+// ERROR type frames from the unit carry a fault code where status frames have
+// the temperature (our best guess at the layout)
+using FujiErrorCodeField = FujiField<4, 0b11111111>;
+
+// The bits a set of fields covers, byte by byte
+template <typename... Fields>
+struct FujiFieldSet {
+    static constexpr byte mask(size_t index) { return (0 | ... | (Fields::index == index ? Fields::mask : 0)); }
+    static constexpr byte masks[kFrameSize] = {mask(0), mask(1), mask(2), mask(3),
+                                               mask(4), mask(5), mask(6), mask(7)};
+};
+
+// Every field we model; the bits outside them are carried, not understood
+using FujiModelledFields = FujiFieldSet<FujiSourceField, FujiDestField, FujiUnknownBitField, FujiMessageTypeField,
+                                       FujiWriteBitField, FujiEnabledField, FujiModeField, FujiFanField,
+                                       FujiErrorField, FujiTemperatureField, FujiEconomyField, FujiSwingStepField,
+                                       FujiSwingField, FujiUpdateMagicField, FujiControllerPresentField,
+                                       FujiControllerTempField>;
+// The unit state as fujiSameState() compares it
+using FujiStateFields = FujiFieldSet<FujiEnabledField, FujiModeField, FujiFanField, FujiErrorField,
+                                     FujiTemperatureField, FujiEconomyField, FujiSwingStepField, FujiSwingField,
+                                     FujiControllerTempField>;
+
+#define FUJI_ACCESSORS(type, field, name, setter)                                     \
+    type name() const { return static_cast<type>(field::get(this->raw)); }            \
+    void setter(type value) { field::put(this->raw, static_cast<byte>(value)); }
+
+// One frame in 9 bytes: the wire bytes (non-inverted) plus the destination.
+// Every field is read and written in place through a typed accessor, so a
+// decode is a copy and state snapshots stay small. The destination is kept
+// apart because a broadcast is resolved to an address when decoding, and on
+// the wire it shares bit 5 with the login bit; the two only meet again in
+// fujiEncodeFrame(). Bits that are not modelled ride along, so a reply built
+// from a received frame sends them back as they came.
+struct FujiFrame {
+    // Defaults to a set point and room temperature of 16
+    byte raw[kFrameSize] = {0, 0, 0, 0, 16, 0, 16 << 1, 0};
+    byte dest = 0;
+
+    FUJI_ACCESSORS(byte, FujiEnabledField, onOff, setOnOff)
+    FUJI_ACCESSORS(byte, FujiTemperatureField, temperature, setTemperature)
+    FUJI_ACCESSORS(byte, FujiModeField, acMode, setAcMode)
+    FUJI_ACCESSORS(byte, FujiFanField, fanMode, setFanMode)
+    FUJI_ACCESSORS(byte, FujiErrorField, acError, setAcError)
+    FUJI_ACCESSORS(byte, FujiEconomyField, economyMode, setEconomyMode)
+    FUJI_ACCESSORS(byte, FujiSwingField, swingMode, setSwingMode)
+    FUJI_ACCESSORS(byte, FujiSwingStepField, swingStep, setSwingStep)
+    FUJI_ACCESSORS(byte, FujiControllerPresentField, controllerPresent, setControllerPresent)
+    FUJI_ACCESSORS(byte, FujiUpdateMagicField, updateMagic, setUpdateMagic)  // unsure what this value indicates
+    FUJI_ACCESSORS(byte, FujiControllerTempField, controllerTemp, setControllerTemp)
+
+    FUJI_ACCESSORS(bool, FujiWriteBitField, writeBit, setWriteBit)
+    FUJI_ACCESSORS(bool, FujiLoginBitField, loginBit, setLoginBit)
+    FUJI_ACCESSORS(bool, FujiUnknownBitField, unknownBit, setUnknownBit)  // unsure what this bit indicates
+
+    FUJI_ACCESSORS(byte, FujiMessageTypeField, messageType, setMessageType)
+    FUJI_ACCESSORS(byte, FujiSourceField, messageSource, setMessageSource)
+    byte messageDest() const { return this->dest; }
+    void setMessageDest(byte value) { this->dest = value & FujiDestField::mask; }
+};
+
+#undef FUJI_ACCESSORS
+
+// True if a and b report the same unit state; addressing and frame flags are ignored
+inline bool fujiSameState(const FujiFrame &a, const FujiFrame &b) {
+    for (size_t i = 0; i < kFrameSize; i++) {
+        if ((a.raw[i] ^ b.raw[i]) & FujiStateFields::masks[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// One frame exactly as it goes over the wire
+struct FujiRawFrame {
+    byte data[kFrameSize];
+};
+
+// Decodes a non-inverted frame. Broadcast frames are reported as addressed to
+// broadcastDest, which is normally our own controller address.
+inline void fujiDecodeFrame(const byte *buf, byte broadcastDest, FujiFrame &ff) {
+    for (size_t i = 0; i < kFrameSize; i++) {
+        ff.raw[i] = buf[i];
+    }
+    ff.dest = FujiBroadcastField::get(buf) ? broadcastDest : FujiDestField::get(buf);
+}
+
+// Encodes into a non-inverted frame: the frame's bytes with the destination
+// patched in, so bits we don't model keep whatever the frame was decoded from
+// (zero in a frame built from scratch). We never broadcast. The login bit goes
+// on top of the destination, whose bit 5 it shares.
+inline void fujiEncodeFrame(const FujiFrame &ff, byte *buf) {
+    for (size_t i = 0; i < kFrameSize; i++) {
+        buf[i] = ff.raw[i];
+    }
+    FujiBroadcastField::put(buf, 0);
+    FujiDestField::put(buf, ff.dest);
+    FujiLoginBitField::put(buf, ff.loginBit());
+}
+
+// Fields a controller can ask the unit to change, one bit each
+const byte kOnOffUpdateMask = 0b10000000;
+const byte kTempUpdateMask = 0b01000000;
+const byte kModeUpdateMask = 0b00100000;
+const byte kFanModeUpdateMask = 0b00010000;
+const byte kEconomyModeUpdateMask = 0b00001000;
+const byte kSwingModeUpdateMask = 0b00000100;
+const byte kSwingStepUpdateMask = 0b00000010;
+const byte kAllUpdateMask = kOnOffUpdateMask | kTempUpdateMask | kModeUpdateMask | kFanModeUpdateMask |
+                            kEconomyModeUpdateMask | kSwingModeUpdateMask | kSwingStepUpdateMask;
+
+// Run-time handle on a FujiField, for tables of fields
+struct FujiFieldRef {
+    byte index;
+    byte mask;
+    byte offset;
+
+    byte get(const FujiFrame &ff) const { return (ff.raw[index] & mask) >> offset; }
+    void put(FujiFrame &ff, byte value) const {
+        ff.raw[index] = (ff.raw[index] & ~mask) | ((value << offset) & mask);
+    }
+};
+
+template <typename Field>
+constexpr FujiFieldRef fujiFieldRef() {
+    return {Field::index, Field::mask, Field::offset};
+}
+
+// The field each update mask bit stands for, indexed by bit number
+const FujiFieldRef kUpdateFields[8] = {
+    {0, 0, 0},
+    fujiFieldRef<FujiSwingStepField>(),
+    fujiFieldRef<FujiSwingField>(),
+    fujiFieldRef<FujiEconomyField>(),
+    fujiFieldRef<FujiFanField>(),
+    fujiFieldRef<FujiModeField>(),
+    fujiFieldRef<FujiTemperatureField>(),
+    fujiFieldRef<FujiEnabledField>(),
+};
+
+enum class FujiMode : byte {
+    UNKNOWN = 0,
+    FAN = 1,
+    DRY = 2,
+    COOL = 3,
+    HEAT = 4,
+    AUTO = 5,
+};
+
+enum class FujiMessageType : byte {
+    STATUS = 0,
+    ERROR = 1,
+    LOGIN = 2,
+    UNKNOWN = 3,
+};
+
+enum class FujiAddress : byte {
+    START = 0,
+    UNIT = 1,
+    PRIMARY = 32,
+    SECONDARY = 33,
+};
+
+enum class FujiFanMode : byte {
+    FAN_AUTO = 0,
+    FAN_QUIET = 1,
+    FAN_LOW = 2,
+    FAN_MEDIUM = 3,
+    FAN_HIGH = 4
+};
+
+// Set point range the climate offers
+const byte kFujiMinTemperature = 16;
+const byte kFujiMaxTemperature = 30;
+
+// Range of values setState() may send for each update mask bit, indexed by bit number
+const byte kUpdateFieldMin[8] = {0, 0, 0, 0, static_cast<byte>(FujiFanMode::FAN_AUTO),
+                                 static_cast<byte>(FujiMode::FAN), kFujiMinTemperature, 0};
+const byte kUpdateFieldMax[8] = {0, 1, 1, 1, static_cast<byte>(FujiFanMode::FAN_HIGH),
+                                 static_cast<byte>(FujiMode::AUTO), kFujiMaxTemperature, 1};
+
+// True if value is a setting the unit understands for the single update mask bit in mask
+inline bool fujiUpdateValueValid(byte mask, byte value) {
+    for (size_t bit = 1; bit < 8; bit++) {
+        if (mask == (1 << bit)) {
+            return value >= kUpdateFieldMin[bit] && value <= kUpdateFieldMax[bit];
+        }
+    }
+    return false;
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -0,0 +1,63 @@
+#include "FujiFrameCache.h"
+
+#include <string.h>
+
+namespace esphome {
+namespace fujitsu {
+
+const FujiFrameCache::Entry *FujiFrameCache::lookup(const byte *wire, uint32_t stateVersion) const {
+    for (const Entry &e : this->entries) {
+        if (e.valid && e.stateVersion == stateVersion && memcmp(e.wire, wire, kFrameSize) == 0) {
+            return &e;
+        }
+    }
+    return nullptr;
+}
+
+void FujiFrameCache::begin(const byte *wire) {
+    memcpy(this->recording.wire, wire, kFrameSize);
+    this->recording.forUs = false;
+    this->recording.event = FujiLinkEvent::NONE;
+    this->recording.responses = 0;
+    this->discarded = false;
+}
+
+void FujiFrameCache::noteResponse(FujiResponseKind kind, const byte *frame) {
+    if (this->recording.responses == kMaxResponses) {
+        this->discarded = true;
+        return;
+    }
+    this->recording.kind[this->recording.responses] = kind;
+    memcpy(this->recording.response[this->recording.responses++], frame, kFrameSize);
+}
+
+void FujiFrameCache::commit(const byte *frame, uint32_t stateVersion) {
+    if (this->discarded) {
+        return;
+    }
+    // Replace an older entry for the same frame first, else round robin
+    Entry *slot = nullptr;
+    for (Entry &e : this->entries) {
+        if (e.valid && memcmp(e.wire, this->recording.wire, kFrameSize) == 0) {
+            slot = &e;
+            break;
+        }
+    }
+    if (slot == nullptr) {
+        slot = &this->entries[this->nextVictim];
+        this->nextVictim = (this->nextVictim + 1) % kEntries;
+    }
+    *slot = this->recording;
+    memcpy(slot->frame, frame, kFrameSize);
+    slot->stateVersion = stateVersion;
+    slot->valid = true;
+}
+
+void FujiFrameCache::clear() {
+    for (Entry &e : this->entries) {
+        e.valid = false;
+    }
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
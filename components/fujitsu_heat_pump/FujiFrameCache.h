@@ -0,0 +1,58 @@
+#pragma once
+
+#include "FujiFrame.h"
+#include "FujiLink.h"
+#include "FujiResponses.h"
+
+namespace esphome {
+namespace fujitsu {
+
+// Remembers how the last few distinct frames were handled, so a byte-identical
+// repeat can be answered without inverting, decoding or touching the state.
+// An entry is only valid while the state it was handled against is unchanged
+// (same currentState version) and the link stays in its state; the caller
+// also keeps it away from anything else that could make the same frame come
+// out differently.
+class FujiFrameCache {
+   public:
+    static const size_t kEntries = 4;
+    static const size_t kMaxResponses = 2;
+
+    struct Entry {
+        bool valid = false;
+        byte wire[kFrameSize];
+        // Same frame after inversion, for the trace
+        byte frame[kFrameSize];
+        uint32_t stateVersion = 0;
+        bool forUs = false;
+        // What the frame meant for the link; a hit must not move it to another state
+        FujiLinkEvent event = FujiLinkEvent::NONE;
+        byte responses = 0;
+        // Encoded, not yet inverted
+        byte response[kMaxResponses][kFrameSize];
+        FujiResponseKind kind[kMaxResponses];
+    };
+
+    // A previous handling of this wire frame that still applies, or nullptr
+    const Entry *lookup(const byte *wire, uint32_t stateVersion) const;
+
+    // Records the handling of a frame that missed; commit() keeps it
+    void begin(const byte *wire);
+    void noteForUs() { this->recording.forUs = true; }
+    void noteEvent(FujiLinkEvent event) { this->recording.event = event; }
+    void noteResponse(FujiResponseKind kind, const byte *frame);
+    // The frame was handled in a way that must not repeat, e.g. a one-off request
+    void discard() { this->discarded = true; }
+    void commit(const byte *frame, uint32_t stateVersion);
+
+    void clear();
+
+   private:
+    Entry entries[kEntries];
+    Entry recording;
+    bool discarded = false;
+    size_t nextVictim = 0;
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -0,0 +1,65 @@
+#include "FujiFramer.h"
+
+#include <string.h>
+
+namespace esphome {
+namespace fujitsu {
+
+static bool knownAddress(byte address) {
+    return address == static_cast<byte>(FujiAddress::UNIT) ||
+           address == static_cast<byte>(FujiAddress::PRIMARY) ||
+           address == static_cast<byte>(FujiAddress::SECONDARY);
+}
+
+bool FujiFramer::plausible(const byte *wire) {
+    byte frame[2] = {static_cast<byte>(wire[0] ^ 0xFF), static_cast<byte>(wire[1] ^ 0xFF)};
+    if (!knownAddress(FujiSourceField::get(frame))) {
+        return false;
+    }
+    // Bit 5 of the destination is also the login bit, so 0/1/32/33 all reduce to 0 or 1
+    byte dest = FujiDestField::get(frame) & ~FujiLoginBitField::mask;
+    return dest == static_cast<byte>(FujiAddress::START) || dest == static_cast<byte>(FujiAddress::UNIT);
+}
+
+void FujiFramer::drop(size_t n) {
+    memmove(buf, buf + n, count - n);
+    count -= n;
+    stats.bytesDropped += n;
+    resyncDropped += n;
+}
+
+void FujiFramer::endResync() {
+    // A stray byte or two costs nothing; a frame's worth of garbage was a frame
+    stats.framesDropped += resyncDropped / kFrameSize;
+    resyncDropped = 0;
+}
+
+bool FujiFramer::push(byte b, byte *frame) {
+    buf[count++] = b;
+    if (count < kFrameSize) {
+        return false;
+    }
+    if (!plausible(buf)) {
+        // Misaligned: slide by one byte and wait for the next one
+        drop(1);
+        return false;
+    }
+    endResync();
+    memcpy(frame, buf, kFrameSize);
+    count = 0;
+    stats.frames++;
+    return true;
+}
+
+void FujiFramer::idle() {
+    if (count == 0) {
+        return;
+    }
+    // Whatever was cut short by the gap is a truncated frame
+    drop(count);
+    resyncDropped = 0;
+    stats.framesDropped++;
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
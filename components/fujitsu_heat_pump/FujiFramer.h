@@ -0,0 +1,43 @@
+#pragma once
+
+#include "FujiFrame.h"
+
+namespace esphome {
+namespace fujitsu {
+
+struct FujiFramerStats {
+    uint32_t frames = 0;
+    // Bytes thrown away while looking for a frame boundary
+    uint32_t bytesDropped = 0;
+    // Frames lost to those bytes: garbage a frame long, or a frame cut short by a gap
+    uint32_t framesDropped = 0;
+};
+
+// Splits the received byte stream into frames. Boundaries come from idle gaps
+// on the line (UART RX timeout or break) and, between gaps, from checking that
+// the address bytes of a candidate frame are plausible. A stray byte costs at
+// most the frame it lands in.
+class FujiFramer {
+   public:
+    // Feeds one wire byte; returns true and fills frame when a frame completes
+    bool push(byte b, byte *frame);
+    // The line went idle, so whatever is buffered cannot be the start of a frame
+    void idle();
+
+    const FujiFramerStats &getStats() const { return this->stats; }
+
+    // Cheap sanity check on a wire (inverted) frame's address bytes
+    static bool plausible(const byte *wire);
+
+   private:
+    void drop(size_t n);
+    void endResync();
+
+    byte buf[kFrameSize];
+    size_t count = 0;
+    size_t resyncDropped = 0;
+    FujiFramerStats stats;
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -1,615 +1,513 @@
 /* This file is based on unreality's FujiHeatPump project */
 
-#define DEBUG_FUJI
 #include "FujiHeatPump.h"
-#include "esphome/core/log.h"
-#include "string.h"
+#include <string.h>
 
 namespace esphome {
 namespace fujitsu {
 
 static const char* TAG = "FujiHeatPump";
 
-FujiFrame FujiHeatPump::decodeFrame() {
-    FujiFrame ff;
-
-    ff.messageSource = readBuf[0] & 0b01111111;
-    if (readBuf[0] & 0b10000000) {
-        // Seems like the high bit means it's a broadcast
-        ff.messageDest = controllerAddress;
-    } else {
-        ff.messageDest = readBuf[1] & 0b01111111;
-    }
-    ff.messageType = (readBuf[2] & 0b00110000) >> 4;
-
-    ff.acError = (readBuf[kErrorIndex] & kErrorMask) >> kErrorOffset;
-    ff.temperature =
-        (readBuf[kTemperatureIndex] & kTemperatureMask) >> kTemperatureOffset;
-    ff.acMode = (readBuf[kModeIndex] & kModeMask) >> kModeOffset;
-    ff.fanMode = (readBuf[kFanIndex] & kFanMask) >> kFanOffset;
-    ff.economyMode = (readBuf[kEconomyIndex] & kEconomyMask) >> kEconomyOffset;
-    ff.swingMode = (readBuf[kSwingIndex] & kSwingMask) >> kSwingOffset;
-    ff.swingStep =
-        (readBuf[kSwingStepIndex] & kSwingStepMask) >> kSwingStepOffset;
-    ff.controllerPresent =
-        (readBuf[kControllerPresentIndex] & kControllerPresentMask) >>
-        kControllerPresentOffset;
-    ff.updateMagic =
-        (readBuf[kUpdateMagicIndex] & kUpdateMagicMask) >> kUpdateMagicOffset;
-    ff.onOff = (readBuf[kEnabledIndex] & kEnabledMask) >> kEnabledOffset;
-    ff.controllerTemp = (readBuf[kControllerTempIndex] & kControllerTempMask) >>
-                        kControllerTempOffset;  // there are 2 leading bits here
-                                                // that are unknown
-
-    ff.writeBit = (readBuf[2] & 0b00001000) != 0;
-    ff.loginBit = (readBuf[1] & 0b00100000) != 0;
-    ff.unknownBit = (readBuf[1] & 0b10000000) > 0;
-
-    return ff;
+void FujiHeatPump::decodeFrame(FujiFrame &ff) {
+    fujiDecodeFrame(readBuf, controllerAddress, ff);
 }
 
-void FujiHeatPump::encodeFrame(FujiFrame ff, byte* writeBuf) {
-    memset(writeBuf, 0, kFrameSize);
-
-    writeBuf[0] = ff.messageSource;
-
-    writeBuf[1] &= 0b10000000;
-    writeBuf[1] |= ff.messageDest & 0b01111111;
-
-    writeBuf[2] &= 0b11001111;
-    writeBuf[2] |= ff.messageType << 4;
+void FujiHeatPump::encodeFrame(const FujiFrame &ff, byte* writeBuf) {
+    fujiEncodeFrame(ff, writeBuf);
+}
 
-    if (ff.writeBit) {
-        writeBuf[2] |= 0b00001000;
+void FujiHeatPump::begin(bool secondary) {
+    if (secondary) {
+        controllerIsPrimary = false;
+        controllerAddress = static_cast<byte>(FujiAddress::SECONDARY);
+        ESP_LOGI(TAG, "Controller in secondary mode");
     } else {
-        writeBuf[2] &= 0b11110111;
+        controllerIsPrimary = true;
+        controllerAddress = static_cast<byte>(FujiAddress::PRIMARY);
+        ESP_LOGI(TAG, "Controller in primary mode");
     }
+    link.begin(controllerIsPrimary, fujiMillis());
+    frameCache.clear();
+}
 
-    writeBuf[1] &= 0b01111111;
-    if (ff.unknownBit) {
-        writeBuf[1] |= 0b10000000;
+uint32_t FujiHeatPump::poll() {
+    uint32_t nowMs = fujiMillis();
+    if (link.expire(nowMs)) {
+        linkChanged();
     }
-
-    if (ff.loginBit) {
-        writeBuf[1] |= 0b00100000;
-    } else {
-        writeBuf[1] &= 0b11011111;
-    }
-
-    writeBuf[kModeIndex] =
-        (writeBuf[kModeIndex] & ~kModeMask) | (ff.acMode << kModeOffset);
-    writeBuf[kModeIndex] = (writeBuf[kEnabledIndex] & ~kEnabledMask) |
-                           (ff.onOff << kEnabledOffset);
-    writeBuf[kFanIndex] =
-        (writeBuf[kFanIndex] & ~kFanMask) | (ff.fanMode << kFanOffset);
-    writeBuf[kErrorIndex] =
-        (writeBuf[kErrorIndex] & ~kErrorMask) | (ff.acError << kErrorOffset);
-    writeBuf[kEconomyIndex] = (writeBuf[kEconomyIndex] & ~kEconomyMask) |
-                              (ff.economyMode << kEconomyOffset);
-    writeBuf[kTemperatureIndex] =
-        (writeBuf[kTemperatureIndex] & ~kTemperatureMask) |
-        (ff.temperature << kTemperatureOffset);
-    writeBuf[kSwingIndex] =
-        (writeBuf[kSwingIndex] & ~kSwingMask) | (ff.swingMode << kSwingOffset);
-    writeBuf[kSwingStepIndex] = (writeBuf[kSwingStepIndex] & ~kSwingStepMask) |
-                                (ff.swingStep << kSwingStepOffset);
-    writeBuf[kControllerPresentIndex] =
-        (writeBuf[kControllerPresentIndex] & ~kControllerPresentMask) |
-        (ff.controllerPresent << kControllerPresentOffset);
-    writeBuf[kUpdateMagicIndex] =
-        (writeBuf[kUpdateMagicIndex] & ~kUpdateMagicMask) |
-        (ff.updateMagic << kUpdateMagicOffset);
-    writeBuf[kControllerTempIndex] =
-        (writeBuf[kControllerTempIndex] & ~kControllerTempMask) |
-        (ff.controllerTemp << kControllerTempOffset);
+    return link.nextTimeoutMs(nowMs);
 }
 
-void heat_pump_uart_event_task(void *pvParameters) {
-    FujiHeatPump *heatpump = (FujiHeatPump *)pvParameters;
-    uart_event_t event;
-    TickType_t wakeTime;
-    byte send_buf[kFrameSize];
-    int msgsSent = 0;
-    while (true) {
-        if(xQueueReceive(heatpump->uart_queue, (void * )&event, pdMS_TO_TICKS(1000))) {
-            ESP_LOGI(TAG, "messages sent so far: %d", msgsSent);
-            switch(event.type) {
-
-                //Event of UART receving data
-                /*We'd better handler data event fast, there would be much more data events than
-                  other types of events. If we take too much time on data event, the queue might
-                  be full.*/
-                case UART_DATA:
-                    size_t bufferLen;
-
-                    wakeTime = xTaskGetTickCount();
-
-                    uart_get_buffered_data_len(heatpump->uart_port, &bufferLen);
-                    ESP_LOGI(TAG, "[BUFFER LENGTH]: %d", bufferLen);
-                    bufferLen %= kFrameSize;
-                    if (bufferLen) {
-                        ESP_LOGD(TAG, "Discarding %d bytes", bufferLen);
-                        uart_read_bytes(heatpump->uart_port, heatpump->readBuf, bufferLen, portMAX_DELAY);
-                    }
-
-                    ESP_LOGI(TAG, "[UART DATA]: %d", event.size);
-                    for (auto i = 0; i < event.size / kFrameSize; i++) {
-                        if (kFrameSize != uart_read_bytes(heatpump->uart_port, heatpump->readBuf, kFrameSize, portMAX_DELAY)) {
-                            ESP_LOGW(TAG, "Failed to read state update as expected");
-                        }
-                        else {
-                            heatpump->processReceivedFrame();
-                            if (!xSemaphoreTake(heatpump->updateStateMutex, portMAX_DELAY)) {
-                                ESP_LOGW(TAG, "Failed to take update state mutex");
-                            }
-                            if (heatpump->updateFields == 0) {
-                                // We only should update HA if we don't have a pending update
-                                xQueueOverwrite(heatpump->state_dropbox, &heatpump->currentState);
-                            }
-                            if (!xSemaphoreGive(heatpump->updateStateMutex)) {
-                                ESP_LOGW(TAG, "Failed to give update state mutex");
-                            }
-                            if (xQueueReceive(heatpump->response_queue, send_buf, 0)) {
-#if 0
-                                ESP_LOGD(TAG, "Now, handling a pending frame txmit");
-                                // This causes us to wait until 100 ms have passed since we read wakeTime, so that we account for the processReceivedFrame(). It also allows other tasks to use the core in the meantime because it suspends instead of busy-waiting.
-                                vTaskDelayUntil(&wakeTime, pdMS_TO_TICKS(100));
-                                if (uart_write_bytes(heatpump->uart_port, (const char*)send_buf, kFrameSize) != kFrameSize) {
-                                    ESP_LOGW(TAG, "Failed to write state update as expected");
-                                }
-                                msgsSent++;
-                                ESP_LOGD(TAG, "Completed txmit");
-                                if (!xSemaphoreTake(heatpump->updateStateMutex, portMAX_DELAY)) {
-                                    ESP_LOGW(TAG, "Failed to take update state mutex");
-                                }
-                                heatpump->updateFields = 0;
-                                if (!xSemaphoreGive(heatpump->updateStateMutex)) {
-                                    ESP_LOGW(TAG, "Failed to give update state mutex");
-                                }
-#endif
-                            }
-                        }
-                    }
-                    break;
-                //Event of HW FIFO overflow detected
-                case UART_FIFO_OVF:
-                    ESP_LOGI(TAG, "hw fifo overflow");
-                    // If fifo overflow happened, you should consider adding flow control for your application.
-                    // The ISR has already reset the rx FIFO,
-                    // As an example, we directly flush the rx buffer here in order to read more data.
-                    uart_flush_input(heatpump->uart_port);
-                    xQueueReset(heatpump->uart_queue);
-                    break;
-                //Event of UART ring buffer full
-                case UART_BUFFER_FULL:
-                    ESP_LOGI(TAG, "ring buffer full");
-                    // If buffer full happened, you should consider increasing your buffer size
-                    // As an example, we directly flush the rx buffer here in order to read more data.
-                    uart_flush_input(heatpump->uart_port);
-                    xQueueReset(heatpump->uart_queue);
-                    break;
-                //Event of UART RX break detected
-                case UART_BREAK:
-                    ESP_LOGI(TAG, "uart rx break");
-                    break;
-                //Event of UART parity check error
-                case UART_PARITY_ERR:
-                    ESP_LOGI(TAG, "uart parity error");
-                    break;
-                //Event of UART frame error
-                case UART_FRAME_ERR:
-                    ESP_LOGI(TAG, "uart frame error");
-                    break;
-                //Others
-                default:
-                    ESP_LOGI(TAG, "uart event type: %d", event.type);
-                    break;
-            }
-        }
-        //ESP_LOGI(TAG, "uart task heartbeat");
+FujiLinkReply FujiHeatPump::linkEvent(FujiLinkEvent event, uint32_t nowMs) {
+    FujiLinkState before = link.state();
+    FujiLinkReply reply = link.handle(event, nowMs);
+    if (link.state() != before) {
+        linkChanged();
     }
+    return reply;
 }
 
-void FujiHeatPump::connect(uart_port_t uart_port, bool secondary, int rxPin, int txPin) {
-    ESP_LOGD("FujitsuClimate", "Connect has been entered!");
-    int rc;
-    uart_config_t uart_config = {
-        .baud_rate = 500,
-        .data_bits = UART_DATA_8_BITS,
-        .parity    = UART_PARITY_EVEN,
-        .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
-        .source_clk = UART_SCLK_APB,
-    };
-    if (uart_is_driver_installed(uart_port)) {
-        ESP_LOGW(TAG, "uninstalling uart driver...");
-        rc = uart_driver_delete(uart_port);
-        if (rc != 0) {
-            ESP_LOGW(TAG, "Failed to uninstall existing uart driver");
-            return;
+void FujiHeatPump::linkChanged() {
+    ESP_LOGD(TAG, "Link %s", FujiLink::name(link.state()));
+    trace.record(FujiTraceEvent::LINK_STATE, nullptr, static_cast<int32_t>(link.state()));
+    // Our replies depend on the link state
+    frameCache.clear();
+}
+
+void FujiHeatPump::handleFrame(const byte *frame) {
+    if (capture.enabled) {
+        byte fields = commands.pending();
+        byte values[8];
+        for (size_t i = 0; i < 8; i++) {
+            values[i] = commands.pendingOr(fields, 1 << i, 0);
+        }
+        if (fields != capturedFields || memcmp(values, capturedValues, sizeof(values)) != 0) {
+            capture.recordPending(fields, values, fujiMicros());
+            capturedFields = fields;
+            memcpy(capturedValues, values, sizeof(values));
         }
     }
-    rc = uart_driver_install(uart_port, 2048, 2048, 20, &this->uart_queue, 0);
-    if (rc != 0) {
-        ESP_LOGW(TAG, "Failed to install uart driver");
+    health.count(FujiBusCounter::FRAMES_RECEIVED);
+    if (listenOnly) {
+        sniffFrame(frame);
         return;
     }
-    rc = uart_param_config(uart_port, &uart_config);
-    if (rc != 0) {
-        ESP_LOGW(TAG, "Failed to configure uart params");
-        return;
+    // Timeouts first, so a frame is always handled in the state it arrives in
+    poll();
+    txScheduler.frameHandled(fujiMicros());
+    // With no change in flight, a repeat of a recent frame against the same
+    // state is answered exactly as before
+    bool quiet = commands.pending() == 0 && latency.idle();
+    uint32_t stateVersion = currentState.version();
+    FujiLinkState linkState = link.state();
+    if (quiet && useFrameCache) {
+        const FujiFrameCache::Entry *hit = frameCache.lookup(frame, stateVersion);
+        if (hit != nullptr && link.next(hit->event) == linkState) {
+            health.count(FujiBusCounter::FRAME_CACHE_HITS);
+            replayCached(*hit);
+            return;
+        }
     }
-    rc = uart_set_pin(uart_port, txPin /* TXD */,  rxPin /* RXD */, UART_PIN_NO_CHANGE /* RTS */, UART_PIN_NO_CHANGE /* CTS */);
-    if (rc != 0) {
-        ESP_LOGW(TAG, "Failed to set uart pins");
-        return;
+    frameCache.begin(frame);
+    memcpy(readBuf, frame, kFrameSize);
+    processReceivedFrame();
+    health.syncCommands(commands.getStats());
+    if (quiet && commands.pending() == 0 && latency.idle() && currentState.version() == stateVersion &&
+        link.state() == linkState) {
+        frameCache.commit(readBuf, stateVersion);
     }
+    publishState();
+}
 
-    rc = uart_set_mode(uart_port, UART_MODE_RS485_HALF_DUPLEX);
-    if (rc != 0) {
-        ESP_LOGW(TAG, "Failed to set uart to half duplex");
+void FujiHeatPump::publishState() {
+    if (commands.pending() != 0) {
+        // We only should update HA if we don't have a pending update
         return;
     }
-    ESP_LOGD(TAG, "Serial port configured");
-
-    if (secondary) {
-        controllerIsPrimary = false;
-        controllerAddress = static_cast<byte>(FujiAddress::SECONDARY);
-        ESP_LOGI(TAG, "Controller in secondary mode");
-    } else {
-        controllerIsPrimary = true;
-        controllerAddress = static_cast<byte>(FujiAddress::PRIMARY);
-        ESP_LOGI(TAG, "Controller in primary mode");
+    // and only bother it when something it shows actually changed
+    FujiFrame current = currentState.read();
+    if (!havePublished || !fujiSameState(current, lastPublished)) {
+        publishedState.write(current);
+        lastPublished = current;
+        havePublished = true;
     }
+}
 
-    this->uart_port = uart_port;
-
-    this->response_queue = xQueueCreate(10, sizeof(uint8_t[kFrameSize]));
+void FujiHeatPump::sniffFrame(const byte *frame) {
+    for (size_t i = 0; i < kFrameSize; i++) {
+        readBuf[i] = frame[i] ^ 0xFF;
+    }
+    trace.record(FujiTraceEvent::RX_FRAME, readBuf);
+    sniffer.frame(readBuf, (uint32_t) fujiMicros());
 
-    //rc = xTaskCreatePinnedToCore(heat_pump_uart_event_task, "FujiTask", 4096, (void *)this,
-    //        // TODO is the priority reasonable? find & investigate the freertosconfig.h
-    //                        configMAX_PRIORITIES - 1, NULL /* ignore the task handle */, 1);
-    rc = xTaskCreate(heat_pump_uart_event_task, "FujiTask", 4096, (void *)this,
-                            12, NULL /* ignore the task handle */);
-    if (rc != pdPASS) {
-        ESP_LOGW(TAG, "Failed to create heat pump event task");
+    // The climate follows the unit's own status, whoever it is talking to
+    byte source = FujiSourceField::get(readBuf);
+    byte type = FujiMessageTypeField::get(readBuf);
+    if (source != static_cast<byte>(FujiAddress::UNIT) || type != static_cast<byte>(FujiMessageType::STATUS)) {
         return;
     }
+    // Read the way the primary would, whichever role we were given
+    FujiFrame ff;
+    fujiDecodeFrame(readBuf, static_cast<byte>(FujiAddress::PRIMARY), ff);
+    if (ff.messageDest() == static_cast<byte>(FujiAddress::SECONDARY)) {
+        // As when taking part: only the room temperature comes from the secondary's polls
+        FujiFrame current = currentState.read();
+        current.setControllerTemp(ff.controllerTemp());
+        updateCurrentState(current);
+    } else {
+        updateCurrentState(ff);
+    }
+    publishState();
 }
 
-void FujiHeatPump::printFrame(byte buf[kFrameSize], FujiFrame ff) {
-    ESP_LOGD(TAG, "%02hhX %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX %02hhX",
-        buf[0], buf[1], buf[2], buf[3], buf[4], buf[5], buf[6], buf[7]);
-    ESP_LOGD(
-        TAG,
-        " mSrc: %d mDst: %d mType: %d write: %d login: %d unknown: %d onOff: "
-        "%d temp: %d, mode: %d cP:%d uM:%d cTemp:%d acError:%d \n",
-        ff.messageSource, ff.messageDest, ff.messageType, ff.writeBit,
-        ff.loginBit, ff.unknownBit, ff.onOff, ff.temperature, ff.acMode,
-        ff.controllerPresent, ff.updateMagic, ff.controllerTemp, ff.acError);
+bool FujiHeatPump::nextResponse(byte *frame) {
+    if (!responses.front(frame)) {
+        return false;
+    }
+    responses.pop();
+    return true;
 }
 
-
-void FujiHeatPump::sendResponse(FujiFrame& ff) {
-    if (!comms_is_enabled) {
-        ESP_LOGD(TAG, "Comms is disabled, so not sending a response");
-        return;
+void FujiHeatPump::replayCached(const FujiFrameCache::Entry &entry) {
+    trace.record(FujiTraceEvent::RX_FRAME, entry.frame);
+    uint32_t nowMs = fujiMillis();
+    if (entry.forUs) {
+        health.count(FujiBusCounter::FRAMES_FOR_US);
+        link.frameForUs(nowMs);
     }
+    // Only ever a self-transition here, but it still restarts the timers
+    link.handle(entry.event, nowMs);
+    for (byte i = 0; i < entry.responses; i++) {
+        queueResponse(entry.kind[i], entry.response[i]);
+    }
+}
+
+void FujiHeatPump::sendResponse(FujiFrame& ff, FujiResponseKind kind) {
     byte writeBuf[kFrameSize];
     encodeFrame(ff, writeBuf);
+    frameCache.noteResponse(kind, writeBuf);
+    queueResponse(kind, writeBuf);
+}
 
-#ifdef DEBUG_FUJI
-    ESP_LOGD(TAG, "--> ");
-    printFrame(writeBuf, ff);
-#endif
+void FujiHeatPump::sendErrorQuery() {
+    ESP_LOGD(TAG, "Got error, asking for details");
+    // Nothing but the addressing and type: no default set point either
+    FujiFrame ff{};
+    memset(ff.raw, 0, sizeof(ff.raw));
+    ff.setMessageSource(controllerAddress);
+    ff.setMessageDest(static_cast<byte>(FujiAddress::UNIT));
+    ff.setUpdateMagic(10);
+    ff.setMessageType(static_cast<byte>(FujiMessageType::ERROR));
+    sendResponse(ff, FujiResponseKind::REQUEST);
+    // A repeat of this poll must not ask again
+    frameCache.discard();
+}
 
-    for (int i = 0; i < kFrameSize; i++) {
-        writeBuf[i] ^= 0xFF;
+void FujiHeatPump::echoChecked() {
+    FujiEchoCheck::Failure failure;
+    while (echo.takeFailure(failure)) {
+        bool collision = failure.result == FujiEchoResult::COLLISION;
+        health.count(collision ? FujiBusCounter::COLLISIONS : FujiBusCounter::ECHO_ERRORS);
+        trace.record(FujiTraceEvent::TX_LOST, failure.wire, static_cast<int32_t>(failure.result));
+
+        // Only the unit's next poll opens a slot, and its reply is built
+        // afresh; what must not be lost with the frame is a write or a
+        // one-off request
+        byte frame[kFrameSize];
+        for (size_t i = 0; i < kFrameSize; i++) {
+            frame[i] = failure.wire[i] ^ 0xFF;
+        }
+        byte type = FujiMessageTypeField::get(frame);
+        const char *what = "reply";
+        bool again = false;
+        if (type == static_cast<byte>(FujiMessageType::STATUS) && FujiWriteBitField::get(frame)) {
+            what = "write";
+            again = commands.writeLost((uint32_t) fujiMicros());
+        } else if (type == static_cast<byte>(FujiMessageType::ERROR)) {
+            what = "error detail request";
+            faults.queryLost();
+            // A cached answer to the unit's poll would skip the new request
+            frameCache.clear();
+            again = true;
+        }
+        if (again) {
+            health.count(FujiBusCounter::RETRANSMITS);
+        }
+        ESP_LOGD(TAG, "Our %s was lost (%s)%s", what, FujiEchoCheck::name(failure.result),
+                 again ? ", sending it again" : "");
     }
+}
 
-    if (xQueueSend(this->response_queue, &writeBuf, 0) != pdTRUE) {
-        ESP_LOGW(TAG, "Unable to send response into response_queue");
+void FujiHeatPump::queueResponse(FujiResponseKind kind, const byte *frame) {
+    if (!comms_is_enabled) {
+        trace.record(FujiTraceEvent::TX_SUPPRESSED, frame);
+        return;
+    }
+    trace.record(FujiTraceEvent::TX_QUEUED, frame);
+    switch (responses.push(kind, frame)) {
+        case FujiResponseQueued::QUEUED:
+            break;
+        case FujiResponseQueued::SUPERSEDED:
+            health.count(FujiBusCounter::RESPONSES_SUPERSEDED);
+            ESP_LOGV(TAG, "Status reply replaced one still waiting for its slot");
+            break;
+        case FujiResponseQueued::DROPPED:
+            trace.record(FujiTraceEvent::TX_QUEUE_FULL, frame);
+            health.count(FujiBusCounter::RESPONSE_DROPS);
+            ESP_LOGW(TAG, "Response queue full, dropping a response");
+            break;
     }
 }
 
 void FujiHeatPump::processReceivedFrame() {
     FujiFrame ff;
 
-    for (int i = 0; i < kFrameSize; i++) {
+    for (size_t i = 0; i < kFrameSize; i++) {
         readBuf[i] ^= 0xFF;
     }
 
-    ff = decodeFrame();
-
-#ifdef DEBUG_FUJI
-    ESP_LOGD(TAG, "<-- ");
-    printFrame(readBuf, ff);
-#endif
-
-    if (ff.messageDest == controllerAddress) {
-        ESP_LOGD(TAG, "Matched addr");
-        lastFrameReceived = xTaskGetTickCount();
-
-        if (ff.messageType == static_cast<byte>(FujiMessageType::STATUS)) {
-            ESP_LOGD(TAG, "status msg");
-            if (ff.loginBit) {
-                ESP_LOGD(TAG, "We are being asked to log in, primary=%d", controllerIsPrimary);
-                if (controllerIsPrimary) {
-                    // if this is the first message we have received,
+    trace.record(FujiTraceEvent::RX_FRAME, readBuf);
+    decodeFrame(ff);
+    uint32_t nowMs = fujiMillis();
+
+    if (ff.messageDest() == controllerAddress) {
+        health.count(FujiBusCounter::FRAMES_FOR_US);
+        link.frameForUs(nowMs);
+        frameCache.noteForUs();
+
+        if (ff.messageType() == static_cast<byte>(FujiMessageType::STATUS)) {
+            latency.statusReceived(ff);
+            uint32_t nowUs = (uint32_t) fujiMicros();
+            byte inFlight = commands.statusReceived(ff, nowUs);
+            FujiLinkEvent event = ff.loginBit() ? FujiLinkEvent::LOGIN_REQUEST : FujiLinkEvent::STATUS;
+            frameCache.noteEvent(event);
+            FujiLinkReply reply = linkEvent(event, nowMs);
+            switch (reply) {
+                case FujiLinkReply::LOGIN: {
                     // announce ourselves to the indoor unit
-                    uint8_t oldUpdateMagic = ff.updateMagic;
-                    memset(&ff, 0, sizeof(FujiFrame));
-                    ff.messageSource = controllerAddress;
-                    ff.messageDest = static_cast<byte>(FujiAddress::UNIT);
-                    ff.loginBit = true;
-                    ff.messageType =
-                        static_cast<byte>(FujiMessageType::LOGIN);
-                    ff.updateMagic = oldUpdateMagic;
-                    sendResponse(ff);
+                    uint8_t oldUpdateMagic = ff.updateMagic();
+                    // An all-zero frame bar what follows, as the original library sent
+                    ff = FujiFrame{};
+                    memset(ff.raw, 0, sizeof(ff.raw));
+                    ff.setMessageSource(controllerAddress);
+                    ff.setMessageDest(static_cast<byte>(FujiAddress::UNIT));
+                    ff.setLoginBit(true);
+                    ff.setMessageType(static_cast<byte>(FujiMessageType::LOGIN));
+                    ff.setUpdateMagic(oldUpdateMagic);
+                    sendResponse(ff, FujiResponseKind::LOGIN);
                     return;
-                } else {
+                }
+                case FujiLinkReply::PRESENT:
                     // secondary controller never seems to get any other
                     // message types, only status with controllerPresent ==
                     // 0 the secondary controller seems to send the same
                     // flags no matter which message type
-
-                    ff.messageSource = controllerAddress;
-                    ff.messageDest = static_cast<byte>(FujiAddress::UNIT);
-                    ff.loginBit = false;
-                    ff.controllerPresent = 1;
-                    ff.updateMagic = 2;
-                    ff.unknownBit = true;
-                    ff.writeBit = 0;
-                }
-            } else {
-                // we have logged into the indoor unit
-                // this is what most frames are
-                ff.messageSource = controllerAddress;
-
-                if (seenSecondaryController) {
-                    ff.messageDest =
-                        static_cast<byte>(FujiAddress::SECONDARY);
-                    ff.loginBit = true;
-                    ff.controllerPresent = 0;
-                } else {
-                    ff.messageDest = static_cast<byte>(FujiAddress::UNIT);
-                    ff.loginBit = false;
-                    ff.controllerPresent = 1;
-                }
-
-                ff.updateMagic = 0;
-                ff.unknownBit = true;
-                ff.writeBit = 0;
-                ff.messageType = static_cast<byte>(FujiMessageType::STATUS);
-            }
-
-#if 0
-            if (ff.acError) {
-                ESP_LOGD(TAG, "Got error, asking for details");
-                memset(&ff, 0, sizeof(FujiFrame));
-                ff.messageSource = controllerAddress;
-                ff.messageDest = static_cast<byte>(FujiAddress::UNIT);
-                ff.updateMagic = 10;
-                ff.messageType =
-                    static_cast<byte>(FujiMessageType::ERROR);
-                sendResponse(ff);
-                return;
-            }
-#endif
-
-            // if we have any updates, set the flags
-            if (!xSemaphoreTake(updateStateMutex, portMAX_DELAY)) {
-                ESP_LOGW(TAG, "Failed to take update state mutex");
-            }
-
-            if (updateFields) {
-                ff.writeBit = 1;
-                ESP_LOGD(TAG, "We have fields to update");
+                    ff.setMessageSource(controllerAddress);
+                    ff.setMessageDest(static_cast<byte>(FujiAddress::UNIT));
+                    ff.setLoginBit(false);
+                    ff.setControllerPresent(1);
+                    ff.setUpdateMagic(2);
+                    ff.setUnknownBit(true);
+                    ff.setWriteBit(0);
+                    break;
+                case FujiLinkReply::STATUS:
+                case FujiLinkReply::STATUS_SECONDARY:
+                    // we have logged into the indoor unit
+                    // this is what most frames are
+                    ff.setMessageSource(controllerAddress);
+                    if (reply == FujiLinkReply::STATUS_SECONDARY) {
+                        ff.setMessageDest(static_cast<byte>(FujiAddress::SECONDARY));
+                        ff.setLoginBit(true);
+                        ff.setControllerPresent(0);
+                    } else {
+                        ff.setMessageDest(static_cast<byte>(FujiAddress::UNIT));
+                        ff.setLoginBit(false);
+                        ff.setControllerPresent(1);
+                    }
+                    ff.setUpdateMagic(0);
+                    ff.setUnknownBit(true);
+                    ff.setWriteBit(0);
+                    ff.setMessageType(static_cast<byte>(FujiMessageType::STATUS));
+                    break;
+                default:
+                    return;
             }
 
-            if (updateFields & kOnOffUpdateMask) {
-                // updateStateMutex is held
-                ff.onOff = updateState.onOff;
-            }
+            // Only on the rising edge; the unit keeps the bit set for as long
+            // as the fault lasts. A secondary leaves asking to the primary.
+            bool queryError = faults.statusReceived(ff.acError()) && controllerIsPrimary;
 
-            if (updateFields & kTempUpdateMask) {
-                // updateStateMutex is held
-                ff.temperature = updateState.temperature;
+            // if a change is new or due a retry, set the flags
+            if (inFlight && commands.writeDue(nowUs)) {
+                ff.setWriteBit(1);
             }
 
-            if (updateFields & kModeUpdateMask) {
-                // updateStateMutex is held
-                ff.acMode = updateState.acMode;
-            }
+            ff.setOnOff(commands.inFlightOr(kOnOffUpdateMask, ff.onOff()));
+            ff.setTemperature(commands.inFlightOr(kTempUpdateMask, ff.temperature()));
+            ff.setAcMode(commands.inFlightOr(kModeUpdateMask, ff.acMode()));
+            ff.setFanMode(commands.inFlightOr(kFanModeUpdateMask, ff.fanMode()));
+            ff.setEconomyMode(commands.inFlightOr(kEconomyModeUpdateMask, ff.economyMode()));
+            ff.setSwingMode(commands.inFlightOr(kSwingModeUpdateMask, ff.swingMode()));
+            ff.setSwingStep(commands.inFlightOr(kSwingStepUpdateMask, ff.swingStep()));
 
-            if (updateFields & kFanModeUpdateMask) {
-                // updateStateMutex is held
-                ff.fanMode = updateState.fanMode;
-            }
+            updateCurrentState(ff);
 
-            if (updateFields & kSwingModeUpdateMask) {
-                // updateStateMutex is held
-                ff.swingMode = updateState.swingMode;
+            if (ff.writeBit()) {
+                ff.setUpdateMagic(10);
+                latency.writeQueued(inFlight);
+                commands.written(nowUs);
             }
-
-            if (updateFields & kSwingStepUpdateMask) {
-                // updateStateMutex is held
-                ff.swingStep = updateState.swingStep;
+            // Every poll gets an answer; a write used to be the only reply, and
+            // with nothing pending the unit would log us out
+            sendResponse(ff, FujiResponseKind::STATUS);
+            if (queryError) {
+                sendErrorQuery();
             }
-
-            memcpy(&currentState, &ff, sizeof(FujiFrame));
-
-            if (!xSemaphoreGive(updateStateMutex)) {
-                ESP_LOGW(TAG, "Failed to give update state mutex");
-            }
-
-            if (ff.writeBit) {
-                ff.updateMagic = 10;
-                ESP_LOGD(TAG, "Sending field updates");
-                sendResponse(ff);
+            return;
+        } else if (ff.messageType() ==
+                   static_cast<byte>(FujiMessageType::LOGIN)) {
+            frameCache.noteEvent(FujiLinkEvent::LOGIN);
+            if (linkEvent(FujiLinkEvent::LOGIN, nowMs) != FujiLinkReply::LOGIN_ACK) {
                 return;
             }
-        } else if (ff.messageType ==
-                   static_cast<byte>(FujiMessageType::LOGIN)) {
             ESP_LOGD(TAG, "recv a login msg, going to ack");
             // received a login frame OK frame
-            ff.loginBit = true;
-            ff.controllerPresent = 1;
-            ff.updateMagic = 0;
-            ff.unknownBit = true;
-            ff.writeBit = 0;
-
-            if (!xSemaphoreTake(updateStateMutex, portMAX_DELAY)) {
-                ESP_LOGW(TAG, "Failed to take update state mutex");
-            }
-
-            ff.onOff = currentState.onOff;
-            ff.temperature = currentState.temperature;
-            ff.acMode = currentState.acMode;
-            ff.fanMode = currentState.fanMode;
-            ff.swingMode = currentState.swingMode;
-            ff.swingStep = currentState.swingStep;
-            ff.acError = currentState.acError;
-            if (!xSemaphoreGive(updateStateMutex)) {
-                ESP_LOGW(TAG, "Failed to give update state mutex");
-            }
+            ff.setLoginBit(true);
+            ff.setControllerPresent(1);
+            ff.setUpdateMagic(0);
+            ff.setUnknownBit(true);
+            ff.setWriteBit(0);
+
+            FujiFrame current = currentState.read();
+            ff.setOnOff(current.onOff());
+            ff.setTemperature(current.temperature());
+            ff.setAcMode(current.acMode());
+            ff.setFanMode(current.fanMode());
+            ff.setSwingMode(current.swingMode());
+            ff.setSwingStep(current.swingStep());
+            ff.setAcError(current.acError());
 
             // ack the login
-            ff.messageDest = ff.messageSource;
-            ff.messageSource = controllerAddress;
-            ff.messageType = static_cast<byte>(FujiMessageType::STATUS);
-            sendResponse(ff);
+            ff.setMessageDest(ff.messageSource());
+            ff.setMessageSource(controllerAddress);
+            ff.setMessageType(static_cast<byte>(FujiMessageType::STATUS));
+            sendResponse(ff, FujiResponseKind::LOGIN);
 
             if (controllerIsPrimary) {
                 ESP_LOGD(TAG, "also pinging secondary on login");
                 // the primary will send packet to a secondary controller to see
                 // if it exists
-                ff.messageSource = controllerAddress;
-                ff.messageDest = static_cast<byte>(FujiAddress::SECONDARY);
-                ff.messageType = static_cast<byte>(FujiMessageType::LOGIN);
-                sendResponse(ff);
+                ff.setMessageSource(controllerAddress);
+                ff.setMessageDest(static_cast<byte>(FujiAddress::SECONDARY));
+                ff.setMessageType(static_cast<byte>(FujiMessageType::LOGIN));
+                sendResponse(ff, FujiResponseKind::LOGIN);
             }
             return;
-        } else if (ff.messageType ==
+        } else if (ff.messageType() ==
                    static_cast<byte>(FujiMessageType::ERROR)) {
-            ESP_LOGD(TAG, "AC ERROR RECV: ");
-            printFrame(readBuf, ff);
-            // handle errors here
+            byte code = FujiErrorCodeField::get(readBuf);
+            ESP_LOGD(TAG, "AC error detail received: 0x%02X", code);
+            faults.detailReceived(code, fujiMicros());
+            frameCache.discard();
         }
-    } else if (ff.messageDest ==
+    } else if (ff.messageDest() ==
                static_cast<byte>(FujiAddress::SECONDARY)) {
-        seenSecondaryController = true;
-        if (!xSemaphoreTake(updateStateMutex, portMAX_DELAY)) {
-            ESP_LOGW(TAG, "Failed to take update state mutex");
-        }
-        currentState.controllerTemp =
-            ff.controllerTemp;  // we dont have a temp sensor, use the temp
-                                // reading from the secondary controller
-        if (!xSemaphoreGive(updateStateMutex)) {
-            ESP_LOGW(TAG, "Failed to give update state mutex");
-        }
+        // only the UART task writes currentState, so this read-modify-write is safe
+        FujiFrame current = currentState.read();
+        // we dont have a temp sensor, use the temp reading from the secondary controller
+        current.setControllerTemp(ff.controllerTemp());
+        updateCurrentState(current);
+    } else if (controllerIsPrimary && ff.messageSource() == static_cast<byte>(FujiAddress::SECONDARY)) {
+        // Only the secondary's own replies show it is still there: the unit
+        // keeps polling one that has gone, and with the login bit clear its
+        // polls don't even decode as addressed to the secondary
+        frameCache.noteEvent(FujiLinkEvent::SECONDARY_SEEN);
+        linkEvent(FujiLinkEvent::SECONDARY_SEEN, nowMs);
     }
 }
 
-bool FujiHeatPump::isBound() {
-    if (xTaskGetTickCount() - lastFrameReceived < pdMS_TO_TICKS(1000))
-    {
-        return true;
+void FujiHeatPump::updateCurrentState(const FujiFrame &ff) {
+    FujiFrame current = currentState.read();
+    FujiFrame next = ff;
+    // A frame that passed parity can still carry a mode or fan speed there is
+    // no such thing as; keep what we had rather than hand it to the climate
+    if (next.acMode() > static_cast<byte>(FujiMode::AUTO)) {
+        next.setAcMode(current.acMode());
+    }
+    if (next.fanMode() > static_cast<byte>(FujiFanMode::FAN_HIGH)) {
+        next.setFanMode(current.fanMode());
+    }
+    // Unchanged writes would only bump the version and miss the frame cache
+    if (!fujiSameState(current, next)) {
+        currentState.write(next);
     }
-    return false;
 }
 
+bool FujiHeatPump::isBound() { return link.isBound(fujiMillis()); }
+
 bool FujiHeatPump::updatePending() {
-    if (updateFields) {
+    if (commands.pending()) {
         return true;
     }
     return false;
 }
 
-void FujiHeatPump::setOnOff(bool o) {
-    updateFields |= kOnOffUpdateMask;
-    updateState.onOff = o ? 1 : 0;
-}
-void FujiHeatPump::setTemp(byte t) {
-    updateFields |= kTempUpdateMask;
-    updateState.temperature = t;
-}
-void FujiHeatPump::setMode(byte m) {
-    updateFields |= kModeUpdateMask;
-    updateState.acMode = m;
-}
-void FujiHeatPump::setFanMode(byte fm) {
-    updateFields |= kFanModeUpdateMask;
-    updateState.fanMode = fm;
-}
-void FujiHeatPump::setEconomyMode(byte em) {
-    updateFields |= kEconomyModeUpdateMask;
-    updateState.economyMode = em;
-}
-void FujiHeatPump::setSwingMode(byte sm) {
-    updateFields |= kSwingModeUpdateMask;
-    updateState.swingMode = sm;
-}
-void FujiHeatPump::setSwingStep(byte ss) {
-    updateFields |= kSwingStepUpdateMask;
-    updateState.swingStep = ss;
+void FujiHeatPump::setUpdate(byte mask, byte value) {
+    if (listenOnly) {
+        ESP_LOGW(TAG, "Listen only, not changing update mask 0x%02X", mask);
+        return;
+    }
+    // The encoder would silently truncate it, so a stray value never makes it to the bus
+    if (!fujiUpdateValueValid(mask, value)) {
+        ESP_LOGW(TAG, "Dropping out of range value %d for update mask 0x%02X", value, mask);
+        return;
+    }
+    latency.issued(mask, value);
+    commands.request(mask, value);
 }
 
-bool FujiHeatPump::getOnOff() { return currentState.onOff == 1 ? true : false; }
-byte FujiHeatPump::getTemp() { return currentState.temperature; }
-byte FujiHeatPump::getMode() { return currentState.acMode; }
-byte FujiHeatPump::getFanMode() { return currentState.fanMode; }
-byte FujiHeatPump::getEconomyMode() { return currentState.economyMode; }
-byte FujiHeatPump::getSwingMode() { return currentState.swingMode; }
-byte FujiHeatPump::getSwingStep() { return currentState.swingStep; }
-byte FujiHeatPump::getControllerTemp() { return currentState.controllerTemp; }
-
-
-void FujiHeatPump::setState(FujiFrame *state) {
-    if (!xSemaphoreTake(updateStateMutex, portMAX_DELAY)) {
-        ESP_LOGW(TAG, "Failed to take update state mutex");
-    }
+void FujiHeatPump::setOnOff(bool o) { setUpdate(kOnOffUpdateMask, o ? 1 : 0); }
+void FujiHeatPump::setTemp(byte t) { setUpdate(kTempUpdateMask, t); }
+void FujiHeatPump::setMode(byte m) { setUpdate(kModeUpdateMask, m); }
+void FujiHeatPump::setFanMode(byte fm) { setUpdate(kFanModeUpdateMask, fm); }
+void FujiHeatPump::setEconomyMode(byte em) { setUpdate(kEconomyModeUpdateMask, em); }
+void FujiHeatPump::setSwingMode(byte sm) { setUpdate(kSwingModeUpdateMask, sm); }
+void FujiHeatPump::setSwingStep(byte ss) { setUpdate(kSwingStepUpdateMask, ss); }
+
+bool FujiHeatPump::getOnOff() { return currentState.read().onOff() == 1 ? true : false; }
+byte FujiHeatPump::getTemp() { return currentState.read().temperature(); }
+byte FujiHeatPump::getMode() { return currentState.read().acMode(); }
+byte FujiHeatPump::getFanMode() { return currentState.read().fanMode(); }
+byte FujiHeatPump::getEconomyMode() { return currentState.read().economyMode(); }
+byte FujiHeatPump::getSwingMode() { return currentState.read().swingMode(); }
+byte FujiHeatPump::getSwingStep() { return currentState.read().swingStep(); }
+byte FujiHeatPump::getControllerTemp() { return currentState.read().controllerTemp(); }
+
+FujiFrame FujiHeatPump::getCurrentState() { return currentState.read(); }
+
+void FujiHeatPump::setState(FujiFrame *state, byte fieldMask) {
     ESP_LOGD(TAG, "About to get the current state");
-    //vTaskDelay(pdMS_TO_TICKS(1000));
-    FujiFrame *current = &this->currentState;
-    if (state->onOff != current->onOff) {
+    FujiFrame current = currentState.read();
+    byte pending = commands.pending();
+    // Compare against what is already pending, if anything, so a request to
+    // go back to the current value still supersedes an older pending write
+    if ((fieldMask & kOnOffUpdateMask) && state->onOff() != commands.pendingOr(pending, kOnOffUpdateMask, current.onOff())) {
         ESP_LOGD(TAG, "About to change onoff");
-        //vTaskDelay(pdMS_TO_TICKS(1000));
-        this->setOnOff(state->onOff);
-        ESP_LOGD(TAG, "changed onoff");
-        //vTaskDelay(pdMS_TO_TICKS(1000));
+        this->setOnOff(state->onOff());
     }
 
-    if (state->temperature != current->temperature) {
-        this->setTemp(state->temperature);
+    if ((fieldMask & kTempUpdateMask) && state->temperature() != commands.pendingOr(pending, kTempUpdateMask, current.temperature())) {
+        this->setTemp(state->temperature());
     }
 
-    if (state->acMode != current->acMode) {
-        this->setMode(state->acMode);
+    if ((fieldMask & kModeUpdateMask) && state->acMode() != commands.pendingOr(pending, kModeUpdateMask, current.acMode())) {
+        this->setMode(state->acMode());
     }
 
-    if (state->fanMode != current->fanMode) {
-        this->setFanMode(state->fanMode);
+    if ((fieldMask & kFanModeUpdateMask) && state->fanMode() != commands.pendingOr(pending, kFanModeUpdateMask, current.fanMode())) {
+        this->setFanMode(state->fanMode());
     }
 
-    if (state->economyMode != current->economyMode) {
-        this->setEconomyMode(state->economyMode);
+    if ((fieldMask & kEconomyModeUpdateMask) &&
+        state->economyMode() != commands.pendingOr(pending, kEconomyModeUpdateMask, current.economyMode())) {
+        this->setEconomyMode(state->economyMode());
     }
 
-    if (state->swingMode != current->swingMode) {
-        this->setSwingMode(state->swingMode);
+    if ((fieldMask & kSwingModeUpdateMask) &&
+        state->swingMode() != commands.pendingOr(pending, kSwingModeUpdateMask, current.swingMode())) {
+        this->setSwingMode(state->swingMode());
     }
 
-    if (state->swingStep != current->swingStep) {
-        this->setSwingStep(state->swingStep);
-    }
-    if (!xSemaphoreGive(updateStateMutex)) {
-        ESP_LOGW(TAG, "Failed to give update state mutex");
+    if ((fieldMask & kSwingStepUpdateMask) &&
+        state->swingStep() != commands.pendingOr(pending, kSwingStepUpdateMask, current.swingStep())) {
+        this->setSwingStep(state->swingStep());
     }
     ESP_LOGD(TAG, "Successfully set state");
 }
 
-byte FujiHeatPump::getUpdateFields() { return updateFields; }
+byte FujiHeatPump::getUpdateFields() { return commands.pending(); }
+
+void FujiHeatPump::setPending(byte fields, const byte *values) { commands.restore(fields, values); }
 
 }
 }
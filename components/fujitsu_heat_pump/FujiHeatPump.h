@@ -1,85 +1,33 @@
 /* This file is based on unreality's FujiHeatPump project */
 #pragma once
 
-#include "esphome/core/component.h"
-#include "esphome/core/hal.h"
-#include "esphome/core/defines.h"
-
+#include "FujiBusHealth.h"
+#include "FujiCapture.h"
+#include "FujiCommands.h"
+#include "FujiEcho.h"
+#include "FujiFrame.h"
+#include "FujiFaults.h"
+#include "FujiFrameCache.h"
+#include "FujiFramer.h"
+#include "FujiLatency.h"
+#include "FujiLink.h"
+#include "FujiResponses.h"
+#include "FujiSniffer.h"
+#include "FujiTxScheduler.h"
+#include "FujiPlatform.h"
+#include "FujiSeqLock.h"
+#include "FujiTrace.h"
+
+#include <atomic>
+
+#ifdef ESP_PLATFORM
 #include "driver/uart.h"
-
-typedef uint8_t byte;
+#endif
 
 namespace esphome {
 namespace fujitsu {
 
-const size_t kFrameSize = 8;
-
-const byte kModeIndex = 3;
-const byte kModeMask = 0b00001110;
-const byte kModeOffset = 1;
-
-const byte kFanIndex = 3;
-const byte kFanMask = 0b01110000;
-const byte kFanOffset = 4;
-
-const byte kEnabledIndex = 3;
-const byte kEnabledMask = 0b00000001;
-const byte kEnabledOffset = 0;
-
-const byte kErrorIndex = 3;
-const byte kErrorMask = 0b10000000;
-const byte kErrorOffset = 7;
-
-const byte kEconomyIndex = 4;
-const byte kEconomyMask = 0b10000000;
-const byte kEconomyOffset = 7;
-
-const byte kTemperatureIndex = 4;
-const byte kTemperatureMask = 0b01111111;
-const byte kTemperatureOffset = 0;
-
-const byte kUpdateMagicIndex = 5;
-const byte kUpdateMagicMask = 0b11110000;
-const byte kUpdateMagicOffset = 4;
-
-const byte kSwingIndex = 5;
-const byte kSwingMask = 0b00000100;
-const byte kSwingOffset = 2;
-
-const byte kSwingStepIndex = 5;
-const byte kSwingStepMask = 0b00000010;
-const byte kSwingStepOffset = 1;
-
-const byte kControllerPresentIndex = 6;
-const byte kControllerPresentMask = 0b00000001;
-const byte kControllerPresentOffset = 0;
-
-const byte kControllerTempIndex = 6;
-const byte kControllerTempMask = 0b00111110;
-const byte kControllerTempOffset = 1;
-
-typedef struct FujiFrames {
-    byte onOff = 0;
-    byte temperature = 16;
-    byte acMode = 0;
-    byte fanMode = 0;
-    byte acError = 0;
-    byte economyMode = 0;
-    byte swingMode = 0;
-    byte swingStep = 0;
-    byte controllerPresent = 0;
-    byte updateMagic = 0;  // unsure what this value indicates
-    byte controllerTemp = 16;
-
-    bool writeBit = false;
-    bool loginBit = false;
-    bool errorBit = false;
-    bool unknownBit = false;  // unsure what this bit indicates
-
-    byte messageType = 0;
-    byte messageSource = 0;
-    byte messageDest = 0;
-} FujiFrame;
+class FujiTransport;
 
 class FujiHeatPump {
    private:
@@ -87,27 +35,35 @@ class FujiHeatPump {
 
     byte controllerAddress;
     bool controllerIsPrimary = true;
-    bool seenSecondaryController = false;
-    bool controllerLoggedIn = false;
-    TickType_t lastFrameReceived;
-
-    // This updateState and updateFields are protected by updateStateMutex in esp-idf
-    byte updateFields;
-    FujiFrame updateState;
-
-    FujiFrame currentState;
 
-    FujiFrame decodeFrame();
-    void encodeFrame(FujiFrame ff, byte* writeBuf);
-    void printFrame(byte buf[kFrameSize], FujiFrame ff);
-
-    QueueHandle_t uart_queue;
-    uart_port_t uart_port;
-    // This protects all accesses of updateState and updateFields
-    SemaphoreHandle_t updateStateMutex;
-    // This publishes state updates to the climate component
-
-    // Not safe b/c no mutexe
+    // Pending writes as last written to the capture
+    byte capturedFields = 0;
+    byte capturedValues[8] = {};
+
+    // Written only by the UART task, readable from any task without blocking it
+    FujiSeqLock<FujiFrame> currentState;
+    // The state as last handed to the climate; rewritten only when it changes,
+    // so its version() doubles as a change counter the climate can poll
+    FujiSeqLock<FujiFrame> publishedState;
+    FujiFrame lastPublished;
+    bool havePublished = false;
+
+    // Handling of recent frames, for answering repeats without decoding them
+    FujiFrameCache frameCache;
+
+    void decodeFrame(FujiFrame &ff);
+    void encodeFrame(const FujiFrame &ff, byte* writeBuf);
+
+    // Runs an event through the link state machine and returns its reply
+    FujiLinkReply linkEvent(FujiLinkEvent event, uint32_t nowMs);
+    // Bookkeeping after the link changed state
+    void linkChanged();
+    // Listen-only handling of a received wire frame
+    void sniffFrame(const byte *frame);
+    // Hands currentState to the climate if it changed and nothing is pending
+    void publishState();
+
+    void setUpdate(byte mask, byte value);
     void setOnOff(bool o);
     void setTemp(byte t);
     void setMode(byte m);
@@ -116,25 +72,87 @@ class FujiHeatPump {
     void setSwingMode(byte sm);
     void setSwingStep(byte ss);
    public:
-    FujiHeatPump() {
-        this->updateStateMutex = xSemaphoreCreateMutex();
-        this->state_dropbox = xQueueCreate(1, sizeof(FujiFrame));
-    }
-    friend void heat_pump_uart_event_task(void *);
-    void connect(uart_port_t uart_port, bool secondary,
-                           int rxPin = UART_PIN_NO_CHANGE, int txPin = UART_PIN_NO_CHANGE);
-    // This publishes state updates to the climate component
-    QueueHandle_t state_dropbox;
-
-    // Contains pending responses to be sent
-    QueueHandle_t response_queue;
+#ifdef ESP_PLATFORM
+    // Installs the UART driver and hands the bus to the shared service task;
+    // false if the port is taken or out of service slots
+    bool connect(uart_port_t uart_port, bool secondary,
+                 int rxPin = UART_PIN_NO_CHANGE, int txPin = UART_PIN_NO_CHANGE);
+#endif
+    // Sets up the addressing without touching any hardware; connect() calls this
+    void begin(bool secondary);
+
+    // The line this heat pump talks through, once connected; a host backend
+    // sets it up itself, after begin()
+    FujiTransport *transport = nullptr;
+
+    // Responses waiting for their slot, login traffic first and only the
+    // newest status reply per address
+    FujiResponseQueue responses;
+
+    // Splits the transport's byte stream into wire frames for handleFrame()
+    FujiFramer framer;
+
+    // Slots our responses relative to the frame they answer
+    FujiTxScheduler txScheduler;
+
+    // Compares what we send with what comes back off the wire
+    FujiEchoCheck echo;
+
+    // Every frame in and out, recorded by the UART task; read it with
+    // FujiTrace::read() and format it off the UART task
+    FujiTrace trace;
+
+    // Byte-level record of the session for replay on a host; the transport
+    // records what it reads and writes, handleFrame() the pending writes
+    FujiCapture capture;
+
+    // setState() changes until the unit confirms them
+    FujiCommandPipeline commands;
+
+    // How long setState() changes take to reach the unit and be echoed back
+    FujiCommandLatency latency;
+
+    // Counters for alerting on a degrading bus
+    FujiBusHealth health;
+
+    // Fault codes from the unit's error details, asked for when its error bit rises
+    FujiFaults faults;
+
+    // Login, secondary discovery and binding; its state and the time spent in
+    // each can be read from any task
+    FujiLink link;
+
+    // Every address heard on the bus, filled in listen-only mode
+    FujiSniffer sniffer;
+
+    // Entry point for the transport: runs one received wire frame through the
+    // protocol and publishes the resulting state
+    void handleFrame(const byte *frame);
+    // Pops the next pending response in wire form; false if there is nothing to send
+    bool nextResponse(byte *frame);
+    // Takes timed link transitions while the bus is quiet. The transport calls
+    // it whenever it wakes up; returns ms until it is next needed (UINT32_MAX
+    // if only a frame can change anything).
+    uint32_t poll();
 
     void processReceivedFrame();
-    void sendResponse(FujiFrame& ff);
+    void sendResponse(FujiFrame& ff, FujiResponseKind kind);
+    // Asks the unit for its error details, after the reply to its poll
+    void sendErrorQuery();
+    // Counts the echo checks that failed since the last call and arranges
+    // for what the lost frames carried to go out again in the next reply
+    void echoChecked();
+    // Queues an encoded (not yet inverted) frame for the transport
+    void queueResponse(FujiResponseKind kind, const byte *frame);
+    void replayCached(const FujiFrameCache::Entry &entry);
+    // Writes currentState only if the state in it actually changes
+    void updateCurrentState(const FujiFrame &ff);
     bool isBound();
     bool updatePending();
 
-    void setState(FujiFrame * state);
+    // Requests the fields selected by fieldMask (k*UpdateMask bits) to take the
+    // values in state. Safe to call from any task.
+    void setState(FujiFrame * state, byte fieldMask = kAllUpdateMask);
 
     bool getOnOff();
     byte getTemp();
@@ -144,54 +162,36 @@ class FujiHeatPump {
     byte getSwingMode();
     byte getSwingStep();
     byte getControllerTemp();
+    // Our bus address; broadcast frames in the trace decode as addressed to it
+    byte getControllerAddress() { return this->controllerAddress; }
+
+    FujiFrame getCurrentState();
+    // Bumped every time the published state changes; never blocks
+    uint32_t getStateVersion() { return publishedState.version(); }
+    // The state as of the latest getStateVersion() bump
+    FujiFrame getPublishedState() { return publishedState.read(); }
 
-    FujiFrame *getCurrentState();
-    // Removed b/c it's not mutex safe
-    //FujiFrame *getUpdateState();
-    
     byte getUpdateFields();
+    // Replaces the pending writes wholesale (values indexed by mask bit);
+    // only meant for replaying a capture
+    void setPending(byte fields, const byte *values);
 
     volatile bool comms_is_enabled = true;
+    // Only listen: frames fill the sniffer and the unit's status is published,
+    // but nothing is ever answered and setState() is ignored. Set before connect().
+    bool listenOnly = false;
+    // Answer repeated frames from the frame cache; off only for comparisons
+    bool useFrameCache = true;
+#ifdef ESP_PLATFORM
+    // RX tuning, set before connect(). The driver raises a data event once
+    // this many bytes are in the RX FIFO, so by default each whole frame
+    // arrives in one event as its last byte lands...
+    uint8_t rxFullThreshold = kFrameSize;
+    // ...and whatever is left of a partial frame after the line has been
+    // quiet for this many byte times
+    uint8_t rxTimeoutSymbols = 2;
+#endif
 };
 
-enum class FujiMode : byte {
-    UNKNOWN = 0,
-    FAN = 1,
-    DRY = 2,
-    COOL = 3,
-    HEAT = 4,
-    AUTO = 5,
-};
-
-enum class FujiMessageType : byte {
-    STATUS = 0,
-    ERROR = 1,
-    LOGIN = 2,
-    UNKNOWN = 3,
-};
-
-enum class FujiAddress : byte {
-    START = 0,
-    UNIT = 1,
-    PRIMARY = 32,
-    SECONDARY = 33,
-};
-
-enum class FujiFanMode : byte {
-    FAN_AUTO = 0,
-    FAN_QUIET = 1,
-    FAN_LOW = 2,
-    FAN_MEDIUM = 3,
-    FAN_HIGH = 4
-};
-
-const byte kOnOffUpdateMask = 0b10000000;
-const byte kTempUpdateMask = 0b01000000;
-const byte kModeUpdateMask = 0b00100000;
-const byte kFanModeUpdateMask = 0b00010000;
-const byte kEconomyModeUpdateMask = 0b00001000;
-const byte kSwingModeUpdateMask = 0b00000100;
-const byte kSwingStepUpdateMask = 0b00000010;
-
 }
 }
@@ -0,0 +1,98 @@
+#include "FujiLatency.h"
+
+namespace esphome {
+namespace fujitsu {
+
+// Upper bucket edges; the last bucket takes everything above 30 s
+static const uint32_t kBucketEdgesMs[FujiHistogram::kBuckets - 1] = {
+    25, 50, 75, 100, 150, 200, 250, 300, 400, 500, 600, 800, 1000,
+    1250, 1500, 2000, 2500, 3000, 4000, 5000, 7500, 10000, 15000, 30000,
+};
+
+void FujiHistogram::record(uint32_t us) {
+    size_t bucket = 0;
+    while (bucket < kBuckets - 1 && us > kBucketEdgesMs[bucket] * 1000) {
+        bucket++;
+    }
+    this->counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    this->total.fetch_add(1, std::memory_order_relaxed);
+    if (us > this->max.load(std::memory_order_relaxed)) {
+        this->max.store(us, std::memory_order_relaxed);
+    }
+}
+
+uint32_t FujiHistogram::percentileUs(float fraction) const {
+    uint32_t total = this->count();
+    if (total == 0) {
+        return 0;
+    }
+    uint32_t max = this->maxUs();
+    uint32_t rank = (uint32_t)(fraction * total + 0.5f);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint32_t seen = 0;
+    for (size_t bucket = 0; bucket < kBuckets - 1; bucket++) {
+        seen += this->counts[bucket].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint32_t edgeUs = kBucketEdgesMs[bucket] * 1000;
+            return edgeUs < max ? edgeUs : max;
+        }
+    }
+    return max;
+}
+
+void FujiCommandLatency::issued(byte mask, byte value) {
+    size_t bit = fujiMaskOffset(mask);
+    this->issuedUs[bit].store((uint32_t) fujiMicros(), std::memory_order_relaxed);
+    this->issuedValues[bit].store(value, std::memory_order_relaxed);
+    this->issuedFields.fetch_or(mask, std::memory_order_release);
+}
+
+void FujiCommandLatency::collect(uint32_t nowUs) {
+    byte fresh = this->issuedFields.exchange(0, std::memory_order_acquire);
+    for (size_t bit = 0; bit < 8; bit++) {
+        byte mask = 1 << bit;
+        if (fresh & mask) {
+            this->startUs[bit] = this->issuedUs[bit].load(std::memory_order_relaxed);
+            this->values[bit] = this->issuedValues[bit].load(std::memory_order_relaxed);
+            this->awaiting |= mask;
+            this->wired &= ~mask;
+        } else if ((this->awaiting & mask) && nowUs - this->startUs[bit] > kGiveUpUs) {
+            this->awaiting &= ~mask;
+            this->unconfirmed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void FujiCommandLatency::writeQueued(byte fields) {
+    uint32_t nowUs = (uint32_t) fujiMicros();
+    this->collect(nowUs);
+    byte first = fields & this->awaiting & ~this->wired;
+    for (size_t bit = 0; bit < 8; bit++) {
+        if (first & (1 << bit)) {
+            this->wireUs[bit] = nowUs;
+            this->toWire.record(nowUs - this->startUs[bit]);
+        }
+    }
+    this->wired |= first;
+}
+
+void FujiCommandLatency::statusReceived(const FujiFrame &unit) {
+    uint32_t nowUs = (uint32_t) fujiMicros();
+    this->collect(nowUs);
+    for (size_t bit = 0; bit < 8; bit++) {
+        byte mask = 1 << bit;
+        if (!(this->awaiting & mask) || kUpdateFields[bit].get(unit) != this->values[bit]) {
+            continue;
+        }
+        this->endToEnd.record(nowUs - this->startUs[bit]);
+        if (this->wired & mask) {
+            this->unitApply.record(nowUs - this->wireUs[bit]);
+        }
+        this->awaiting &= ~mask;
+    }
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "FujiFrame.h"
+#include "FujiPlatform.h"
+
+#include <atomic>
+
+namespace esphome {
+namespace fujitsu {
+
+// Latency histogram with fixed buckets from 25 ms to 30 s. One task records,
+// any task can read; a read racing a record may be off by that one sample.
+class FujiHistogram {
+   public:
+    static const size_t kBuckets = 25;
+
+    void record(uint32_t us);
+
+    uint32_t count() const { return this->total.load(std::memory_order_relaxed); }
+    uint32_t maxUs() const { return this->max.load(std::memory_order_relaxed); }
+    // Upper edge of the bucket holding that fraction of samples, capped at
+    // the largest sample; 0 while empty
+    uint32_t percentileUs(float fraction) const;
+
+   private:
+    std::atomic<uint32_t> counts[kBuckets] = {};
+    std::atomic<uint32_t> total{0};
+    std::atomic<uint32_t> max{0};
+};
+
+// Follows each setState() field change to the wire and back. Stages:
+//   issued   setState() published the change (control() calls it directly)
+//   wire     a write-bit frame carrying the field was queued
+//   echo     a status frame from the unit reported the new value
+// A newer change to the same field before the echo replaces the older one.
+class FujiCommandLatency {
+   public:
+    // Any task; call before the change is published to the UART task
+    void issued(byte mask, byte value);
+
+    // UART task only
+    void writeQueued(byte fields);
+    void statusReceived(const FujiFrame &unit);
+    // Nothing issued or awaiting an echo
+    bool idle() const { return this->awaiting == 0 && this->issuedFields.load(std::memory_order_relaxed) == 0; }
+
+    // issued -> wire, wire -> echo, issued -> echo
+    FujiHistogram toWire;
+    FujiHistogram unitApply;
+    FujiHistogram endToEnd;
+    // Changes that never echoed within kGiveUpUs
+    std::atomic<uint32_t> unconfirmed{0};
+
+    static const uint32_t kGiveUpUs = 60000000;
+
+   private:
+    void collect(uint32_t nowUs);
+
+    std::atomic<uint32_t> issuedFields{0};
+    std::atomic<uint32_t> issuedUs[8] = {};
+    std::atomic<uint32_t> issuedValues[8] = {};
+
+    // UART task state
+    byte awaiting = 0;
+    byte wired = 0;
+    uint32_t startUs[8] = {};
+    uint32_t wireUs[8] = {};
+    byte values[8] = {};
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
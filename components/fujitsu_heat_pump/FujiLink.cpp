@@ -0,0 +1,179 @@
+#include "FujiLink.h"
+
+namespace esphome {
+namespace fujitsu {
+
+namespace {
+
+typedef FujiLinkState S;
+typedef FujiLinkReply R;
+
+struct Transition {
+    FujiLinkState next;
+    FujiLinkReply reply;
+};
+
+const size_t kStates = static_cast<size_t>(FujiLinkState::COUNT);
+const size_t kEvents = static_cast<size_t>(FujiLinkEvent::COUNT);
+
+// Columns: NONE, LOGIN_REQUEST, LOGIN, STATUS, SECONDARY_SEEN
+const Transition kPrimaryTable[kStates][kEvents] = {
+    // UNBOUND: a plain status means the unit still has us logged in
+    {{S::UNBOUND, R::NONE}, {S::LOGGING_IN, R::LOGIN}, {S::DISCOVERING, R::LOGIN_ACK}, {S::BOUND, R::STATUS},
+     {S::UNBOUND, R::NONE}},
+    // LOGGING_IN: repeated login requests get the login again
+    {{S::LOGGING_IN, R::NONE}, {S::LOGGING_IN, R::LOGIN}, {S::DISCOVERING, R::LOGIN_ACK}, {S::BOUND, R::STATUS},
+     {S::LOGGING_IN, R::NONE}},
+    // DISCOVERING
+    {{S::DISCOVERING, R::NONE}, {S::LOGGING_IN, R::LOGIN}, {S::DISCOVERING, R::LOGIN_ACK},
+     {S::DISCOVERING, R::STATUS}, {S::BOUND_SECONDARY, R::NONE}},
+    // BOUND
+    {{S::BOUND, R::NONE}, {S::LOGGING_IN, R::LOGIN}, {S::DISCOVERING, R::LOGIN_ACK}, {S::BOUND, R::STATUS},
+     {S::BOUND_SECONDARY, R::NONE}},
+    // BOUND_SECONDARY
+    {{S::BOUND_SECONDARY, R::NONE}, {S::LOGGING_IN, R::LOGIN}, {S::DISCOVERING, R::LOGIN_ACK},
+     {S::BOUND_SECONDARY, R::STATUS_SECONDARY}, {S::BOUND_SECONDARY, R::NONE}},
+};
+
+// A secondary never logs in; being polled is all there is to it
+const Transition kSecondaryTable[kStates][kEvents] = {
+    {{S::UNBOUND, R::NONE}, {S::BOUND, R::PRESENT}, {S::BOUND, R::LOGIN_ACK}, {S::BOUND, R::STATUS},
+     {S::UNBOUND, R::NONE}},
+    {{S::LOGGING_IN, R::NONE}, {S::BOUND, R::PRESENT}, {S::BOUND, R::LOGIN_ACK}, {S::BOUND, R::STATUS},
+     {S::LOGGING_IN, R::NONE}},
+    {{S::DISCOVERING, R::NONE}, {S::BOUND, R::PRESENT}, {S::BOUND, R::LOGIN_ACK}, {S::BOUND, R::STATUS},
+     {S::DISCOVERING, R::NONE}},
+    {{S::BOUND, R::NONE}, {S::BOUND, R::PRESENT}, {S::BOUND, R::LOGIN_ACK}, {S::BOUND, R::STATUS},
+     {S::BOUND, R::NONE}},
+    {{S::BOUND_SECONDARY, R::NONE}, {S::BOUND, R::PRESENT}, {S::BOUND, R::LOGIN_ACK}, {S::BOUND, R::STATUS},
+     {S::BOUND_SECONDARY, R::NONE}},
+};
+
+enum class Since : uint8_t {
+    ENTERED,    // the current state was entered
+    FOR_US,     // the last frame addressed to us
+    SECONDARY,  // the secondary last answered the unit (SECONDARY_SEEN)
+};
+
+struct Timeout {
+    FujiLinkState state;
+    Since since;
+    uint32_t ms;
+    FujiLinkState next;
+};
+
+// Checked in order; the first one due wins
+const Timeout kTimeouts[] = {
+    {S::LOGGING_IN, Since::FOR_US, FujiLink::kSilenceMs, S::UNBOUND},
+    {S::DISCOVERING, Since::FOR_US, FujiLink::kSilenceMs, S::UNBOUND},
+    {S::BOUND, Since::FOR_US, FujiLink::kSilenceMs, S::UNBOUND},
+    {S::BOUND_SECONDARY, Since::FOR_US, FujiLink::kSilenceMs, S::UNBOUND},
+    {S::LOGGING_IN, Since::ENTERED, FujiLink::kLoginTimeoutMs, S::UNBOUND},
+    {S::DISCOVERING, Since::ENTERED, FujiLink::kDiscoveryMs, S::BOUND},
+    {S::BOUND_SECONDARY, Since::SECONDARY, FujiLink::kSecondaryLostMs, S::BOUND},
+};
+
+}  // namespace
+
+void FujiLink::begin(bool primary, uint32_t nowMs) {
+    this->primary = primary;
+    this->current = FujiLinkState::UNBOUND;
+    this->enteredMs = nowMs;
+    this->local = FujiLinkStats();
+    this->local.enteredMs = nowMs;
+    this->stats.write(this->local);
+}
+
+FujiLinkState FujiLink::next(FujiLinkEvent event) const {
+    const Transition(&table)[kStates][kEvents] = this->primary ? kPrimaryTable : kSecondaryTable;
+    return table[static_cast<size_t>(this->current)][static_cast<size_t>(event)].next;
+}
+
+FujiLinkReply FujiLink::handle(FujiLinkEvent event, uint32_t nowMs) {
+    const Transition(&table)[kStates][kEvents] = this->primary ? kPrimaryTable : kSecondaryTable;
+    const Transition &t = table[static_cast<size_t>(this->current)][static_cast<size_t>(event)];
+    if (event == FujiLinkEvent::SECONDARY_SEEN) {
+        this->lastSecondaryMs = nowMs;
+    }
+    if (t.next != this->current) {
+        this->enter(t.next, nowMs);
+    }
+    return t.reply;
+}
+
+bool FujiLink::expire(uint32_t nowMs) {
+    for (const Timeout &t : kTimeouts) {
+        if (t.state != this->current) {
+            continue;
+        }
+        if (nowMs - this->sinceMs(static_cast<uint8_t>(t.since)) >= t.ms) {
+            this->enter(t.next, nowMs);
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t FujiLink::nextTimeoutMs(uint32_t nowMs) const {
+    uint32_t soonest = UINT32_MAX;
+    for (const Timeout &t : kTimeouts) {
+        if (t.state != this->current) {
+            continue;
+        }
+        uint32_t elapsed = nowMs - this->sinceMs(static_cast<uint8_t>(t.since));
+        uint32_t left = elapsed >= t.ms ? 0 : t.ms - elapsed;
+        if (left < soonest) {
+            soonest = left;
+        }
+    }
+    return soonest;
+}
+
+uint32_t FujiLink::sinceMs(uint8_t since) const {
+    switch (static_cast<Since>(since)) {
+        case Since::ENTERED:
+            return this->enteredMs;
+        case Since::FOR_US:
+            return this->lastForUsMs.load(std::memory_order_relaxed);
+        default:
+            return this->lastSecondaryMs;
+    }
+}
+
+void FujiLink::enter(FujiLinkState state, uint32_t nowMs) {
+    this->local.timeInStateMs[static_cast<size_t>(this->current)] += nowMs - this->enteredMs;
+    this->local.transitions++;
+    this->local.state = state;
+    this->local.enteredMs = nowMs;
+    this->current = state;
+    this->enteredMs = nowMs;
+    if (state == FujiLinkState::BOUND_SECONDARY) {
+        this->lastSecondaryMs = nowMs;
+    }
+    this->stats.write(this->local);
+}
+
+bool FujiLink::isBound(uint32_t nowMs) const {
+    FujiLinkState state = this->stats.read().state;
+    if (state == FujiLinkState::UNBOUND || state == FujiLinkState::LOGGING_IN) {
+        return false;
+    }
+    return nowMs - this->lastForUsMs.load(std::memory_order_relaxed) < kSilenceMs;
+}
+
+uint32_t FujiLink::timeInStateMs(const FujiLinkStats &stats, FujiLinkState state, uint32_t nowMs) {
+    uint32_t ms = stats.timeInStateMs[static_cast<size_t>(state)];
+    if (stats.state == state) {
+        ms += nowMs - stats.enteredMs;
+    }
+    return ms;
+}
+
+const char *FujiLink::name(FujiLinkState state) {
+    static const char *const names[] = {"unbound", "logging in", "discovering", "bound", "bound (secondary)"};
+    size_t i = static_cast<size_t>(state);
+    return i < sizeof(names) / sizeof(names[0]) ? names[i] : "?";
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
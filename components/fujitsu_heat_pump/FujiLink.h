@@ -0,0 +1,105 @@
+#pragma once
+
+#include "FujiPlatform.h"
+#include "FujiSeqLock.h"
+
+#include <atomic>
+
+namespace esphome {
+namespace fujitsu {
+
+enum class FujiLinkState : uint8_t {
+    UNBOUND = 0,      // nothing addressed to us lately
+    LOGGING_IN,       // primary: announced ourselves, waiting for the unit's login frame
+    DISCOVERING,      // primary: logged in, listening for a secondary controller
+    BOUND,            // exchanging status frames with the unit
+    BOUND_SECONDARY,  // as BOUND, with a secondary controller on the bus
+    COUNT,
+};
+
+enum class FujiLinkEvent : uint8_t {
+    NONE = 0,        // tells us nothing about the link
+    LOGIN_REQUEST,   // status frame for us with the login bit set
+    LOGIN,           // login frame for us
+    STATUS,          // any other status frame for us
+    SECONDARY_SEEN,  // the secondary controller answered the unit
+    COUNT,
+};
+
+// What the controller answers an event with in the state it leads to
+enum class FujiLinkReply : uint8_t {
+    NONE = 0,
+    LOGIN,             // announce ourselves to the unit
+    PRESENT,           // secondary: report ourselves present, login bit clear
+    STATUS,            // status to the unit
+    STATUS_SECONDARY,  // status to the secondary controller
+    LOGIN_ACK,         // ack the login; the primary also pings the secondary
+};
+
+struct FujiLinkStats {
+    FujiLinkState state = FujiLinkState::UNBOUND;
+    uint32_t enteredMs = 0;
+    uint32_t transitions = 0;
+    // Time spent in each state, not counting the current stay
+    uint32_t timeInStateMs[static_cast<size_t>(FujiLinkState::COUNT)] = {};
+};
+
+// The controller's side of the link with the indoor unit. Received frames
+// become events, and a transition table per role (primary or secondary) maps
+// each state and event to the next state and the reply. A second table holds
+// the timed transitions: a stalled login, the end of secondary discovery, a
+// secondary that stopped answering the unit's polls (going by its own
+// replies, SECONDARY_SEEN) and silence from the unit. Silence
+// always drops to UNBOUND, so the next login request starts from scratch.
+class FujiLink {
+   public:
+    // No frame for us for this long and the unit has forgotten us (or is off).
+    // With a secondary on the bus the unit polls each controller about once a
+    // second, so this has to leave room for a late poll.
+    static const uint32_t kSilenceMs = 2000;
+    // Login requests that go unanswered for this long start over
+    static const uint32_t kLoginTimeoutMs = 3000;
+    // How long after logging in a secondary has to show up
+    static const uint32_t kDiscoveryMs = 3000;
+    // A secondary answers every poll for it; this long without a reply and it is gone
+    static const uint32_t kSecondaryLostMs = 10000;
+
+    void begin(bool primary, uint32_t nowMs);
+
+    // UART task only
+    // Takes the transition for event and returns the reply it calls for
+    FujiLinkReply handle(FujiLinkEvent event, uint32_t nowMs);
+    // Where event would lead from here, without taking it
+    FujiLinkState next(FujiLinkEvent event) const;
+    // Any frame addressed to us, whatever its type; holds off the silence timeout
+    void frameForUs(uint32_t nowMs) { this->lastForUsMs.store(nowMs, std::memory_order_relaxed); }
+    // Takes the timed transition that is due, if any; true if the state changed
+    bool expire(uint32_t nowMs);
+    // ms until expire() has something to do, UINT32_MAX if nothing is timed
+    uint32_t nextTimeoutMs(uint32_t nowMs) const;
+    FujiLinkState state() const { return this->current; }
+
+    // Any task
+    // Logged in (or polled, as a secondary) and not silent
+    bool isBound(uint32_t nowMs) const;
+    FujiLinkStats getStats() const { return this->stats.read(); }
+    // Total time in state up to nowMs, including the current stay
+    static uint32_t timeInStateMs(const FujiLinkStats &stats, FujiLinkState state, uint32_t nowMs);
+    static const char *name(FujiLinkState state);
+
+   private:
+    void enter(FujiLinkState state, uint32_t nowMs);
+    // Start of the interval a timeout row measures (its Since clock)
+    uint32_t sinceMs(uint8_t since) const;
+
+    bool primary = true;
+    FujiLinkState current = FujiLinkState::UNBOUND;
+    uint32_t enteredMs = 0;
+    uint32_t lastSecondaryMs = 0;
+    std::atomic<uint32_t> lastForUsMs{0};
+    FujiLinkStats local;
+    FujiSeqLock<FujiLinkStats> stats;
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
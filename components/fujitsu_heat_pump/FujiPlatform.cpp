@@ -0,0 +1,56 @@
+/* Thin RTOS/logging shim so the protocol core builds both on ESP-IDF and on a host */
+
+#include "FujiPlatform.h"
+
+#ifndef ESP_PLATFORM
+#include <chrono>
+#include <stdarg.h>
+#include <stdio.h>
+#endif
+
+namespace esphome {
+namespace fujitsu {
+
+#ifdef ESP_PLATFORM
+
+uint32_t fujiMillis() { return xTaskGetTickCount() * portTICK_PERIOD_MS; }
+
+uint64_t fujiMicros() { return esp_timer_get_time(); }
+
+#else
+
+int fujiHostLogLevel = FUJI_LOG_WARN;
+
+void fujiHostLog(int level, const char *tag, const char *format, ...) {
+    static const char levelChars[] = "-EWIDV";
+    if (level > fujiHostLogLevel) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "[%c][%s]: ", levelChars[level], tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+static FujiHostClock hostClock = nullptr;
+
+void fujiSetHostClock(FujiHostClock clock) { hostClock = clock; }
+
+uint64_t fujiMicros() {
+    static const auto boot = std::chrono::steady_clock::now();
+    if (hostClock != nullptr) {
+        return hostClock();
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - boot)
+        .count();
+}
+
+uint32_t fujiMillis() { return fujiMicros() / 1000; }
+
+#endif
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -0,0 +1,58 @@
+/* Thin RTOS/logging shim so the protocol core builds both on ESP-IDF and on a host */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esphome/core/log.h"
+#else
+
+namespace esphome {
+namespace fujitsu {
+enum FujiHostLogLevel {
+    FUJI_LOG_NONE = 0,
+    FUJI_LOG_ERROR,
+    FUJI_LOG_WARN,
+    FUJI_LOG_INFO,
+    FUJI_LOG_DEBUG,
+    FUJI_LOG_VERBOSE,
+};
+// Host builds log to stderr, only up to this level (default FUJI_LOG_WARN)
+extern int fujiHostLogLevel;
+void fujiHostLog(int level, const char *tag, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+}  // namespace fujitsu
+}  // namespace esphome
+
+#define ESP_LOGE(tag, ...) ::esphome::fujitsu::fujiHostLog(::esphome::fujitsu::FUJI_LOG_ERROR, tag, __VA_ARGS__)
+#define ESP_LOGW(tag, ...) ::esphome::fujitsu::fujiHostLog(::esphome::fujitsu::FUJI_LOG_WARN, tag, __VA_ARGS__)
+#define ESP_LOGI(tag, ...) ::esphome::fujitsu::fujiHostLog(::esphome::fujitsu::FUJI_LOG_INFO, tag, __VA_ARGS__)
+#define ESP_LOGD(tag, ...) ::esphome::fujitsu::fujiHostLog(::esphome::fujitsu::FUJI_LOG_DEBUG, tag, __VA_ARGS__)
+#define ESP_LOGV(tag, ...) ::esphome::fujitsu::fujiHostLog(::esphome::fujitsu::FUJI_LOG_VERBOSE, tag, __VA_ARGS__)
+#define ESP_LOGCONFIG(tag, ...) ::esphome::fujitsu::fujiHostLog(::esphome::fujitsu::FUJI_LOG_INFO, tag, __VA_ARGS__)
+#endif
+
+typedef uint8_t byte;
+
+namespace esphome {
+namespace fujitsu {
+
+// Milliseconds since boot (FreeRTOS tick count on ESP32, steady_clock on host)
+uint32_t fujiMillis();
+// Microseconds since boot (esp_timer on ESP32, steady_clock on host)
+uint64_t fujiMicros();
+
+#ifndef ESP_PLATFORM
+// Host builds can run on a virtual clock instead, e.g. the bus simulator's.
+// The function returns microseconds; pass nullptr to go back to steady_clock.
+typedef uint64_t (*FujiHostClock)();
+void fujiSetHostClock(FujiHostClock clock);
+#endif
+
+}  // namespace fujitsu
+}  // namespace esphome
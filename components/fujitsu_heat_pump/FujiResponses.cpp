@@ -0,0 +1,75 @@
+#include "FujiResponses.h"
+
+#include <string.h>
+
+namespace esphome {
+namespace fujitsu {
+
+FujiResponseQueued FujiResponseQueue::push(FujiResponseKind kind, const byte *frame) {
+    if (kind == FujiResponseKind::STATUS) {
+        byte dest = FujiDestField::get(frame);
+        for (size_t i = 0; i < this->count; i++) {
+            Entry &e = this->entries[i];
+            if (e.kind != FujiResponseKind::STATUS || FujiDestField::get(e.frame) != dest) {
+                continue;
+            }
+            bool wasWrite = FujiWriteBitField::get(e.frame);
+            memcpy(e.frame, frame, kFrameSize);
+            if (wasWrite && !FujiWriteBitField::get(e.frame)) {
+                FujiWriteBitField::put(e.frame, 1);
+                FujiUpdateMagicField::put(e.frame, 10);
+            }
+            this->stats.superseded++;
+            return FujiResponseQueued::SUPERSEDED;
+        }
+    }
+    if (this->count == kCapacity) {
+        this->stats.dropped++;
+        return FujiResponseQueued::DROPPED;
+    }
+    // Behind everything of the same or a more urgent kind
+    size_t at = this->count;
+    if (kind == FujiResponseKind::LOGIN) {
+        at = 0;
+        while (at < this->count && this->entries[at].kind == FujiResponseKind::LOGIN) {
+            at++;
+        }
+    }
+    memmove(&this->entries[at + 1], &this->entries[at], (this->count - at) * sizeof(Entry));
+    this->entries[at].kind = kind;
+    memcpy(this->entries[at].frame, frame, kFrameSize);
+    this->stats.queued++;
+    this->setCount(this->count + 1);
+    return FujiResponseQueued::QUEUED;
+}
+
+bool FujiResponseQueue::front(byte *wire) const {
+    if (this->count == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < kFrameSize; i++) {
+        wire[i] = this->entries[0].frame[i] ^ 0xFF;
+    }
+    return true;
+}
+
+void FujiResponseQueue::pop() {
+    if (this->count == 0) {
+        return;
+    }
+    memmove(&this->entries[0], &this->entries[1], (this->count - 1) * sizeof(Entry));
+    this->setCount(this->count - 1);
+}
+
+void FujiResponseQueue::clear() { this->setCount(0); }
+
+void FujiResponseQueue::setCount(size_t count) {
+    this->count = count;
+    this->depthNow.store(count, std::memory_order_relaxed);
+    if (count > this->peak.load(std::memory_order_relaxed)) {
+        this->peak.store(count, std::memory_order_relaxed);
+    }
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "FujiFrame.h"
+
+#include <atomic>
+
+namespace esphome {
+namespace fujitsu {
+
+enum class FujiResponseKind : uint8_t {
+    LOGIN = 0,  // login, login ack, secondary ping: the link waits on these
+    STATUS,     // reply to a poll; only the newest for an address is worth sending
+    REQUEST,    // one-off request such as error details, never replaced
+};
+
+enum class FujiResponseQueued : uint8_t {
+    QUEUED = 0,
+    SUPERSEDED,  // took the place of an older status reply to the same address
+    DROPPED,     // no room, the frame was not queued
+};
+
+struct FujiResponseStats {
+    uint32_t queued = 0;
+    uint32_t superseded = 0;
+    uint32_t dropped = 0;
+};
+
+// Responses waiting for their reply slot. Login traffic goes ahead of
+// everything else, the rest in the order it was queued. A status reply only
+// carries our view of the state, so one that hasn't gone out yet is replaced
+// by a newer one to the same address, keeping its place in the queue; a
+// write bit on the older one carries over, as its changes are still in flight.
+//
+// Only the task serving the bus queues and sends; depth() and takePeakDepth()
+// may be read from anywhere.
+class FujiResponseQueue {
+   public:
+    static const size_t kCapacity = 8;
+
+    // Queues an encoded (not yet inverted) frame
+    FujiResponseQueued push(FujiResponseKind kind, const byte *frame);
+    // Next response to send, in wire form; false if there is none. It stays
+    // queued, and can still be superseded, until pop().
+    bool front(byte *wire) const;
+    void pop();
+    void clear();
+
+    size_t depth() const { return this->depthNow.load(std::memory_order_relaxed); }
+    // Deepest the queue got since the last call
+    size_t takePeakDepth() { return this->peak.exchange(this->depth(), std::memory_order_relaxed); }
+    const FujiResponseStats &getStats() const { return this->stats; }
+
+   private:
+    struct Entry {
+        FujiResponseKind kind;
+        byte frame[kFrameSize];
+    };
+
+    void setCount(size_t count);
+
+    Entry entries[kCapacity];
+    size_t count = 0;
+    std::atomic<uint8_t> depthNow{0};
+    std::atomic<uint8_t> peak{0};
+    FujiResponseStats stats;
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
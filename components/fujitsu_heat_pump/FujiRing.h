@@ -0,0 +1,77 @@
+#pragma once
+
+#include "FujiSeqLock.h"
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace esphome {
+namespace fujitsu {
+
+// Where a reader has got to in a FujiRecordRing
+struct FujiRingCursor {
+    uint32_t next = 0;
+    // Records overwritten before this reader got to them
+    uint32_t lost = 0;
+};
+
+// Fixed-size ring of records with one recording task and any number of
+// readers, each with its own cursor. Recording never blocks or fails; the
+// oldest record is overwritten and slow readers are told what they lost.
+// T needs a uint32_t seq member, which the ring fills in (1-based).
+template <typename T, size_t N>
+class FujiRecordRing {
+   public:
+    static const size_t kSize = N;
+
+    // Only ever called from one task
+    void record(T &rec) {
+        rec.seq = this->head.load(std::memory_order_relaxed) + 1;
+        this->slots[(rec.seq - 1) % N].write(rec);
+        this->head.store(rec.seq, std::memory_order_release);
+    }
+
+    // Copies out the next record after cursor; false once caught up
+    bool read(FujiRingCursor &cursor, T &out) const {
+        uint32_t head = this->head.load(std::memory_order_acquire);
+        if (cursor.next == head) {
+            return false;
+        }
+        if (head - cursor.next > N) {
+            cursor.lost += head - N - cursor.next;
+            cursor.next = head - N;
+        }
+        T rec = this->slots[cursor.next % N].read();
+        if (rec.seq != cursor.next + 1) {
+            // Overwritten since we loaded head; everything older than the ring is gone
+            uint32_t oldest = rec.seq - N;
+            cursor.lost += oldest - cursor.next;
+            cursor.next = oldest;
+            rec = this->slots[cursor.next % N].read();
+            if (rec.seq != cursor.next + 1) {
+                // Lapped again; leave it for the next call
+                return false;
+            }
+        }
+        out = rec;
+        cursor.next++;
+        return true;
+    }
+
+    // A cursor that only sees records made from now on
+    FujiRingCursor tail() const {
+        FujiRingCursor cursor;
+        cursor.next = this->recorded();
+        return cursor;
+    }
+
+    uint32_t recorded() const { return this->head.load(std::memory_order_acquire); }
+
+   private:
+    std::atomic<uint32_t> head{0};
+    FujiSeqLock<T> slots[N];
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+namespace esphome {
+namespace fujitsu {
+
+// Single-writer sequence lock. The writer never blocks or retries, so the
+// UART task can publish through it mid-frame; readers retry on the rare
+// occasion they overlap a write. The value is kept in relaxed atomic words
+// so a torn read is well defined (and then discarded).
+template <typename T>
+class FujiSeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "FujiSeqLock needs a trivially copyable type");
+    static const size_t kWords = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+   public:
+    FujiSeqLock() { write(T()); }
+
+    // Only ever called from one task
+    void write(const T &value) {
+        uint32_t raw[kWords] = {};
+        memcpy(raw, &value, sizeof(T));
+        uint32_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < kWords; i++) {
+            words[i].store(raw[i], std::memory_order_relaxed);
+        }
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    T read() const {
+        uint32_t raw[kWords];
+        uint32_t before, after;
+        do {
+            before = sequence.load(std::memory_order_acquire);
+            for (size_t i = 0; i < kWords; i++) {
+                raw[i] = words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while (before != after || (before & 1));
+        T value;
+        memcpy(&value, raw, sizeof(T));
+        return value;
+    }
+
+    // Bumped by every write; lets readers skip work when nothing changed
+    uint32_t version() const { return sequence.load(std::memory_order_acquire) >> 1; }
+
+   private:
+    std::atomic<uint32_t> sequence{0};
+    std::atomic<uint32_t> words[kWords];
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -0,0 +1,328 @@
+// Linux transport for FujiHeatPump: a tty or a pty served by an epoll loop
+#if defined(__linux__) && !defined(ESP_PLATFORM)
+
+#include "FujiSerial.h"
+
+#include "FujiHeatPump.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+// termios2 for the non-standard 500 baud; <termios.h> would clash with it
+#include <asm/termbits.h>
+#include <linux/serial.h>
+
+namespace esphome {
+namespace fujitsu {
+
+static const char *TAG = "FujiSerial";
+
+static const uint32_t kBaudRate = 500;
+
+// Raw 8E1 at kBaudRate. PARMRK marks bad bytes as 0xFF 0x00 x and breaks as
+// 0xFF 0x00 0x00, and doubles a real 0xFF.
+static bool configure(int fd, const char *path) {
+    struct termios2 tio;
+    if (ioctl(fd, TCGETS2, &tio) != 0) {
+        ESP_LOGW(TAG, "%s is not a tty: %s", path, strerror(errno));
+        return false;
+    }
+    tio.c_iflag = INPCK | PARMRK;
+    tio.c_oflag = 0;
+    tio.c_lflag = 0;
+    tio.c_cflag = BOTHER | CS8 | PARENB | CREAD | CLOCAL;
+    tio.c_ispeed = kBaudRate;
+    tio.c_ospeed = kBaudRate;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    if (ioctl(fd, TCSETS2, &tio) != 0) {
+        ESP_LOGW(TAG, "Failed to set up %s for 500 baud 8E1: %s", path, strerror(errno));
+        return false;
+    }
+    // Transceivers on an on-board UART switch direction with RTS, as in the
+    // ESP UART's RS485 half-duplex mode; USB adapters do it themselves. The
+    // receiver stays on while we send, for the echo check.
+    struct serial_rs485 rs485;
+    if (ioctl(fd, TIOCGRS485, &rs485) == 0) {
+        rs485.flags |= SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND | SER_RS485_RX_DURING_TX;
+        rs485.flags &= ~SER_RS485_RTS_AFTER_SEND;
+        if (ioctl(fd, TIOCSRS485, &rs485) != 0) {
+            ESP_LOGW(TAG, "Failed to set %s to RS485 half duplex: %s", path, strerror(errno));
+        }
+    }
+    ioctl(fd, TCFLSH, TCIOFLUSH);
+    return true;
+}
+
+int fujiSerialOpen(const char *path) {
+    int fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        ESP_LOGW(TAG, "Failed to open %s: %s", path, strerror(errno));
+        return -1;
+    }
+    if (!configure(fd, path)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int fujiSerialOpenPty(char *peerPath, size_t len, int *slaveFd) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0 || ptsname_r(master, peerPath, len) != 0) {
+        ESP_LOGW(TAG, "Failed to create a pty: %s", strerror(errno));
+        if (master >= 0) {
+            close(master);
+        }
+        return -1;
+    }
+    // The line discipline sits on the slave side, so that is where the
+    // line gets set up; the peer may set it up again when it opens it
+    int slave = fujiSerialOpen(peerPath);
+    if (slave < 0) {
+        close(master);
+        return -1;
+    }
+    *slaveFd = slave;
+    return master;
+}
+
+FujiSerialTransport::~FujiSerialTransport() {
+    if (this->fd >= 0) {
+        close(this->fd);
+    }
+    if (this->slaveFd >= 0) {
+        close(this->slaveFd);
+    }
+}
+
+bool FujiSerialTransport::open(const char *path) {
+    this->fd = fujiSerialOpen(path);
+    snprintf(this->path, sizeof(this->path), "%s", path);
+    if (this->fd < 0) {
+        return false;
+    }
+    // Overrun counts run from boot, so start from where they are now
+    struct serial_icounter_struct counts;
+    this->icount = ioctl(this->fd, TIOCGICOUNT, &counts) == 0;
+    if (this->icount) {
+        this->overruns = counts.overrun;
+        this->bufferOverruns = counts.buf_overrun;
+    }
+    return true;
+}
+
+bool FujiSerialTransport::openPty(char *peerPath, size_t len) {
+    this->fd = fujiSerialOpenPty(peerPath, len, &this->slaveFd);
+    snprintf(this->path, sizeof(this->path), "pty %s", peerPath);
+    return this->fd >= 0;
+}
+
+bool FujiSerialTransport::write(const byte *frame) { return ::write(this->fd, frame, kFrameSize) == kFrameSize; }
+
+void FujiSerialTransport::flushInput() {
+    ioctl(this->fd, TCFLSH, TCIFLUSH);
+    this->marked = 0;
+}
+
+void FujiSerialTransport::unescape(const byte *raw, size_t len, uint64_t nowUs) {
+    byte data[256];
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        byte b = raw[i];
+        if (this->marked == 0) {
+            if (b == 0xFF) {
+                this->marked = 1;
+            } else {
+                data[n++] = b;
+            }
+            continue;
+        }
+        if (this->marked == 1) {
+            if (b == 0x00) {
+                this->marked = 2;
+                continue;
+            }
+            // 0xFF 0xFF is a real 0xFF
+            this->marked = 0;
+            data[n++] = 0xFF;
+            continue;
+        }
+        // The data so far arrived before the mark
+        this->marked = 0;
+        if (n > 0) {
+            this->received(data, n, nowUs);
+            n = 0;
+        }
+        if (b == 0x00) {
+            // Also what a parity error on a 0x00 looks like; the wire is inverted,
+            // so that would need a 0xFF payload byte and a bit error both
+            this->lineEvent(FujiLineEvent::BREAK, nowUs);
+        } else {
+            // Linux doesn't tell parity and framing errors apart; the ESP UART
+            // hands such a byte on too
+            this->lineEvent(FujiLineEvent::PARITY_ERROR, nowUs);
+            data[n++] = b;
+        }
+    }
+    if (n > 0) {
+        this->received(data, n, nowUs);
+    }
+}
+
+bool FujiSerialTransport::readReady(uint64_t nowUs) {
+    byte raw[128];
+    bool got = false;
+    struct serial_icounter_struct counts;
+    while (true) {
+        ssize_t n = read(this->fd, raw, sizeof(raw));
+        if (n > 0) {
+            this->unescape(raw, n, nowUs);
+            got = true;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN) {
+            break;
+        }
+        // EOF or EIO: the adapter was unplugged or the pty peer is gone for good
+        return false;
+    }
+    if (got) {
+        this->idleAtUs = nowUs + kIdleSymbols * kFujiByteTimeUs;
+    }
+    if (got && this->icount) {
+        if (ioctl(this->fd, TIOCGICOUNT, &counts) != 0) {
+            this->icount = false;
+        } else {
+            if ((uint32_t) counts.overrun != this->overruns) {
+                this->lineEvent(FujiLineEvent::FIFO_OVERFLOW, nowUs);
+            }
+            if ((uint32_t) counts.buf_overrun != this->bufferOverruns) {
+                this->lineEvent(FujiLineEvent::BUFFER_FULL, nowUs);
+            }
+            this->overruns = counts.overrun;
+            this->bufferOverruns = counts.buf_overrun;
+        }
+    }
+    return true;
+}
+
+FujiSerialService::FujiSerialService() {
+    this->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    this->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    this->stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = &this->timerFd;
+    epoll_ctl(this->epollFd, EPOLL_CTL_ADD, this->timerFd, &ev);
+    ev.data.ptr = &this->stopFd;
+    epoll_ctl(this->epollFd, EPOLL_CTL_ADD, this->stopFd, &ev);
+}
+
+FujiSerialService::~FujiSerialService() {
+    close(this->stopFd);
+    close(this->timerFd);
+    close(this->epollFd);
+}
+
+bool FujiSerialService::attach(FujiSerialTransport *transport) {
+    if (this->epollFd < 0 || this->timerFd < 0 || this->stopFd < 0) {
+        ESP_LOGW(TAG, "Failed to set up the serial service: %s", strerror(errno));
+        return false;
+    }
+    if (this->busCount == kMaxBuses) {
+        ESP_LOGW(TAG, "At most %u heat pumps are supported", (unsigned) kMaxBuses);
+        return false;
+    }
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = transport;
+    if (epoll_ctl(this->epollFd, EPOLL_CTL_ADD, transport->fd, &ev) != 0) {
+        ESP_LOGW(TAG, "Failed to watch %s: %s", transport->name(), strerror(errno));
+        return false;
+    }
+    transport->getHeatPump()->transport = transport;
+    this->buses[this->busCount++] = transport;
+    return true;
+}
+
+void FujiSerialService::arm(uint64_t deadlineUs) {
+    itimerspec spec = {};
+    if (deadlineUs != UINT64_MAX) {
+        uint64_t nowUs = fujiMicros();
+        // A zero it_value disarms, so what is already due fires in 1 ns
+        uint64_t waitNs = deadlineUs > nowUs ? (deadlineUs - nowUs) * 1000 : 1;
+        spec.it_value.tv_sec = waitNs / 1000000000;
+        spec.it_value.tv_nsec = waitNs % 1000000000;
+    }
+    timerfd_settime(this->timerFd, 0, &spec, nullptr);
+}
+
+bool FujiSerialService::run() {
+    epoll_event events[kMaxBuses + 2];
+    while (true) {
+        uint64_t nowUs = fujiMicros();
+        uint64_t deadlineUs = UINT64_MAX;
+        for (size_t i = 0; i < this->busCount; i++) {
+            FujiSerialTransport *bus = this->buses[i];
+            if (bus->idleAtUs <= nowUs) {
+                bus->idleAtUs = UINT64_MAX;
+                bus->idle(nowUs);
+            }
+            uint32_t linkMs = bus->getHeatPump()->poll();
+            if (linkMs != UINT32_MAX) {
+                deadlineUs = std::min<uint64_t>(deadlineUs, nowUs + linkMs * 1000ULL);
+            }
+            // The timer wakes us at the slot itself, so nothing is spun out
+            deadlineUs = std::min(deadlineUs, bus->sendDue(0));
+            deadlineUs = std::min(deadlineUs, bus->idleAtUs);
+        }
+        this->arm(deadlineUs);
+
+        int n = epoll_wait(this->epollFd, events, kMaxBuses + 2, -1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            ESP_LOGE(TAG, "epoll_wait failed: %s", strerror(errno));
+            return false;
+        }
+        nowUs = fujiMicros();
+        for (int i = 0; i < n; i++) {
+            uint64_t count;
+            if (events[i].data.ptr == &this->timerFd) {
+                (void) read(this->timerFd, &count, sizeof(count));
+            } else if (events[i].data.ptr == &this->stopFd) {
+                (void) read(this->stopFd, &count, sizeof(count));
+                return true;
+            } else {
+                FujiSerialTransport *bus = static_cast<FujiSerialTransport *>(events[i].data.ptr);
+                if (!bus->readReady(nowUs)) {
+                    ESP_LOGW(TAG, "%s went away", bus->name());
+                    return false;
+                }
+            }
+        }
+    }
+}
+
+void FujiSerialService::stop() {
+    uint64_t one = 1;
+    (void) ::write(this->stopFd, &one, sizeof(one));
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
+
+#endif
@@ -0,0 +1,94 @@
+// Linux transport for FujiHeatPump: a tty (USB-RS485 adapter, on-board UART)
+// or one end of a pty pair, served by an epoll loop
+#pragma once
+
+#if defined(__linux__) && !defined(ESP_PLATFORM)
+
+#include "FujiTransport.h"
+
+#include <atomic>
+
+namespace esphome {
+namespace fujitsu {
+
+// Opens path non-blocking and sets it up for the bus: 500 baud 8E1, raw, with
+// parity errors and breaks marked in the data. A tty driver that can drive
+// an RS485 transceiver gets switched to half duplex. Returns the fd, or -1.
+int fujiSerialOpen(const char *path);
+// Creates a pty pair set up the same way and returns its master; the peer
+// opens the slave, whose name goes to peerPath. slaveFd keeps the slave open
+// so the master doesn't hang up while the peer is away.
+int fujiSerialOpenPty(char *peerPath, size_t len, int *slaveFd);
+
+class FujiSerialTransport : public FujiTransport {
+   public:
+    // Quiet time after which the framer hears a gap, as the ESP UART's RX timeout
+    static const uint32_t kIdleSymbols = 10;
+
+    explicit FujiSerialTransport(FujiHeatPump *heatpump) : FujiTransport(heatpump) {}
+    ~FujiSerialTransport();
+
+    // Uses a tty or a pty slave, e.g. /dev/ttyUSB0 or /dev/pts/3
+    bool open(const char *path);
+    // Makes a pty pair and talks through its master; peerPath gets the slave
+    bool openPty(char *peerPath, size_t len);
+
+    const char *name() const override { return this->path; }
+
+   protected:
+    bool write(const byte *frame) override;
+    void flushInput() override;
+
+   private:
+    friend class FujiSerialService;
+
+    // Drains the fd; false once the line has gone away
+    bool readReady(uint64_t nowUs);
+    // Strips the parity and break marks from raw, feeding the rest on
+    void unescape(const byte *raw, size_t len, uint64_t nowUs);
+
+    int fd = -1;
+    int slaveFd = -1;
+    char path[64] = "";
+    // Whether the driver keeps overrun counts (ptys and many USB adapters don't)
+    bool icount = false;
+    uint32_t overruns = 0;
+    uint32_t bufferOverruns = 0;
+    // Where unescape() is within a 0xFF mark
+    byte marked = 0;
+    uint64_t idleAtUs = UINT64_MAX;
+};
+
+// One thread serves any number of serial transports. Every fd sits in one
+// epoll set next to a timerfd armed for the earliest deadline (a reply slot,
+// a link timeout, an idle gap), so the thread only wakes for bytes or for
+// work that is due.
+class FujiSerialService {
+   public:
+    static const size_t kMaxBuses = 8;
+
+    FujiSerialService();
+    ~FujiSerialService();
+
+    // Before run(); the transport must be open
+    bool attach(FujiSerialTransport *transport);
+    // Serves the lines until stop(); false if one went away or epoll failed
+    bool run();
+    // Any thread
+    void stop();
+
+   private:
+    // Arms the timer for deadlineUs (fujiMicros() time), or disarms it
+    void arm(uint64_t deadlineUs);
+
+    int epollFd = -1;
+    int timerFd = -1;
+    int stopFd = -1;
+    FujiSerialTransport *buses[kMaxBuses] = {};
+    size_t busCount = 0;
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
+
+#endif
@@ -0,0 +1,79 @@
+#include "FujiSniffer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace esphome {
+namespace fujitsu {
+
+FujiSnifferStation *FujiSniffer::station(byte address) {
+    for (size_t i = 0; i < this->count; i++) {
+        if (this->local[i].address == address) {
+            return &this->local[i];
+        }
+    }
+    if (this->count == kMaxStations) {
+        return nullptr;
+    }
+    FujiSnifferStation *s = &this->local[this->count++];
+    s->address = address;
+    return s;
+}
+
+static void sample(uint32_t value, uint32_t &n, uint32_t &min, uint32_t &max, uint64_t &sum) {
+    if (n == 0 || value < min) {
+        min = value;
+    }
+    if (value > max) {
+        max = value;
+    }
+    sum += value;
+    n++;
+}
+
+void FujiSniffer::frame(const byte *frame, uint32_t nowUs) {
+    byte address = FujiSourceField::get(frame);
+    FujiSnifferStation *s = this->station(address);
+    if (s == nullptr) {
+        this->droppedFrames.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (s->frames != 0) {
+        sample(nowUs - s->lastUs, s->periods, s->minPeriodUs, s->maxPeriodUs, s->sumPeriodUs);
+    }
+    if (this->heard && this->lastAddress != address && nowUs - this->lastUs < kReplyWindowUs) {
+        sample(nowUs - this->lastUs, s->replies, s->minReplyUs, s->maxReplyUs, s->sumReplyUs);
+    }
+    // A repeat of the last frame from this address changes nothing but the timing
+    if (s->frames == 0 || memcmp(s->last.raw, frame, kFrameSize) != 0) {
+        FujiFrame ff;
+        // The unit addresses the primary through the broadcast bit
+        fujiDecodeFrame(frame, static_cast<byte>(FujiAddress::PRIMARY), ff);
+        if (s->frames != 0 && !fujiSameState(ff, s->last)) {
+            s->changes++;
+        }
+        s->last = ff;
+    }
+    s->frames++;
+    s->lastUs = nowUs;
+    this->heard = true;
+    this->lastAddress = address;
+    this->lastUs = nowUs;
+    this->published[s - this->local].write(*s);
+}
+
+void FujiSniffer::format(const FujiSnifferStation &s, char *buf, size_t len) {
+    static const char *const types[] = {"STATUS", "ERROR", "LOGIN", "UNKNOWN"};
+    const FujiFrame &f = s.last;
+    snprintf(buf, len,
+             "%u -> %u %s %s mode %u %uC fan %u eco %u swing %u/%u room %u error %u write %u login %u; "
+             "%u frames, %u changes, every %u ms (%u..%u), answers in %u ms (%u..%u)",
+             s.address, f.messageDest(), types[f.messageType() & 3], f.onOff() ? "on" : "off", f.acMode(), f.temperature(),
+             f.fanMode(), f.economyMode(), f.swingMode(), f.swingStep(), f.controllerTemp(), f.acError(), f.writeBit(),
+             f.loginBit(), (unsigned) s.frames, (unsigned) s.changes, (unsigned) (s.meanPeriodUs() / 1000),
+             (unsigned) (s.minPeriodUs / 1000), (unsigned) (s.maxPeriodUs / 1000), (unsigned) (s.meanReplyUs() / 1000),
+             (unsigned) (s.minReplyUs / 1000), (unsigned) (s.maxReplyUs / 1000));
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
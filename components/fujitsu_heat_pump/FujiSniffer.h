@@ -0,0 +1,75 @@
+#pragma once
+
+#include "FujiFrame.h"
+#include "FujiPlatform.h"
+#include "FujiSeqLock.h"
+
+#include <atomic>
+
+namespace esphome {
+namespace fujitsu {
+
+// Everything heard from one bus address
+struct FujiSnifferStation {
+    byte address = 0;
+    uint32_t frames = 0;
+    // Frames whose decoded state differed from the one before
+    uint32_t changes = 0;
+    // The latest frame from this address
+    FujiFrame last;
+    uint32_t lastUs = 0;
+    // Time between two frames from this address
+    uint32_t periods = 0;
+    uint32_t minPeriodUs = 0;
+    uint32_t maxPeriodUs = 0;
+    uint64_t sumPeriodUs = 0;
+    // Time from the end of another address's frame to the end of this one's,
+    // i.e. how long it took to answer, frame time included
+    uint32_t replies = 0;
+    uint32_t minReplyUs = 0;
+    uint32_t maxReplyUs = 0;
+    uint64_t sumReplyUs = 0;
+
+    uint32_t meanPeriodUs() const { return periods ? sumPeriodUs / periods : 0; }
+    uint32_t meanReplyUs() const { return replies ? sumReplyUs / replies : 0; }
+};
+
+// Passive view of the bus for listen-only mode: the latest decoded frame and
+// the frame timing of every address that talks on it. Stations are keyed by
+// source address, so the unit's polls of each controller share one entry and
+// the controllers' answers get one each. A byte-identical repeat of the last
+// frame from an address (most of the traffic) only updates the timing.
+class FujiSniffer {
+   public:
+    // Unit, primary, secondary and one stranger
+    static const size_t kMaxStations = 4;
+    // A frame further than this from the one before is not an answer to it
+    static const uint32_t kReplyWindowUs = 500000;
+
+    // UART task only; frame is non-inverted
+    void frame(const byte *frame, uint32_t nowUs);
+
+    // Any task
+    // Station i, in order of first appearance; frames == 0 if not in use
+    FujiSnifferStation read(size_t i) const { return this->published[i].read(); }
+    // Frames from addresses that found no free station
+    uint32_t dropped() const { return this->droppedFrames.load(std::memory_order_relaxed); }
+
+    // One line per station, e.g. "33 -> 1 STATUS on mode 4 22C ... room 21 ...;
+    // 412 frames, 3 changes, every 1002 ms (980..1030), answers in 226 ms (224..231)"
+    static void format(const FujiSnifferStation &station, char *buf, size_t len);
+
+   private:
+    FujiSnifferStation *station(byte address);
+
+    FujiSnifferStation local[kMaxStations];
+    size_t count = 0;
+    byte lastAddress = 0;
+    uint32_t lastUs = 0;
+    bool heard = false;
+    std::atomic<uint32_t> droppedFrames{0};
+    FujiSeqLock<FujiSnifferStation> published[kMaxStations];
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -0,0 +1,64 @@
+#include "FujiTrace.h"
+#include "FujiEcho.h"
+#include "FujiLink.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace esphome {
+namespace fujitsu {
+
+void FujiTrace::record(FujiTraceEvent event, const byte *frame, int32_t arg) {
+    FujiTraceRecord rec;
+    rec.timeUs = (uint32_t) fujiMicros();
+    rec.event = event;
+    rec.arg = arg;
+    if (frame != nullptr) {
+        memcpy(rec.frame, frame, kFrameSize);
+    }
+    this->ring.record(rec);
+}
+
+void FujiTrace::format(const FujiTraceRecord &rec, byte broadcastDest, char *buf, size_t len) {
+    static const char *const names[] = {"RX", "TX", "SENT", "TXFULL", "MUTED", "RESYNC", "UART", "LINK", "LOST"};
+    const char *name = (size_t) rec.event < sizeof(names) / sizeof(names[0]) ? names[(size_t) rec.event] : "?";
+    unsigned seconds = rec.timeUs / 1000000;
+    unsigned micros = rec.timeUs % 1000000;
+
+    switch (rec.event) {
+        case FujiTraceEvent::RX_FRAME:
+        case FujiTraceEvent::TX_QUEUED:
+        case FujiTraceEvent::TX_QUEUE_FULL:
+        case FujiTraceEvent::TX_SUPPRESSED: {
+            const byte *b = rec.frame;
+            FujiFrame ff;
+            fujiDecodeFrame(b, broadcastDest, ff);
+            snprintf(buf, len,
+                     "#%u %u.%06u %-6s %02X %02X %02X %02X %02X %02X %02X %02X mSrc: %d mDst: %d mType: %d "
+                     "write: %d login: %d unknown: %d onOff: %d temp: %d mode: %d fan: %d eco: %d cP: %d uM: %d "
+                     "cTemp: %d acError: %d",
+                     (unsigned) rec.seq, seconds, micros, name, b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7],
+                     ff.messageSource(), ff.messageDest(), ff.messageType(), ff.writeBit(), ff.loginBit(), ff.unknownBit(),
+                     ff.onOff(), ff.temperature(), ff.acMode(), ff.fanMode(), ff.economyMode(), ff.controllerPresent(),
+                     ff.updateMagic(), ff.controllerTemp(), ff.acError());
+            break;
+        }
+        case FujiTraceEvent::TX_LOST: {
+            const byte *b = rec.frame;
+            snprintf(buf, len, "#%u %u.%06u %-6s %02X %02X %02X %02X %02X %02X %02X %02X %s", (unsigned) rec.seq,
+                     seconds, micros, name, b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7],
+                     FujiEchoCheck::name(static_cast<FujiEchoResult>(rec.arg)));
+            break;
+        }
+        case FujiTraceEvent::LINK_STATE:
+            snprintf(buf, len, "#%u %u.%06u %-6s %s", (unsigned) rec.seq, seconds, micros, name,
+                     FujiLink::name(static_cast<FujiLinkState>(rec.arg)));
+            break;
+        default:
+            snprintf(buf, len, "#%u %u.%06u %-6s %d", (unsigned) rec.seq, seconds, micros, name, (int) rec.arg);
+            break;
+    }
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
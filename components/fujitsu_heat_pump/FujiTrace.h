@@ -0,0 +1,56 @@
+#pragma once
+
+#include "FujiFrame.h"
+#include "FujiPlatform.h"
+#include "FujiRing.h"
+
+namespace esphome {
+namespace fujitsu {
+
+enum class FujiTraceEvent : uint8_t {
+    RX_FRAME = 0,    // frame: as received (non-inverted)
+    TX_QUEUED,       // frame: response queued (non-inverted)
+    TX_SENT,         // arg: slot error in us
+    TX_QUEUE_FULL,   // frame: response that did not fit
+    TX_SUPPRESSED,   // frame: response not sent because comms are disabled
+    RESYNC,          // arg: bytes the framer dropped since the last record
+    UART_EVENT,      // arg: uart_event_type_t of a non-data event
+    LINK_STATE,      // arg: the FujiLinkState just entered
+    TX_LOST,         // frame: one of ours whose echo check failed (wire form), arg: FujiEchoResult
+};
+
+struct FujiTraceRecord {
+    uint32_t seq = 0;     // 1-based position in the trace
+    uint32_t timeUs = 0;  // low 32 bits of fujiMicros()
+    FujiTraceEvent event = FujiTraceEvent::RX_FRAME;
+    int32_t arg = 0;
+    byte frame[kFrameSize] = {};
+};
+
+typedef FujiRingCursor FujiTraceCursor;
+
+// Fixed-size binary trace of bus activity. Recording is a copy into a ring
+// slot, cheap enough for every frame on the UART task; turning records into
+// text is left to whoever reads them, on their own task and only on demand.
+// There must be a single recording task; any number of tasks can read.
+class FujiTrace {
+   public:
+    static const size_t kSize = 64;
+
+    void record(FujiTraceEvent event, const byte *frame = nullptr, int32_t arg = 0);
+
+    // Copies out the next record after cursor; false once caught up
+    bool read(FujiTraceCursor &cursor, FujiTraceRecord &out) const { return this->ring.read(cursor, out); }
+    // A cursor that only sees records made from now on
+    FujiTraceCursor tail() const { return this->ring.tail(); }
+    uint32_t recorded() const { return this->ring.recorded(); }
+
+    // One line of text; broadcastDest is used to decode broadcast frames
+    static void format(const FujiTraceRecord &rec, byte broadcastDest, char *buf, size_t len);
+
+   private:
+    FujiRecordRing<FujiTraceRecord, kSize> ring;
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
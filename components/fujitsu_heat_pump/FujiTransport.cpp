@@ -0,0 +1,121 @@
+#include "FujiTransport.h"
+
+#include "FujiHeatPump.h"
+
+namespace esphome {
+namespace fujitsu {
+
+static const char *TAG = "FujiHeatPump";
+
+void FujiTransport::received(const byte *bytes, size_t len, uint64_t endUs) {
+    FujiHeatPump *hp = this->heatpump;
+    uint32_t bytesDropped = hp->framer.getStats().bytesDropped;
+    byte frame[kFrameSize];
+    // Captured bytes are cut at frame boundaries so a replay sees each
+    // frame complete at the end of a record, as it did here
+    size_t captured = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint64_t byteEndUs = endUs - (len - 1 - i) * kFujiByteTimeUs;
+        // Our own echo is checked and goes no further
+        if (hp->echo.push(bytes[i], byteEndUs)) {
+            continue;
+        }
+        if (hp->framer.push(bytes[i], frame)) {
+            hp->capture.recordRx(bytes + captured, i + 1 - captured, byteEndUs);
+            captured = i + 1;
+            hp->txScheduler.frameEnded(byteEndUs);
+            // A lost write must be known before the reply to this frame is built
+            hp->echoChecked();
+            hp->handleFrame(frame);
+        }
+    }
+    if (captured < len) {
+        hp->capture.recordRx(bytes + captured, len - captured, endUs);
+    }
+    hp->health.syncFramer(hp->framer.getStats());
+    hp->echoChecked();
+    if (hp->framer.getStats().bytesDropped != bytesDropped) {
+        hp->trace.record(FujiTraceEvent::RESYNC, nullptr, hp->framer.getStats().bytesDropped - bytesDropped);
+    }
+}
+
+void FujiTransport::idle(uint64_t nowUs) {
+    FujiHeatPump *hp = this->heatpump;
+    hp->framer.idle();
+    hp->capture.recordIdle(nowUs);
+    hp->health.syncFramer(hp->framer.getStats());
+    hp->echo.expire(nowUs);
+    hp->echoChecked();
+}
+
+void FujiTransport::lineEvent(FujiLineEvent event, uint64_t nowUs) {
+    FujiHeatPump *hp = this->heatpump;
+    hp->trace.record(FujiTraceEvent::UART_EVENT, nullptr, static_cast<int32_t>(event));
+    hp->capture.recordEvent(static_cast<byte>(event), nowUs);
+    switch (event) {
+        case FujiLineEvent::FIFO_OVERFLOW:
+            ESP_LOGI(TAG, "hw fifo overflow on %s", this->name());
+            hp->health.count(FujiBusCounter::FIFO_OVERFLOWS);
+            // Whatever is left is missing bytes somewhere; start over from the next gap
+            this->flushInput();
+            this->idle(nowUs);
+            break;
+        case FujiLineEvent::BUFFER_FULL:
+            ESP_LOGI(TAG, "ring buffer full on %s", this->name());
+            hp->health.count(FujiBusCounter::BUFFER_FULL);
+            this->flushInput();
+            this->idle(nowUs);
+            break;
+        case FujiLineEvent::BREAK:
+            ESP_LOGI(TAG, "rx break on %s", this->name());
+            hp->health.count(FujiBusCounter::BREAKS);
+            this->idle(nowUs);
+            break;
+        case FujiLineEvent::PARITY_ERROR:
+            ESP_LOGI(TAG, "parity error on %s", this->name());
+            hp->health.count(FujiBusCounter::PARITY_ERRORS);
+            break;
+        case FujiLineEvent::FRAME_ERROR:
+            ESP_LOGI(TAG, "frame error on %s", this->name());
+            hp->health.count(FujiBusCounter::FRAME_ERRORS);
+            break;
+    }
+}
+
+uint64_t FujiTransport::sendDue(uint64_t spinUs) {
+    FujiHeatPump *hp = this->heatpump;
+    // Multi-frame responses (e.g. login ack then secondary ping) go out in
+    // order. A response stays queued until it is written, so a newer status
+    // reply can still take its place while it waits for the slot.
+    while (hp->responses.front(this->tx)) {
+        uint64_t slotUs = hp->txScheduler.nextSlotUs();
+        if ((int64_t) slotUs - (int64_t) fujiMicros() > (int64_t) spinUs) {
+            return slotUs;
+        }
+        while ((int64_t) fujiMicros() < (int64_t) slotUs) {
+        }
+        uint64_t startUs = fujiMicros();
+        if (!this->write(this->tx)) {
+            ESP_LOGW(TAG, "Failed to write state update as expected");
+        }
+        hp->responses.pop();
+        hp->echo.sent(this->tx, startUs);
+        hp->txScheduler.sent(startUs);
+        hp->capture.recordTx(this->tx, startUs);
+        hp->health.count(FujiBusCounter::FRAMES_SENT);
+        const FujiSlotStats &slots = hp->txScheduler.getStats();
+        hp->trace.record(FujiTraceEvent::TX_SENT, nullptr, slots.lastErrorUs);
+        if (slots.sent % 64 == 0) {
+            const FujiRxDelayStats &rx = hp->txScheduler.getRxDelayStats();
+            ESP_LOGI(TAG, "Reply slots on %s: %u sent, %u missed, error min %d max %d mean |%u| us", this->name(),
+                     (unsigned) slots.sent, (unsigned) slots.missed, (int) slots.minErrorUs, (int) slots.maxErrorUs,
+                     (unsigned) slots.meanAbsErrorUs());
+            ESP_LOGI(TAG, "RX delay on %s: mean %u max %u us, %u of %u frames too late for their slot", this->name(),
+                     (unsigned) rx.meanUs(), (unsigned) rx.maxUs, (unsigned) rx.late, (unsigned) rx.frames);
+        }
+    }
+    return UINT64_MAX;
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
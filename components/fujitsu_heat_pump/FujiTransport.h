@@ -0,0 +1,59 @@
+#pragma once
+
+#include "FujiFrame.h"
+#include "FujiPlatform.h"
+
+namespace esphome {
+namespace fujitsu {
+
+class FujiHeatPump;
+
+// What a line reports besides data. The values are ESP-IDF's uart_event_type_t,
+// so captures and traces read the same whichever backend recorded them.
+enum class FujiLineEvent : uint8_t {
+    BREAK = 1,
+    BUFFER_FULL = 2,
+    FIFO_OVERFLOW = 3,
+    FRAME_ERROR = 4,
+    PARITY_ERROR = 5,
+};
+
+// The line under one heat pump. A backend (the ESP-IDF UART, a Linux tty or
+// pty, the bus simulator) owns the line and the loop that waits on it; it
+// hands everything it reads to received(), idle() and lineEvent() and calls
+// sendDue() whenever it wakes. Both directions then go through the protocol
+// engine, the capture and the counters the same way on every backend.
+class FujiTransport {
+   public:
+    explicit FujiTransport(FujiHeatPump *heatpump) : heatpump(heatpump) {}
+    virtual ~FujiTransport() {}
+
+    FujiHeatPump *getHeatPump() const { return this->heatpump; }
+    // For log lines, e.g. "UART 2" or "/dev/ttyUSB0"
+    virtual const char *name() const = 0;
+
+    // Backend side, from the one task that serves the line
+    // Bytes just read off the line, the last of them finished arriving at endUs
+    void received(const byte *bytes, size_t len, uint64_t endUs);
+    // The line has been quiet up to nowUs, so the next byte starts a new frame
+    void idle(uint64_t nowUs);
+    void lineEvent(FujiLineEvent event, uint64_t nowUs);
+    // Sends the responses whose slot is at most spinUs away, busy-waiting out
+    // the rest; returns the slot of the next response still waiting, or
+    // UINT64_MAX if there is none
+    uint64_t sendDue(uint64_t spinUs);
+
+   protected:
+    // Puts one wire frame on the line right away; false if it didn't all go
+    virtual bool write(const byte *frame) = 0;
+    // Throws away whatever was received but not read yet, after an overrun
+    virtual void flushInput() = 0;
+
+    FujiHeatPump *const heatpump;
+
+   private:
+    byte tx[kFrameSize];
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
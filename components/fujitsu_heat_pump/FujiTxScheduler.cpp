@@ -0,0 +1,53 @@
+#include "FujiTxScheduler.h"
+
+namespace esphome {
+namespace fujitsu {
+
+void FujiTxScheduler::frameEnded(uint64_t endUs) {
+    slotUs = endUs + replyDelayUs;
+    frameEndUs = endUs;
+}
+
+void FujiTxScheduler::frameHandled(uint64_t nowUs) {
+    if (frameEndUs == 0) {
+        return;
+    }
+    uint32_t delayUs = nowUs > frameEndUs ? nowUs - frameEndUs : 0;
+    frameEndUs = 0;
+    rxDelay.frames++;
+    rxDelay.lastUs = delayUs;
+    rxDelay.sumUs += delayUs;
+    if (delayUs > rxDelay.maxUs) {
+        rxDelay.maxUs = delayUs;
+    }
+    if (delayUs >= replyDelayUs) {
+        rxDelay.late++;
+    }
+    if (delayUs > rxDelayPeakUs.load(std::memory_order_relaxed)) {
+        rxDelayPeakUs.store(delayUs, std::memory_order_relaxed);
+    }
+}
+
+void FujiTxScheduler::sent(uint64_t startUs) {
+    int32_t error = static_cast<int32_t>(static_cast<int64_t>(startUs) - static_cast<int64_t>(slotUs));
+    uint32_t absError = error < 0 ? -error : error;
+
+    if (stats.sent == 0 || error < stats.minErrorUs) {
+        stats.minErrorUs = error;
+    }
+    if (stats.sent == 0 || error > stats.maxErrorUs) {
+        stats.maxErrorUs = error;
+    }
+    stats.lastErrorUs = error;
+    stats.sumAbsErrorUs += absError;
+    stats.sent++;
+    if (absError > toleranceUs) {
+        stats.missed++;
+    }
+
+    // The next frame of a multi-frame response follows this one, even if we were late
+    slotUs = startUs + kFujiFrameTimeUs + interFrameGapUs;
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "FujiFrame.h"
+
+#include <atomic>
+
+namespace esphome {
+namespace fujitsu {
+
+// 500 baud 8E1: start + 8 data + parity + stop = 11 bits of 2 ms each
+const uint32_t kFujiByteTimeUs = 11 * 2000;
+const uint32_t kFujiFrameTimeUs = kFrameSize * kFujiByteTimeUs;
+
+struct FujiSlotStats {
+    uint32_t sent = 0;
+    // Frames that started more than the tolerance away from their slot
+    uint32_t missed = 0;
+    int32_t lastErrorUs = 0;
+    int32_t minErrorUs = 0;
+    int32_t maxErrorUs = 0;
+    uint64_t sumAbsErrorUs = 0;
+
+    uint32_t meanAbsErrorUs() const { return sent ? sumAbsErrorUs / sent : 0; }
+};
+
+struct FujiRxDelayStats {
+    // Frames handled, and those that reached the protocol too late to make their reply slot
+    uint32_t frames = 0;
+    uint32_t late = 0;
+    uint32_t lastUs = 0;
+    uint32_t maxUs = 0;
+    uint64_t sumUs = 0;
+
+    uint32_t meanUs() const { return frames ? sumUs / frames : 0; }
+};
+
+// Times our replies from the end of the frame they answer. Responses to one
+// frame go out back to back in queue order, each in its own slot, and every
+// send is checked against the slot it was meant for.
+class FujiTxScheduler {
+   public:
+    // The frame we are replying to finished arriving at endUs
+    void frameEnded(uint64_t endUs);
+    // When the next pending response should start
+    uint64_t nextSlotUs() const { return this->slotUs; }
+    // A response actually started at startUs
+    void sent(uint64_t startUs);
+    // The frame that last ended is being handled at nowUs; records how long
+    // it took to get from its last byte on the wire to the protocol
+    void frameHandled(uint64_t nowUs);
+
+    const FujiSlotStats &getStats() const { return this->stats; }
+    const FujiRxDelayStats &getRxDelayStats() const { return this->rxDelay; }
+    // Longest RX delay since the last call; any task may call it
+    uint32_t takeRxDelayPeakUs() { return this->rxDelayPeakUs.exchange(0, std::memory_order_relaxed); }
+
+    // Reply delay after the end of the received frame (the original library used 50 ms)
+    uint32_t replyDelayUs = 50000;
+    // Idle time between back-to-back frames of a multi-frame response
+    uint32_t interFrameGapUs = 20000;
+    // How far off a send may be before it counts as a missed slot
+    uint32_t toleranceUs = 5000;
+
+   private:
+    uint64_t slotUs = 0;
+    FujiSlotStats stats;
+    // End of the frame not yet handled, 0 if there is none
+    uint64_t frameEndUs = 0;
+    FujiRxDelayStats rxDelay;
+    std::atomic<uint32_t> rxDelayPeakUs{0};
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -0,0 +1,395 @@
+/* This file is based on unreality's FujiHeatPump project */
+
+// ESP-IDF UART transport for FujiHeatPump; the protocol itself lives in FujiHeatPump.cpp
+#ifdef ESP_PLATFORM
+
+#include "FujiHeatPump.h"
+#include "FujiTransport.h"
+
+#include "driver/gpio.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdio.h>
+
+namespace esphome {
+namespace fujitsu {
+
+static const char* TAG = "FujiHeatPump";
+
+// Event queue depth per UART; all of them feed one queue set
+static const int kUartEventQueueLength = 10;
+// The bus carries ~45 bytes/s, so the driver's ring only needs to be larger
+// than the hardware FIFO (which it must be). Writes are 8 bytes and go
+// straight into the FIFO, so no TX ring at all.
+static const int kUartRxBufferSize = 256;
+static const int kUartTxBufferSize = 0;
+
+// The ESP-IDF UART backend: the driver's event queue tells the service task
+// what arrived, and replies go out through the driver's TX path
+class FujiUartTransport : public FujiTransport {
+   public:
+    FujiUartTransport(FujiHeatPump *heatpump, uart_port_t port, QueueHandle_t queue, uint32_t rxTimeoutSymbols)
+        : FujiTransport(heatpump), port(port), queue(queue), rxTimeoutSymbols(rxTimeoutSymbols) {
+        snprintf(this->label, sizeof(this->label), "UART %d", port);
+    }
+
+    ~FujiUartTransport() override {
+        if (this->edgePin >= 0) {
+            gpio_isr_handler_remove(static_cast<gpio_num_t>(this->edgePin));
+        }
+    }
+
+    const char *name() const override { return this->label; }
+
+    // Times the start bits on the RX pin, so each chunk's end comes from the
+    // wire rather than from when its event was handled; false (with a
+    // warning) if the pin can't take the interrupt
+    bool timeEdges(int rxPin);
+    // buf is scratch space for the bytes of a data event
+    void handleEvent(const uart_event_t &event, byte *buf, size_t len);
+
+    const uart_port_t port;
+    const QueueHandle_t queue;
+    // As set with uart_set_rx_timeout()
+    const uint32_t rxTimeoutSymbols;
+
+   protected:
+    bool write(const byte *frame) override {
+        return uart_write_bytes(this->port, (const char *) frame, kFrameSize) == kFrameSize;
+    }
+    void flushInput() override {
+        // The data events still queued now read nothing. No xQueueReset():
+        // the queue is in a queue set, which would keep stale entries.
+        uart_flush_input(this->port);
+    }
+
+   private:
+    static void rxEdge(void *arg);
+    // When the last byte read so far finished arriving
+    uint64_t chunkEndUs(uint64_t eventUs, bool timeout) const;
+
+    char label[12];
+    int edgePin = -1;
+    // Low 32 bits of fujiMicros(). The ISR owns byteStartUs and publishes
+    // when the byte it last saw start will have ended.
+    uint32_t byteStartUs = 0;
+    std::atomic<uint32_t> byteEndUs{0};
+};
+
+// One task serves every heat pump bus on the board. Events from all UART
+// queues arrive through a queue set, and each reply goes out from the same
+// loop when its slot comes up, so waiting on one bus never holds up another.
+class FujiBusService {
+   public:
+    static const size_t kMaxBuses = 3;
+
+    // Adds a UART whose driver is installed and configured
+    static bool attach(FujiUartTransport *transport);
+
+   private:
+    static void task(void *param);
+    void run();
+
+    FujiUartTransport *buses[kMaxBuses] = {};
+    std::atomic<size_t> busCount{0};
+    // Counts the task's passes, each of which starts by reading busCount
+    std::atomic<uint32_t> passes{0};
+    QueueSetHandle_t queueSet = nullptr;
+    // UART_DATA events carry about the RX FIFO full threshold worth of bytes
+    // (a frame by default, at most 120)
+    byte rx_buf[128];
+};
+
+static FujiBusService *busService = nullptr;
+
+bool FujiBusService::attach(FujiUartTransport *transport) {
+    if (busService == nullptr) {
+        FujiBusService *service = new FujiBusService();
+        service->queueSet = xQueueCreateSet(kMaxBuses * kUartEventQueueLength);
+        if (service->queueSet == nullptr) {
+            ESP_LOGW(TAG, "Failed to create the bus service queue set");
+            delete service;
+            return false;
+        }
+        //rc = xTaskCreatePinnedToCore(task, "FujiTask", 4096, (void *)busService,
+        //        // TODO is the priority reasonable? find & investigate the freertosconfig.h
+        //                        configMAX_PRIORITIES - 1, NULL /* ignore the task handle */, 1);
+        if (xTaskCreate(task, "FujiTask", 4096, (void *) service, 12, NULL /* ignore the task handle */) !=
+            pdPASS) {
+            ESP_LOGW(TAG, "Failed to create heat pump event task");
+            vQueueDelete(service->queueSet);
+            delete service;
+            return false;
+        }
+        // Only a service with its task running is kept, so the next heat pump
+        // tries the setup again after a failure
+        busService = service;
+    }
+    FujiBusService *service = busService;
+    size_t n = service->busCount.load();
+    if (n == kMaxBuses) {
+        ESP_LOGW(TAG, "At most %u heat pumps are supported", (unsigned) kMaxBuses);
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (service->buses[i]->port == transport->port) {
+            ESP_LOGW(TAG, "UART %d is already used by another heat pump", transport->port);
+            return false;
+        }
+    }
+    // The task matches a woken queue against the buses below busCount, so
+    // publish the bus before its queue can wake the task
+    service->buses[n] = transport;
+    service->busCount.store(n + 1);
+    // A queue set only takes an empty queue, and the line is live by now:
+    // drop whatever arrived, and again if a byte slips in before the add
+    bool added = false;
+    for (int attempt = 0; attempt < 3 && !added; attempt++) {
+        uart_flush_input(transport->port);
+        xQueueReset(transport->queue);
+        added = xQueueAddToSet(transport->queue, service->queueSet) == pdPASS;
+    }
+    if (!added) {
+        ESP_LOGW(TAG, "Failed to add UART %d to the bus service", transport->port);
+        // Its queue never joined the set, but the task may be polling it in
+        // the pass under way; the caller frees it once the next pass begins
+        service->busCount.store(n);
+        uint32_t pass = service->passes.load();
+        while (service->passes.load() == pass) {
+            vTaskDelay(1);
+        }
+        service->buses[n] = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void FujiBusService::task(void *param) { static_cast<FujiBusService *>(param)->run(); }
+
+void FujiBusService::run() {
+    const uint64_t tickUs = portTICK_PERIOD_MS * 1000;
+    uart_event_t event;
+    while (true) {
+        uint64_t nextSlotUs = UINT64_MAX;
+        uint32_t linkMs = 1000;
+        this->passes.fetch_add(1);
+        size_t n = this->busCount.load();
+        for (size_t i = 0; i < n; i++) {
+            linkMs = std::min(linkMs, this->buses[i]->getHeatPump()->poll());
+            // Spin out the last tick before a slot; the queue wait can't be finer
+            nextSlotUs = std::min(nextSlotUs, this->buses[i]->sendDue(tickUs));
+        }
+
+        // Sleep until the next event, the next link timeout, or until a tick
+        // before the next reply slot; sendDue() spins out the rest
+        TickType_t timeout = pdMS_TO_TICKS(linkMs) + 1;
+        if (nextSlotUs != UINT64_MAX) {
+            int64_t waitUs = (int64_t) nextSlotUs - (int64_t) fujiMicros() - (int64_t) tickUs;
+            timeout = waitUs > 0 ? std::min<TickType_t>(timeout, waitUs / tickUs) : 0;
+        }
+        QueueSetMemberHandle_t member = xQueueSelectFromSet(this->queueSet, timeout);
+        if (member == nullptr) {
+            continue;
+        }
+        // A bus attached during the wait may be the one that woke us
+        n = this->busCount.load();
+        for (size_t i = 0; i < n; i++) {
+            FujiUartTransport *bus = this->buses[i];
+            if (bus->queue == member && xQueueReceive(bus->queue, (void *) &event, 0)) {
+                bus->handleEvent(event, this->rx_buf, sizeof(this->rx_buf));
+                break;
+            }
+        }
+    }
+}
+
+void FujiUartTransport::handleEvent(const uart_event_t &event, byte *buf, size_t len) {
+    uint64_t eventUs = fujiMicros();
+    switch(event.type) {
+
+        //Event of UART receving data
+        /*We'd better handler data event fast, there would be much more data events than
+          other types of events. If we take too much time on data event, the queue might
+          be full.*/
+        case UART_DATA: {
+            int n = uart_read_bytes(this->port, buf, std::min(event.size, len), 0);
+            if (n > 0) {
+                this->received(buf, n, this->chunkEndUs(eventUs, event.timeout_flag));
+            }
+            if (event.timeout_flag) {
+                // The line went quiet, so the next byte starts a new frame
+                this->idle(eventUs);
+            }
+            break;
+        }
+        //Event of HW FIFO overflow detected
+        case UART_FIFO_OVF:
+        //Event of UART ring buffer full
+        case UART_BUFFER_FULL:
+        //Event of UART RX break detected
+        case UART_BREAK:
+        //Event of UART parity check error
+        case UART_PARITY_ERR:
+        //Event of UART frame error
+        case UART_FRAME_ERR:
+            this->lineEvent(static_cast<FujiLineEvent>(event.type), eventUs);
+            break;
+        //Others
+        default:
+            this->heatpump->trace.record(FujiTraceEvent::UART_EVENT, nullptr, event.type);
+            this->heatpump->capture.recordEvent(event.type, eventUs);
+            ESP_LOGI(TAG, "uart event type: %d", event.type);
+            break;
+    }
+}
+
+// A falling edge at least 10 bit times into a byte can only be the next start
+// bit: the last one inside a byte opens its parity bit, 9 bit times in
+void IRAM_ATTR FujiUartTransport::rxEdge(void *arg) {
+    FujiUartTransport *self = static_cast<FujiUartTransport *>(arg);
+    uint32_t nowUs = (uint32_t) esp_timer_get_time();
+    if (nowUs - self->byteStartUs >= kFujiByteTimeUs * 10 / 11) {
+        self->byteStartUs = nowUs;
+        self->byteEndUs.store(nowUs + kFujiByteTimeUs, std::memory_order_relaxed);
+    }
+}
+
+bool FujiUartTransport::timeEdges(int rxPin) {
+    gpio_num_t pin = static_cast<gpio_num_t>(rxPin);
+    // Someone else may have installed the service already, which is fine
+    esp_err_t rc = gpio_install_isr_service(ESP_INTR_FLAG_LEVEL1);
+    if (rc != ESP_OK && rc != ESP_ERR_INVALID_STATE) {
+        ESP_LOGW(TAG, "Failed to install the GPIO ISR service");
+        return false;
+    }
+    if (gpio_set_intr_type(pin, GPIO_INTR_NEGEDGE) != ESP_OK || gpio_isr_handler_add(pin, rxEdge, this) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to time the edges on GPIO %d", rxPin);
+        return false;
+    }
+    this->edgePin = rxPin;
+    gpio_intr_enable(pin);
+    return true;
+}
+
+uint64_t FujiUartTransport::chunkEndUs(uint64_t eventUs, bool timeout) const {
+    if (this->edgePin >= 0) {
+        uint32_t endUs = this->byteEndUs.load(std::memory_order_relaxed);
+        // A byte still arriving isn't in this chunk; take the one before it
+        // to have ended as it started. Only happens when the task is so late
+        // that the next frame has begun.
+        if ((int32_t) (endUs - (uint32_t) eventUs) > 0) {
+            endUs -= kFujiByteTimeUs;
+        }
+        int32_t agoUs = (int32_t) ((uint32_t) eventUs - endUs);
+        if (agoUs >= 0) {
+            return eventUs - agoUs;
+        }
+    }
+    // Without the edges: a timeout event fires once the line has been idle for
+    // the RX timeout, otherwise the FIFO has just reached the full threshold
+    // with the last byte. Both count from when the event is handled, so the
+    // time spent in the driver and the event queue goes unseen.
+    return timeout ? eventUs - this->rxTimeoutSymbols * kFujiByteTimeUs : eventUs;
+}
+
+static_assert(static_cast<int>(FujiLineEvent::BREAK) == UART_BREAK &&
+                  static_cast<int>(FujiLineEvent::BUFFER_FULL) == UART_BUFFER_FULL &&
+                  static_cast<int>(FujiLineEvent::FIFO_OVERFLOW) == UART_FIFO_OVF &&
+                  static_cast<int>(FujiLineEvent::FRAME_ERROR) == UART_FRAME_ERR &&
+                  static_cast<int>(FujiLineEvent::PARITY_ERROR) == UART_PARITY_ERR,
+              "FujiLineEvent follows uart_event_type_t");
+
+// Everything but the event queue; false (with a warning) at the first failure
+static bool configureUart(uart_port_t port, int rxPin, int txPin, uint8_t rxFullThreshold, uint8_t rxTimeoutSymbols) {
+    uart_config_t uart_config = {
+        .baud_rate = 500,
+        .data_bits = UART_DATA_8_BITS,
+        .parity    = UART_PARITY_EVEN,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_APB,
+    };
+    int rc = uart_param_config(port, &uart_config);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "Failed to configure uart params");
+        return false;
+    }
+    rc = uart_set_pin(port, txPin /* TXD */,  rxPin /* RXD */, UART_PIN_NO_CHANGE /* RTS */, UART_PIN_NO_CHANGE /* CTS */);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "Failed to set uart pins");
+        return false;
+    }
+
+    // One data event per frame, as its last byte lands. With the driver's
+    // default threshold of 120 bytes every frame waited out the default RX
+    // timeout of 10 byte times (220 ms, well past the reply slot). The
+    // timeout now only picks up what a misaligned frame leaves in the FIFO.
+    rc = uart_set_rx_full_threshold(port, rxFullThreshold);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "Failed to set the uart rx full threshold");
+        return false;
+    }
+    rc = uart_set_rx_timeout(port, rxTimeoutSymbols);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "Failed to set the uart rx timeout");
+        return false;
+    }
+
+    // Half duplex, but with the receiver left on while we transmit (plain
+    // RS485 half duplex mode turns it off), so our frames come back for the
+    // echo check. The hardware's own collision flag isn't needed: the check
+    // compares every byte, on every backend.
+    rc = uart_set_mode(port, UART_MODE_RS485_COLLISION_DETECT);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "Failed to set uart to half duplex");
+        return false;
+    }
+    return true;
+}
+
+bool FujiHeatPump::connect(uart_port_t uart_port, bool secondary, int rxPin, int txPin) {
+    ESP_LOGD("FujitsuClimate", "Connect has been entered!");
+    int rc;
+    if (uart_is_driver_installed(uart_port)) {
+        ESP_LOGW(TAG, "uninstalling uart driver...");
+        rc = uart_driver_delete(uart_port);
+        if (rc != 0) {
+            ESP_LOGW(TAG, "Failed to uninstall existing uart driver");
+            return false;
+        }
+    }
+    QueueHandle_t queue;
+    rc = uart_driver_install(uart_port, kUartRxBufferSize, kUartTxBufferSize, kUartEventQueueLength, &queue, 0);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "Failed to install uart driver");
+        return false;
+    }
+    // Fully configured before the service task ever sees the port, so a
+    // failure leaves nothing behind
+    if (!configureUart(uart_port, rxPin, txPin, this->rxFullThreshold, this->rxTimeoutSymbols)) {
+        uart_driver_delete(uart_port);
+        return false;
+    }
+    this->begin(secondary);
+    FujiUartTransport *uart = new FujiUartTransport(this, uart_port, queue, this->rxTimeoutSymbols);
+    // Only for the RX delay, so the bus works without it
+    if (rxPin == UART_PIN_NO_CHANGE) {
+        ESP_LOGW(TAG, "No RX pin given for UART %d, so its RX delay leaves out the driver", uart_port);
+    } else {
+        uart->timeEdges(rxPin);
+    }
+    if (!FujiBusService::attach(uart)) {
+        delete uart;
+        uart_driver_delete(uart_port);
+        return false;
+    }
+    this->transport = uart;
+    ESP_LOGD(TAG, "Serial port configured");
+    return true;
+}
+
+}
+}
+
+#endif  // ESP_PLATFORM
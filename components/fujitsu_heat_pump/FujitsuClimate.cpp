@@ -9,7 +9,16 @@ void FujitsuClimate::setup() {
     // c.f. https://github.com/esphome/esphome/blob/acd55b960120265a0a4ce0bd06d08758dce5bbbd/esphome/components/uart/uart_component_esp32_arduino.cpp#L95
     int8_t tx = this->tx_pin_ != nullptr ? this->tx_pin_->get_pin() : UART_PIN_NO_CHANGE;
     int8_t rx = this->rx_pin_ != nullptr ? this->rx_pin_->get_pin() : UART_PIN_NO_CHANGE;
-    this->heatPump.connect(UART_NUM_2, !this->is_master_, rx, tx);
+    if (!this->heatPump.connect(static_cast<uart_port_t>(this->uart_port_), !this->is_master_, rx, tx)) {
+        this->mark_failed();
+        return;
+    }
+    // Nothing to show until the first frame publishes a state
+    this->state_version_ = this->heatPump.getStateVersion();
+    this->loop_reported_ms_ = millis();
+    for (uint32_t &changes : this->sniffer_changes_) {
+        changes = UINT32_MAX;
+    }
     ESP_LOGD(TAG, "Fuji initialized");
 }
 
@@ -102,22 +111,22 @@ void FujitsuClimate::updateState() {
         ESP_LOGD(TAG, "using remote temp");
         this->current_temperature = this->remote_temperature_->state;
         updated = true;
-    } else if (this->current_temperature != this->sharedState.controllerTemp) {
-        this->current_temperature = this->sharedState.controllerTemp;
+    } else if (this->current_temperature != this->sharedState.controllerTemp()) {
+        this->current_temperature = this->sharedState.controllerTemp();
         updated = true;
     }
 
     // Target temp
-    if (this->sharedState.temperature != this->target_temperature) {
+    if (this->sharedState.temperature() != this->target_temperature) {
         ESP_LOGD(TAG, "ctrl temp %d vs my temp %f",
-                 this->sharedState.temperature, this->target_temperature);
-        this->target_temperature = this->sharedState.temperature;
+                 this->sharedState.temperature(), this->target_temperature);
+        this->target_temperature = this->sharedState.temperature();
         updated = true;
     }
 
     // Mode
-    auto newMode = fujiToEspMode((FujiMode)this->sharedState.acMode);
-    if (newMode.has_value() && this->sharedState.onOff &&
+    auto newMode = fujiToEspMode((FujiMode)this->sharedState.acMode());
+    if (newMode.has_value() && this->sharedState.onOff() &&
         newMode.value() != this->mode) {
         ESP_LOGD(TAG, "ctrl mode %d vs my mode %d", newMode.value(),
                  this->mode);
@@ -127,7 +136,7 @@ void FujitsuClimate::updateState() {
 
     // Fan speed
     auto newFanMode =
-        fujiToEspFanMode((FujiFanMode)this->sharedState.fanMode);
+        fujiToEspFanMode((FujiFanMode)this->sharedState.fanMode());
     if (newFanMode.has_value() && newFanMode.value() != this->fan_mode) {
         ESP_LOGD("fujitsu", "ctrl fan mode %d vs my fan mode %d",
                  newFanMode.value(), this->fan_mode.value_or(-1));
@@ -135,27 +144,27 @@ void FujitsuClimate::updateState() {
         updated = true;
     }
 
-    if (this->sharedState.economyMode &&
+    if (this->sharedState.economyMode() &&
         this->preset != climate::ClimatePreset::CLIMATE_PRESET_ECO) {
         ESP_LOGD("fujitsu",
                  "ECO mode turned on by controller, adding preset change "
                  "to call %d ",
-                 this->sharedState.economyMode);
+                 this->sharedState.economyMode());
 
         this->preset = climate::ClimatePreset::CLIMATE_PRESET_ECO;
         updated = true;
-    } else if (!this->sharedState.economyMode &&
+    } else if (!this->sharedState.economyMode() &&
                this->preset == climate::ClimatePreset::CLIMATE_PRESET_ECO) {
         ESP_LOGD("fujitsu",
                  "ECO mode turned off by controller, adding preset change "
                  "to call, %d",
-                 this->sharedState.economyMode);
+                 this->sharedState.economyMode());
 
         this->preset = climate::ClimatePreset::CLIMATE_PRESET_NONE;
         updated = true;
     }
 
-    if (!this->sharedState.onOff &&
+    if (!this->sharedState.onOff() &&
         this->mode != climate::ClimateMode::CLIMATE_MODE_OFF) {
         ESP_LOGD(TAG,
                  "Controller turned off AC, adding mode change to call");
@@ -170,18 +179,221 @@ void FujitsuClimate::updateState() {
 }
 
 void FujitsuClimate::loop() {
-    // Atomically recieve the state when it changes
-    if (xQueueReceive(this->heatPump.state_dropbox, &this->sharedState, pdMS_TO_TICKS(100))) {
-        ESP_LOGD(TAG, "Got a state update from the other task");
+    uint32_t start_us = micros();
+    // The UART task bumps the version whenever the state changes; copying it
+    // never waits on that task
+    uint32_t version = this->heatPump.getStateVersion();
+    if (version != this->state_version_) {
+        this->state_version_ = version;
+        this->sharedState = this->heatPump.getPublishedState();
+        this->updateState();
+    } else if (this->remote_temperature_ != nullptr && this->remote_temperature_->has_state() &&
+               this->remote_temperature_->state != this->current_temperature) {
         this->updateState();
     }
     if (this->comms_enable_switch_ != nullptr) {
         this->heatPump.comms_is_enabled = this->comms_enable_switch_->state;
     }
+    if (this->log_trace_) {
+        // A few records per pass keeps loop() short; the ring absorbs bursts
+        FujiTraceRecord rec;
+        for (int i = 0; i < 8 && this->heatPump.trace.read(this->trace_cursor_, rec); i++) {
+            this->logTraceRecord(rec);
+        }
+        if (this->trace_cursor_.lost != 0) {
+            ESP_LOGW(TAG, "Bus trace overran, %u records not logged", (unsigned) this->trace_cursor_.lost);
+            this->trace_cursor_.lost = 0;
+        }
+    }
+    if (this->log_capture_) {
+        this->logCapture();
+    }
+    this->logLinkState();
+    this->publishFaults();
+    if (this->heatPump.listenOnly) {
+        this->logSniffer();
+    }
+    this->publishLatency();
+    this->publishBusHealth();
+    this->recordLoopTime(micros() - start_us);
+}
+
+void FujitsuClimate::logLinkState() {
+    FujiLinkStats link = this->heatPump.link.getStats();
+    if (link.transitions == this->link_transitions_) {
+        return;
+    }
+    this->link_transitions_ = link.transitions;
+    // Link times are on the UART task's clock
+    uint32_t now = fujiMillis();
+    ESP_LOGI(TAG, "Link %s; unbound %u s, logging in %u s, discovering %u s, bound %u s, bound with secondary %u s",
+             FujiLink::name(link.state),
+             (unsigned) (FujiLink::timeInStateMs(link, FujiLinkState::UNBOUND, now) / 1000),
+             (unsigned) (FujiLink::timeInStateMs(link, FujiLinkState::LOGGING_IN, now) / 1000),
+             (unsigned) (FujiLink::timeInStateMs(link, FujiLinkState::DISCOVERING, now) / 1000),
+             (unsigned) (FujiLink::timeInStateMs(link, FujiLinkState::BOUND, now) / 1000),
+             (unsigned) (FujiLink::timeInStateMs(link, FujiLinkState::BOUND_SECONDARY, now) / 1000));
+}
+
+void FujitsuClimate::publishFaults() {
+    uint32_t version = this->heatPump.faults.version();
+    if (version == this->faults_version_) {
+        return;
+    }
+    this->faults_version_ = version;
+    char text[128];
+    FujiFaults::format(this->heatPump.faults.read(), text, sizeof(text));
+    ESP_LOGI(TAG, "Faults: %s", text);
+    if (this->fault_codes_sensor_ != nullptr) {
+        this->fault_codes_sensor_->publish_state(text);
+    }
+}
+
+void FujitsuClimate::logSniffer() {
+    char line[256];
+    for (size_t i = 0; i < FujiSniffer::kMaxStations; i++) {
+        FujiSnifferStation station = this->heatPump.sniffer.read(i);
+        if (station.frames == 0 || station.changes == this->sniffer_changes_[i]) {
+            continue;
+        }
+        this->sniffer_changes_[i] = station.changes;
+        FujiSniffer::format(station, line, sizeof(line));
+        ESP_LOGI(TAG, "Sniffer %s", line);
+    }
+    // The timing only settles over time; the whole table once a minute
+    if (millis() - this->sniffer_logged_ms_ >= 60000) {
+        this->sniffer_logged_ms_ = millis();
+        this->dump_sniffer();
+    }
+}
+
+void FujitsuClimate::dump_sniffer() {
+    char line[256];
+    for (size_t i = 0; i < FujiSniffer::kMaxStations; i++) {
+        FujiSnifferStation station = this->heatPump.sniffer.read(i);
+        if (station.frames != 0) {
+            FujiSniffer::format(station, line, sizeof(line));
+            ESP_LOGD(TAG, "Sniffer %s", line);
+        }
+    }
+    if (this->heatPump.sniffer.dropped() != 0) {
+        ESP_LOGD(TAG, "Sniffer: %u frames from addresses beyond the table", (unsigned) this->heatPump.sniffer.dropped());
+    }
+}
+
+void FujitsuClimate::recordLoopTime(uint32_t elapsed_us) {
+    this->loop_passes_++;
+    this->loop_total_us_ += elapsed_us;
+    if (elapsed_us > this->loop_max_us_) {
+        this->loop_max_us_ = elapsed_us;
+    }
+    if (millis() - this->loop_reported_ms_ < 60000) {
+        return;
+    }
+    ESP_LOGD(TAG, "loop: %u passes, mean %u us, max %u us", (unsigned) this->loop_passes_,
+             (unsigned) (this->loop_total_us_ / this->loop_passes_), (unsigned) this->loop_max_us_);
+    if (this->loop_time_sensor_ != nullptr) {
+        this->loop_time_sensor_->publish_state(this->loop_max_us_ / 1000.0f);
+    }
+    this->loop_reported_ms_ = millis();
+    this->loop_passes_ = 0;
+    this->loop_total_us_ = 0;
+    this->loop_max_us_ = 0;
+}
+
+void FujitsuClimate::publishBusHealth() {
+    if (this->bus_health_published_once_ && millis() - this->bus_health_published_ms_ < this->bus_health_interval_ms_) {
+        return;
+    }
+    this->bus_health_published_ms_ = millis();
+    for (size_t i = 0; i < FujiBusHealth::kCount; i++) {
+        sensor::Sensor *sensor = this->bus_counter_sensors_[i];
+        uint32_t value = this->heatPump.health.get(static_cast<FujiBusCounter>(i));
+        if (sensor == nullptr || (this->bus_health_published_once_ && value == this->bus_counter_published_[i])) {
+            continue;
+        }
+        sensor->publish_state(value);
+        this->bus_counter_published_[i] = value;
+    }
+    if (this->rx_delay_sensor_ != nullptr) {
+        this->rx_delay_sensor_->publish_state(this->heatPump.txScheduler.takeRxDelayPeakUs() / 1000.0f);
+    }
+    if (this->response_queue_depth_sensor_ != nullptr) {
+        this->response_queue_depth_sensor_->publish_state(this->heatPump.responses.takePeakDepth());
+    }
+    this->bus_health_published_once_ = true;
+}
+
+void FujitsuClimate::publishLatency() {
+    const FujiHistogram &h = this->heatPump.latency.endToEnd;
+    uint32_t count = h.count();
+    // Only when new commands have echoed, and not more than every 10 s
+    if (count == this->latency_published_count_ || millis() - this->latency_published_ms_ < 10000) {
+        return;
+    }
+    this->latency_published_count_ = count;
+    this->latency_published_ms_ = millis();
+    if (this->latency_p50_sensor_ != nullptr) {
+        this->latency_p50_sensor_->publish_state(h.percentileUs(0.5f) / 1000.0f);
+    }
+    if (this->latency_p95_sensor_ != nullptr) {
+        this->latency_p95_sensor_->publish_state(h.percentileUs(0.95f) / 1000.0f);
+    }
+    if (this->latency_max_sensor_ != nullptr) {
+        this->latency_max_sensor_->publish_state(h.maxUs() / 1000.0f);
+    }
+}
+
+static void toHex(const byte *data, size_t len, char *out) {
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+        out[2 * i] = digits[data[i] >> 4];
+        out[2 * i + 1] = digits[data[i] & 0xF];
+    }
+    out[2 * len] = 0;
+}
+
+void FujitsuClimate::logCapture() {
+    byte buf[kCaptureRecordSize];
+    char hex[2 * kCaptureRecordSize + 1];
+    // A header starts the stream and follows every gap, so a replay can pick
+    // up from any point in the log
+    if (!this->capture_header_logged_ || this->capture_cursor_.lost != 0) {
+        if (this->capture_cursor_.lost != 0) {
+            ESP_LOGW(TAG, "Bus capture overran, %u records lost", (unsigned) this->capture_cursor_.lost);
+            this->capture_cursor_.lost = 0;
+        }
+        FujiCapture::encodeHeader(this->heatPump.getControllerAddress(), buf);
+        toHex(buf, kCaptureHeaderSize, hex);
+        ESP_LOGI(TAG, "FCAPH %s", hex);
+        this->capture_header_logged_ = true;
+    }
+    FujiCaptureRecord rec;
+    for (int i = 0; i < 8 && this->heatPump.capture.read(this->capture_cursor_, rec); i++) {
+        FujiCapture::encodeRecord(rec, buf);
+        toHex(buf, kCaptureRecordSize, hex);
+        ESP_LOGI(TAG, "FCAP %s", hex);
+    }
+}
+
+void FujitsuClimate::logTraceRecord(const FujiTraceRecord &rec) {
+    char line[256];
+    FujiTrace::format(rec, this->heatPump.getControllerAddress(), line, sizeof(line));
+    ESP_LOGD(TAG, "%s", line);
+}
+
+void FujitsuClimate::dump_trace() {
+    FujiTraceCursor cursor;
+    FujiTraceRecord rec;
+    while (this->heatPump.trace.read(cursor, rec)) {
+        this->logTraceRecord(rec);
+    }
 }
 
 void FujitsuClimate::control(const climate::ClimateCall &call) {
     bool updated = false;
+    // Only the fields this call touches are sent, so concurrent changes to others are kept
+    byte fields = 0;
     if (call.get_mode().has_value()) {
         climate::ClimateMode callMode = call.get_mode().value();
         ESP_LOGD(TAG, "Fuji setting mode %d", callMode);
@@ -189,30 +401,35 @@ void FujitsuClimate::control(const climate::ClimateCall &call) {
         auto fujiMode = this->espToFujiMode(callMode);
 
         if (fujiMode.has_value()) {
-            this->sharedState.acMode = static_cast<byte>(fujiMode.value());
+            this->sharedState.setAcMode(static_cast<byte>(fujiMode.value()));
+            fields |= kModeUpdateMask;
             if (callMode != climate::ClimateMode::CLIMATE_MODE_OFF) {
-                this->sharedState.onOff = 1;
+                this->sharedState.setOnOff(1);
+                fields |= kOnOffUpdateMask;
             }
             updated = true;
         }
 
         if (callMode == climate::ClimateMode::CLIMATE_MODE_OFF) {
-            this->sharedState.onOff = 0;
+            this->sharedState.setOnOff(0);
+            fields |= kOnOffUpdateMask;
             updated = true;
         }
     }
     if (call.get_target_temperature().has_value()) {
         auto callTargetTemp = call.get_target_temperature().value();
-        this->sharedState.temperature = callTargetTemp;
+        this->sharedState.setTemperature(callTargetTemp);
+        fields |= kTempUpdateMask;
         updated = true;
         ESP_LOGD(TAG, "Fuji setting temperature %f", callTargetTemp);
     }
 
     if (call.get_preset().has_value()) {
         auto callPreset = call.get_preset().value();
-        this->sharedState.economyMode = static_cast<byte>(
+        this->sharedState.setEconomyMode(static_cast<byte>(
             callPreset == climate::ClimatePreset::CLIMATE_PRESET_ECO ? 1
-                                                                     : 0);
+                                                                     : 0));
+        fields |= kEconomyModeUpdateMask;
         updated = true;
         ESP_LOGD(TAG, "Fuji setting preset %d", callPreset);
     }
@@ -221,13 +438,14 @@ void FujitsuClimate::control(const climate::ClimateCall &call) {
         auto callFanMode = call.get_fan_mode().value();
         auto fujiFanMode = this->espToFujiFanMode(callFanMode);
         if (fujiFanMode.has_value()) {
-            this->sharedState.fanMode = static_cast<byte>(fujiFanMode.value());
+            this->sharedState.setFanMode(static_cast<byte>(fujiFanMode.value()));
+            fields |= kFanModeUpdateMask;
         }
         updated = true;
         ESP_LOGD(TAG, "Fuji setting fan mode %d", this->fan_mode.value_or(-1));
     }
     if (updated) {
-        this->heatPump.setState(&(this->sharedState));
+        this->heatPump.setState(&(this->sharedState), fields);
     }
 }
 
@@ -245,8 +463,8 @@ climate::ClimateTraits FujitsuClimate::traits() {
     });
 
     traits.set_visual_temperature_step(1);
-    traits.set_visual_min_temperature(16);
-    traits.set_visual_max_temperature(30);
+    traits.set_visual_min_temperature(kFujiMinTemperature);
+    traits.set_visual_max_temperature(kFujiMaxTemperature);
 
     traits.set_supported_fan_modes(
         {climate::CLIMATE_FAN_AUTO, climate::CLIMATE_FAN_LOW,
@@ -261,7 +479,9 @@ climate::ClimateTraits FujitsuClimate::traits() {
 
 void FujitsuClimate::dump_config() {
     ESP_LOGCONFIG(TAG, "Fujitsu Climate Heat Pump:");
-    ESP_LOGCONFIG(TAG, "  Using uart #2");
+    ESP_LOGCONFIG(TAG, "  Using uart #%d", this->uart_port_);
+    ESP_LOGCONFIG(TAG, "  RX full threshold: %u bytes, RX timeout: %u byte times",
+                  (unsigned) this->heatPump.rxFullThreshold, (unsigned) this->heatPump.rxTimeoutSymbols);
     if (this->is_master_) {
         ESP_LOGCONFIG(TAG, "  Running as master");
     } else {
@@ -269,6 +489,23 @@ void FujitsuClimate::dump_config() {
     }
     LOG_PIN("  TX Pin:", this->tx_pin_);
     LOG_PIN("  RX Pin:", this->rx_pin_);
+    ESP_LOGCONFIG(TAG, "  Log bus trace: %s", YESNO(this->log_trace_));
+    ESP_LOGCONFIG(TAG, "  Log bus capture: %s", YESNO(this->log_capture_));
+    ESP_LOGCONFIG(TAG, "  Listen only: %s", YESNO(this->heatPump.listenOnly));
+    ESP_LOGCONFIG(TAG, "  Link: %s", FujiLink::name(this->heatPump.link.getStats().state));
+    LOG_TEXT_SENSOR("  ", "Fault Codes", this->fault_codes_sensor_);
+    LOG_SENSOR("  ", "Command Latency p50", this->latency_p50_sensor_);
+    LOG_SENSOR("  ", "Command Latency p95", this->latency_p95_sensor_);
+    LOG_SENSOR("  ", "Command Latency Max", this->latency_max_sensor_);
+    LOG_SENSOR("  ", "Response Queue Depth", this->response_queue_depth_sensor_);
+    LOG_SENSOR("  ", "RX Delay", this->rx_delay_sensor_);
+    ESP_LOGCONFIG(TAG, "  Bus health interval: %u ms", (unsigned) this->bus_health_interval_ms_);
+    for (size_t i = 0; i < FujiBusHealth::kCount; i++) {
+        if (this->bus_counter_sensors_[i] != nullptr) {
+            ESP_LOGCONFIG(TAG, "  Bus counter '%s': %s", FujiBusHealth::name(static_cast<FujiBusCounter>(i)),
+                          this->bus_counter_sensors_[i]->get_name().c_str());
+        }
+    }
     //if (this->remote_temperature_ != nullptr) {
     //    LOG_SENSOR("  ", "Remote Temp Sensor", this->remote_temperature_);
     //}
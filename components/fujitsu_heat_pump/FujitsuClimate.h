@@ -6,6 +6,7 @@
 #include "esphome/components/climate/climate.h"
 #include "esphome/components/sensor/sensor.h"
 #include "esphome/components/switch/switch.h"
+#include "esphome/components/text_sensor/text_sensor.h"
 #include "FujiHeatPump.h"
 
 namespace esphome {
@@ -26,19 +27,89 @@ class FujitsuClimate : public climate::Climate, public Component {
     void set_master(bool is_master) { this->is_master_ = is_master; }
     void set_tx_pin(InternalGPIOPin *tx_pin) { this->tx_pin_ = tx_pin; }
     void set_rx_pin(InternalGPIOPin *rx_pin) { this->rx_pin_ = rx_pin; }
+    void set_uart_port(int uart_port) { this->uart_port_ = uart_port; }
     void set_remote_temperature(sensor::Sensor *sensor) { this->remote_temperature_ = sensor; }
     void set_comms_enable_switch(switch_::Switch *sw) { this->comms_enable_switch_ = sw; }
+    // Log new bus trace records from loop() as they come in
+    void set_log_trace(bool log_trace) { this->log_trace_ = log_trace; }
+    // Logs whatever the bus trace still holds, e.g. from a button or API service lambda
+    void dump_trace();
+    // Never transmit; log what every address on the bus says instead
+    void set_listen_only(bool listen_only) { this->heatPump.listenOnly = listen_only; }
+    // UART RX FIFO full threshold in bytes and RX timeout in byte times
+    void set_rx_full_threshold(uint8_t threshold) { this->heatPump.rxFullThreshold = threshold; }
+    void set_rx_timeout(uint8_t symbols) { this->heatPump.rxTimeoutSymbols = symbols; }
+    // Logs the listen-only table of every address heard so far
+    void dump_sniffer();
+    // Stream the bus capture into the log as hex lines for host/fuji_replay --log
+    void set_log_capture(bool log_capture) { this->log_capture_ = log_capture; }
+    // setState() to unit echo latency, in ms
+    void set_latency_p50_sensor(sensor::Sensor *sensor) { this->latency_p50_sensor_ = sensor; }
+    void set_latency_p95_sensor(sensor::Sensor *sensor) { this->latency_p95_sensor_ = sensor; }
+    void set_latency_max_sensor(sensor::Sensor *sensor) { this->latency_max_sensor_ = sensor; }
+    void set_bus_counter_sensor(FujiBusCounter counter, sensor::Sensor *sensor) {
+        this->bus_counter_sensors_[static_cast<size_t>(counter)] = sensor;
+    }
+    // Bus counters are published at most this often, and only when they moved
+    void set_bus_health_interval(uint32_t interval_ms) { this->bus_health_interval_ms_ = interval_ms; }
+    // Longest wait from a frame's last byte to its handling over each bus health interval, in ms
+    void set_rx_delay_sensor(sensor::Sensor *sensor) { this->rx_delay_sensor_ = sensor; }
+    // Most responses waiting at once over each bus health interval
+    void set_response_queue_depth_sensor(sensor::Sensor *sensor) { this->response_queue_depth_sensor_ = sensor; }
+    // Longest loop() pass over the last minute, in ms
+    void set_loop_time_sensor(sensor::Sensor *sensor) { this->loop_time_sensor_ = sensor; }
+    // Active fault codes from the unit's error details, with when each was first seen
+    void set_fault_codes_sensor(text_sensor::TextSensor *sensor) { this->fault_codes_sensor_ = sensor; }
 
 
    protected:
     bool is_master_;
     InternalGPIOPin *tx_pin_;
     InternalGPIOPin *rx_pin_;
+    int uart_port_{2};
     sensor::Sensor *remote_temperature_{nullptr};
     switch_::Switch *comms_enable_switch_{nullptr};
+    bool log_trace_{false};
+    FujiTraceCursor trace_cursor_;
+    bool log_capture_{false};
+    bool capture_header_logged_{false};
+    FujiRingCursor capture_cursor_;
+    sensor::Sensor *latency_p50_sensor_{nullptr};
+    sensor::Sensor *latency_p95_sensor_{nullptr};
+    sensor::Sensor *latency_max_sensor_{nullptr};
+    uint32_t latency_published_count_{0};
+    uint32_t latency_published_ms_{0};
+    sensor::Sensor *bus_counter_sensors_[FujiBusHealth::kCount] = {};
+    uint32_t bus_counter_published_[FujiBusHealth::kCount] = {};
+    uint32_t bus_health_interval_ms_{60000};
+    uint32_t bus_health_published_ms_{0};
+    bool bus_health_published_once_{false};
+    sensor::Sensor *response_queue_depth_sensor_{nullptr};
+    sensor::Sensor *rx_delay_sensor_{nullptr};
+    uint32_t state_version_{0};
+    sensor::Sensor *loop_time_sensor_{nullptr};
+    uint32_t loop_passes_{0};
+    uint64_t loop_total_us_{0};
+    uint32_t loop_max_us_{0};
+    uint32_t loop_reported_ms_{0};
+    uint32_t link_transitions_{0};
+    text_sensor::TextSensor *fault_codes_sensor_{nullptr};
+    uint32_t faults_version_{0};
+    uint32_t sniffer_changes_[FujiSniffer::kMaxStations];
+    uint32_t sniffer_logged_ms_{0};
 
 
     void updateState();
+    void logTraceRecord(const FujiTraceRecord &rec);
+    void logCapture();
+    void publishLatency();
+    void publishBusHealth();
+    void recordLoopTime(uint32_t elapsed_us);
+    // Logs the link state and time spent in each state whenever it changes
+    void logLinkState();
+    void publishFaults();
+    // In listen-only mode, logs each address when it first talks or its state changes
+    void logSniffer();
     optional<climate::ClimateMode> fujiToEspMode(FujiMode fujiMode);
     optional<FujiMode> espToFujiMode(climate::ClimateMode espMode);
     
@@ -1,17 +1,24 @@
 from esphome import pins
-from esphome.components import climate, sensor, switch
+from esphome.components import climate, sensor, switch, text_sensor
 import esphome.config_validation as cv
 import esphome.codegen as cg
+import esphome.final_validate as fv
 from esphome.core import CORE
 from esphome.const import (
     CONF_ID,
+    CONF_PLATFORM,
+    STATE_CLASS_TOTAL_INCREASING,
+    DEVICE_CLASS_DURATION,
+    ENTITY_CATEGORY_DIAGNOSTIC,
+    STATE_CLASS_MEASUREMENT,
+    UNIT_MILLISECOND,
     CONF_SWITCH_DATAPOINT,
     CONF_SUPPORTS_COOL,
     CONF_SUPPORTS_HEAT,
 )
 
 CODEOWNERS = ["@rabbit-aaron", "@dgrnbrg"]
-AUTO_LOAD = ["sensor", "switch"]
+AUTO_LOAD = ["sensor", "switch", "text_sensor"]
 
 fujitsu_climate_ns = cg.esphome_ns.namespace("fujitsu")
 FujitsuClimateComponent = fujitsu_climate_ns.class_("FujitsuClimate",
@@ -26,6 +33,71 @@ CONF_REMOTE_TEMPERATURE = "remote_temperature_id"
 CONF_TX_PIN = "tx_pin"
 CONF_RX_PIN = "rx_pin"
 CONF_ENABLE_COMMS = "enable_communication"
+CONF_UART_PORT = "uart_port"
+CONF_LOG_TRACE = "log_trace"
+CONF_LOG_CAPTURE = "log_capture"
+CONF_COMMAND_LATENCY_P50 = "command_latency_p50"
+CONF_COMMAND_LATENCY_P95 = "command_latency_p95"
+CONF_COMMAND_LATENCY_MAX = "command_latency_max"
+CONF_LOOP_TIME = "loop_time"
+CONF_RESPONSE_QUEUE_DEPTH = "response_queue_depth"
+CONF_RX_FULL_THRESHOLD = "rx_full_threshold"
+CONF_RX_TIMEOUT = "rx_timeout"
+CONF_RX_DELAY = "rx_delay"
+CONF_FAULT_CODES = "fault_codes"
+CONF_LISTEN_ONLY = "listen_only"
+
+CONF_BUS_HEALTH_INTERVAL = "bus_health_interval"
+
+FujiBusCounter = fujitsu_climate_ns.enum("FujiBusCounter", is_class=True)
+# YAML key -> counter, for the bus health diagnostic sensors
+BUS_COUNTERS = {
+    "bus_frames_received": FujiBusCounter.FRAMES_RECEIVED,
+    "bus_frames_for_us": FujiBusCounter.FRAMES_FOR_US,
+    "bus_frames_sent": FujiBusCounter.FRAMES_SENT,
+    "bus_bytes_dropped": FujiBusCounter.BYTES_DROPPED,
+    "bus_response_drops": FujiBusCounter.RESPONSE_DROPS,
+    "bus_fifo_overflows": FujiBusCounter.FIFO_OVERFLOWS,
+    "bus_buffer_full": FujiBusCounter.BUFFER_FULL,
+    "bus_parity_errors": FujiBusCounter.PARITY_ERRORS,
+    "bus_frame_errors": FujiBusCounter.FRAME_ERRORS,
+    "bus_breaks": FujiBusCounter.BREAKS,
+    "bus_command_retries": FujiBusCounter.COMMAND_RETRIES,
+    "bus_commands_abandoned": FujiBusCounter.COMMANDS_ABANDONED,
+    "bus_frame_cache_hits": FujiBusCounter.FRAME_CACHE_HITS,
+    "bus_collisions": FujiBusCounter.COLLISIONS,
+    "bus_echo_errors": FujiBusCounter.ECHO_ERRORS,
+    "bus_retransmits": FujiBusCounter.RETRANSMITS,
+    "bus_responses_superseded": FujiBusCounter.RESPONSES_SUPERSEDED,
+}
+
+BUS_COUNTER_SENSOR_SCHEMA = sensor.sensor_schema(
+    accuracy_decimals=0,
+    state_class=STATE_CLASS_TOTAL_INCREASING,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+)
+
+LATENCY_SENSOR_SCHEMA = sensor.sensor_schema(
+    unit_of_measurement=UNIT_MILLISECOND,
+    accuracy_decimals=0,
+    device_class=DEVICE_CLASS_DURATION,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+)
+
+DURATION_MS_SENSOR_SCHEMA = sensor.sensor_schema(
+    unit_of_measurement=UNIT_MILLISECOND,
+    accuracy_decimals=2,
+    device_class=DEVICE_CLASS_DURATION,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+)
+
+RESPONSE_QUEUE_SENSOR_SCHEMA = sensor.sensor_schema(
+    accuracy_decimals=0,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+)
 
 def validate_tx_pin(value):
     value = pins.internal_gpio_output_pin_schema(value)
@@ -47,17 +119,64 @@ CONFIG_SCHEMA = (
             cv.Optional(CONF_REMOTE_TEMPERATURE): cv.use_id(sensor.Sensor),
             cv.Optional(CONF_TX_PIN): validate_tx_pin,
             cv.Optional(CONF_RX_PIN): validate_rx_pin,
+            # Every heat pump needs its own hardware UART; UART0 is usually the logger
+            cv.Optional(CONF_UART_PORT, default=2): cv.int_range(min=0, max=2),
             #cv.Optional(CONF_TEMPERATURE_STEP) -- set to 2
             cv.Optional(CONF_ENABLE_COMMS): cv.use_id(switch.Switch),
+            cv.Optional(CONF_LOG_TRACE, default=False): cv.boolean,
+            cv.Optional(CONF_LOG_CAPTURE, default=False): cv.boolean,
+            # Decode and log every address on the bus without ever transmitting
+            cv.Optional(CONF_LISTEN_ONLY, default=False): cv.boolean,
+            cv.Optional(CONF_COMMAND_LATENCY_P50): LATENCY_SENSOR_SCHEMA,
+            cv.Optional(CONF_COMMAND_LATENCY_P95): LATENCY_SENSOR_SCHEMA,
+            cv.Optional(CONF_COMMAND_LATENCY_MAX): LATENCY_SENSOR_SCHEMA,
+            cv.Optional(CONF_BUS_HEALTH_INTERVAL, default="60s"): cv.positive_time_period_milliseconds,
+            cv.Optional(CONF_LOOP_TIME): DURATION_MS_SENSOR_SCHEMA,
+            # Deepest the response queue got over each bus health interval
+            cv.Optional(CONF_RESPONSE_QUEUE_DEPTH): RESPONSE_QUEUE_SENSOR_SCHEMA,
+            # Bytes in the RX FIFO that raise a data event; one frame by default
+            cv.Optional(CONF_RX_FULL_THRESHOLD, default=8): cv.int_range(min=1, max=120),
+            # Quiet time, in byte times (22 ms each), before a partial chunk is handed over
+            cv.Optional(CONF_RX_TIMEOUT, default=2): cv.int_range(min=1, max=126),
+            # Longest delay from a frame's last byte on rx_pin to its handling over each bus health interval
+            cv.Optional(CONF_RX_DELAY): DURATION_MS_SENSOR_SCHEMA,
+            cv.Optional(CONF_FAULT_CODES): text_sensor.text_sensor_schema(
+                icon="mdi:alert-circle-outline",
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            ),
         }
-    ).extend(cv.COMPONENT_SCHEMA)
+    )
+    .extend({cv.Optional(key): BUS_COUNTER_SENSOR_SCHEMA for key in BUS_COUNTERS})
+    .extend(cv.COMPONENT_SCHEMA)
 )
 
+# All heat pumps share one service task with room for three buses
+MAX_HEAT_PUMPS = 3
+
+def _final_validate(config):
+    ports = [
+        conf[CONF_UART_PORT]
+        for conf in fv.full_config.get().get("climate", [])
+        if conf.get(CONF_PLATFORM) == "fujitsu_heat_pump"
+    ]
+    if len(ports) > MAX_HEAT_PUMPS:
+        raise cv.Invalid(f"At most {MAX_HEAT_PUMPS} Fujitsu heat pumps are supported per device")
+    if ports.count(config[CONF_UART_PORT]) > 1:
+        raise cv.Invalid(f"uart_port {config[CONF_UART_PORT]} is used by more than one heat pump")
+
+FINAL_VALIDATE_SCHEMA = _final_validate
+
 async def to_code(config):
     var = cg.new_Pvariable(config[CONF_ID])
     await cg.register_component(var, config)
     await climate.register_climate(var, config)
     cg.add(var.set_master(config[CONF_IS_MASTER]))
+    cg.add(var.set_uart_port(config[CONF_UART_PORT]))
+    cg.add(var.set_log_trace(config[CONF_LOG_TRACE]))
+    cg.add(var.set_log_capture(config[CONF_LOG_CAPTURE]))
+    cg.add(var.set_listen_only(config[CONF_LISTEN_ONLY]))
+    cg.add(var.set_rx_full_threshold(config[CONF_RX_FULL_THRESHOLD]))
+    cg.add(var.set_rx_timeout(config[CONF_RX_TIMEOUT]))
     if CONF_TX_PIN in config:
         tx_pin = await cg.gpio_pin_expression(config[CONF_TX_PIN])
         cg.add(var.set_tx_pin(tx_pin))
@@ -67,6 +186,32 @@ async def to_code(config):
     if CONF_REMOTE_TEMPERATURE in config:
         remote_var = await cg.get_variable(config[CONF_REMOTE_TEMPERATURE])
         cg.add(var.set_remote_temperature(remote_var))
+    if CONF_COMMAND_LATENCY_P50 in config:
+        sens = await sensor.new_sensor(config[CONF_COMMAND_LATENCY_P50])
+        cg.add(var.set_latency_p50_sensor(sens))
+    if CONF_COMMAND_LATENCY_P95 in config:
+        sens = await sensor.new_sensor(config[CONF_COMMAND_LATENCY_P95])
+        cg.add(var.set_latency_p95_sensor(sens))
+    if CONF_COMMAND_LATENCY_MAX in config:
+        sens = await sensor.new_sensor(config[CONF_COMMAND_LATENCY_MAX])
+        cg.add(var.set_latency_max_sensor(sens))
+    cg.add(var.set_bus_health_interval(config[CONF_BUS_HEALTH_INTERVAL]))
+    if CONF_LOOP_TIME in config:
+        sens = await sensor.new_sensor(config[CONF_LOOP_TIME])
+        cg.add(var.set_loop_time_sensor(sens))
+    if CONF_RX_DELAY in config:
+        sens = await sensor.new_sensor(config[CONF_RX_DELAY])
+        cg.add(var.set_rx_delay_sensor(sens))
+    if CONF_RESPONSE_QUEUE_DEPTH in config:
+        sens = await sensor.new_sensor(config[CONF_RESPONSE_QUEUE_DEPTH])
+        cg.add(var.set_response_queue_depth_sensor(sens))
+    if CONF_FAULT_CODES in config:
+        sens = await text_sensor.new_text_sensor(config[CONF_FAULT_CODES])
+        cg.add(var.set_fault_codes_sensor(sens))
+    for key, counter in BUS_COUNTERS.items():
+        if key in config:
+            sens = await sensor.new_sensor(config[key])
+            cg.add(var.set_bus_counter_sensor(counter, sens))
     if CONF_ENABLE_COMMS in config:
         switch_var = await cg.get_variable(config[CONF_ENABLE_COMMS])
         cg.add(var.set_comms_enable_switch(switch_var))
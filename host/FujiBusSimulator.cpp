@@ -0,0 +1,383 @@
+// Host-side model of a Fujitsu indoor unit and its single-wire bus
+
+#include "FujiBusSimulator.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace esphome {
+namespace fujitsu {
+
+static const byte kUnitAddress = static_cast<byte>(FujiAddress::UNIT);
+static const byte kPrimaryAddress = static_cast<byte>(FujiAddress::PRIMARY);
+static const byte kSecondaryAddress = static_cast<byte>(FujiAddress::SECONDARY);
+
+static FujiBusSimulator *activeBus = nullptr;
+
+static uint64_t simClock() { return activeBus->now(); }
+
+static void toWire(const FujiFrame &ff, byte *wire) {
+    fujiEncodeFrame(ff, wire);
+    for (size_t i = 0; i < kFrameSize; i++) {
+        wire[i] ^= 0xFF;
+    }
+}
+
+static FujiFrame fromWire(const byte *wire) {
+    byte buf[kFrameSize];
+    for (size_t i = 0; i < kFrameSize; i++) {
+        buf[i] = wire[i] ^ 0xFF;
+    }
+    FujiFrame ff;
+    fujiDecodeFrame(buf, 0, ff);
+    return ff;
+}
+
+FujiSimIndoorUnit::FujiSimIndoorUnit() {
+    state.setOnOff(0);
+    state.setTemperature(22);
+    state.setAcMode(static_cast<byte>(FujiMode::COOL));
+    state.setFanMode(static_cast<byte>(FujiFanMode::FAN_AUTO));
+    state.setControllerTemp(21);
+    peers.push_back(Peer{kPrimaryAddress});
+    peers.push_back(Peer{kSecondaryAddress});
+}
+
+FujiSimIndoorUnit::Peer *FujiSimIndoorUnit::peer(byte address) {
+    for (auto &p : peers) {
+        if (p.address == address) {
+            return &p;
+        }
+    }
+    return nullptr;
+}
+
+bool FujiSimIndoorUnit::isLoggedIn(byte address) {
+    Peer *p = peer(address);
+    return p != nullptr && p->loggedIn;
+}
+
+void FujiSimIndoorUnit::powerOff() {
+    powered = false;
+    awaiting = nullptr;
+    pendingLoginReply = false;
+    pendingErrorReply = false;
+    for (auto &p : peers) {
+        p.loggedIn = false;
+        p.loginReplied = false;
+        p.missedPolls = 0;
+    }
+}
+
+void FujiSimIndoorUnit::powerOn(uint64_t nowUs) {
+    powered = true;
+    wakeUs = nowUs + turnaroundUs;
+}
+
+uint64_t FujiSimIndoorUnit::nextWakeUs() { return powered ? wakeUs : UINT64_MAX; }
+
+void FujiSimIndoorUnit::send(FujiBusSimulator &bus, FujiFrame ff, uint64_t nowUs) {
+    byte wire[kFrameSize];
+    if (ff.messageDest() == kPrimaryAddress) {
+        // With the current codec bit 5 of the destination doubles as the login
+        // bit, so the primary is addressed through the broadcast bit instead
+        ff.setMessageDest(0);
+        toWire(ff, wire);
+        wire[0] ^= FujiBroadcastField::mask;
+    } else {
+        toWire(ff, wire);
+    }
+    bus.transmit(this, nowUs, wire);
+}
+
+void FujiSimIndoorUnit::sendPoll(FujiBusSimulator &bus, uint64_t nowUs) {
+    Peer *target = &peers[nextPeer];
+    nextPeer = (nextPeer + 1) % peers.size();
+    if (target->address == kSecondaryAddress && !secondaryPresent) {
+        target = &peers[0];
+        nextPeer = 1;
+    }
+
+    FujiFrame ff = state;
+    ff.setMessageSource(kUnitAddress);
+    ff.setMessageType(static_cast<byte>(FujiMessageType::STATUS));
+    ff.setAcError(errorCode != 0);
+    ff.setControllerPresent(1);
+    ff.setWriteBit(false);
+    ff.setLoginBit(!target->loggedIn);
+    ff.setUpdateMagic(0);
+
+    ff.setMessageDest(target->address);
+    send(bus, ff, nowUs);
+
+    awaiting = target;
+    answered = false;
+    wakeUs = nowUs + kSimFrameTimeUs + replyTimeoutUs;
+}
+
+void FujiSimIndoorUnit::wake(FujiBusSimulator &bus, uint64_t nowUs) {
+    if (awaiting != nullptr && !answered) {
+        if (++awaiting->missedPolls >= missedPollLimit) {
+            awaiting->loggedIn = false;
+            awaiting->loginReplied = false;
+        }
+    }
+    awaiting = nullptr;
+
+    FujiFrame ff;
+    ff.setMessageSource(kUnitAddress);
+    if (pendingLoginReply) {
+        pendingLoginReply = false;
+        ff.setMessageDest(pendingLoginDest);
+        ff.setMessageType(static_cast<byte>(FujiMessageType::LOGIN));
+        ff.setControllerPresent(1);
+        peer(pendingLoginDest)->loginReplied = true;
+    } else if (pendingErrorReply) {
+        pendingErrorReply = false;
+        ff.setMessageDest(pendingErrorDest);
+        ff.setMessageType(static_cast<byte>(FujiMessageType::ERROR));
+        ff.setAcError(errorCode != 0);
+        // Best guess at the detail layout: the fault code is all of byte 4
+        FujiErrorCodeField::put(ff.raw, errorCode);
+    } else {
+        sendPoll(bus, nowUs);
+        return;
+    }
+
+    send(bus, ff, nowUs);
+    awaiting = peer(ff.messageDest());
+    answered = false;
+    wakeUs = nowUs + kSimFrameTimeUs + replyTimeoutUs;
+}
+
+void FujiSimIndoorUnit::onFrame(FujiBusSimulator &, const byte *wire, uint64_t endUs) {
+    if (!powered) {
+        return;
+    }
+    FujiFrame ff = fromWire(wire);
+    Peer *from = peer(ff.messageSource());
+    if (from == nullptr) {
+        return;
+    }
+    from->missedPolls = 0;
+    if (from == awaiting) {
+        answered = true;
+    }
+    // Leave the bus alone while a controller is still talking
+    wakeUs = std::max(wakeUs, endUs + turnaroundUs);
+    if (answered) {
+        wakeUs = endUs + turnaroundUs;
+    }
+
+    // Bit 5 of the destination is also the login bit, so the primary's login
+    // traffic to us and to the secondary look alike; tell them apart by type.
+    if (ff.messageType() == static_cast<byte>(FujiMessageType::LOGIN)) {
+        // Until the controller's ack, in case our reply never reached it
+        if (!from->loggedIn) {
+            pendingLoginReply = true;
+            pendingLoginDest = from->address;
+        }
+    } else if (ff.messageType() == static_cast<byte>(FujiMessageType::ERROR)) {
+        pendingErrorReply = true;
+        pendingErrorDest = from->address;
+    } else if (ff.messageType() == static_cast<byte>(FujiMessageType::STATUS)) {
+        if (from->loginReplied || from->address == kSecondaryAddress) {
+            from->loggedIn = true;
+        }
+        if (ff.writeBit() && writeDropProbability > 0 &&
+            std::uniform_real_distribution<double>()(rng) < writeDropProbability) {
+            writesDropped++;
+        } else if (ff.writeBit()) {
+            state.setOnOff(ff.onOff());
+            state.setTemperature(ff.temperature());
+            state.setAcMode(ff.acMode());
+            state.setFanMode(ff.fanMode());
+            state.setEconomyMode(ff.economyMode());
+            state.setSwingMode(ff.swingMode());
+            state.setSwingStep(ff.swingStep());
+            writesApplied++;
+        }
+    }
+}
+
+void FujiSimController::onFrame(FujiBusSimulator &bus, const byte *wire, uint64_t endUs) {
+    this->bus = &bus;
+    byte bytes[kFrameSize + 1];
+    size_t len = 0;
+    if (glitchProbability > 0 && std::uniform_real_distribution<double>()(rng) < glitchProbability) {
+        bytes[len++] = static_cast<byte>(rng());
+    }
+    memcpy(bytes + len, wire, kFrameSize);
+    len += kFrameSize;
+    received(bytes, len, endUs);
+    if (idleGaps) {
+        idle(endUs);
+    }
+    schedule();
+}
+
+void FujiSimController::schedule() {
+    uint64_t slot = sendDue(0);
+    if (slot != slotUs) {
+        slotUs = slot;
+        sendUs = slot == UINT64_MAX ? UINT64_MAX : slot + replyJitterUs(rng);
+    }
+}
+
+bool FujiSimController::write(const byte *frame) {
+    bus->transmit(this, bus->now(), frame);
+    return true;
+}
+
+uint64_t FujiSimController::nextWakeUs() {
+    uint32_t ms = heatPump.link.nextTimeoutMs(fujiMillis());
+    return std::min<uint64_t>(sendUs, ms == UINT32_MAX ? UINT64_MAX : fujiMicros() + ms * 1000ULL);
+}
+
+void FujiSimController::wake(FujiBusSimulator &bus, uint64_t nowUs) {
+    this->bus = &bus;
+    heatPump.poll();
+    if (nowUs >= sendUs) {
+        // Late by the jitter, so sendDue() sends right away
+        slotUs = UINT64_MAX;
+        sendUs = UINT64_MAX;
+        schedule();
+    } else if (sendUs == UINT64_MAX) {
+        schedule();
+    }
+}
+
+void FujiSimRemote::onFrame(FujiBusSimulator &bus, const byte *wire, uint64_t endUs) {
+    FujiFrame ff = fromWire(wire);
+    if (ff.messageSource() != kUnitAddress || ff.messageDest() != address) {
+        return;
+    }
+    ff.setMessageSource(address);
+    ff.setMessageDest(kUnitAddress);
+    ff.setLoginBit(false);
+    ff.setWriteBit(false);
+    ff.setUnknownBit(true);
+    ff.setControllerPresent(1);
+    ff.setControllerTemp(roomTemperature);
+    byte response[kFrameSize];
+    toWire(ff, response);
+    bus.transmit(this, endUs + replyDelayUs, response);
+}
+
+FujiBusSimulator::FujiBusSimulator() {
+    activeBus = this;
+    fujiSetHostClock(simClock);
+}
+
+FujiBusSimulator::~FujiBusSimulator() {
+    if (activeBus == this) {
+        fujiSetHostClock(nullptr);
+        activeBus = nullptr;
+    }
+}
+
+void FujiBusSimulator::transmit(FujiSimNode *from, uint64_t startUs, const byte *wire) {
+    Transmission tx;
+    tx.from = from;
+    tx.startUs = std::max(startUs, nowUs);
+    memcpy(tx.wire, wire, kFrameSize);
+    pending.push_back(tx);
+}
+
+uint64_t FujiBusSimulator::nextEventUs() const {
+    uint64_t next = UINT64_MAX;
+    for (const auto &tx : pending) {
+        next = std::min(next, tx.startUs + kSimFrameTimeUs);
+    }
+    for (auto node : nodes) {
+        next = std::min(next, node->nextWakeUs());
+    }
+    return next;
+}
+
+void FujiBusSimulator::runUntil(uint64_t untilUs) {
+    // Several buses may be stepped in turn; the host clock follows whichever runs
+    activeBus = this;
+    while (nowUs < untilUs) {
+        uint64_t nextTx = UINT64_MAX;
+        size_t txIndex = 0;
+        for (size_t i = 0; i < pending.size(); i++) {
+            if (pending[i].startUs < nextTx) {
+                nextTx = pending[i].startUs;
+                txIndex = i;
+            }
+        }
+        uint64_t nextWake = UINT64_MAX;
+        FujiSimNode *waker = nullptr;
+        for (auto node : nodes) {
+            uint64_t t = node->nextWakeUs();
+            if (t < nextWake) {
+                nextWake = t;
+                waker = node;
+            }
+        }
+
+        if (nextWake <= nextTx && nextWake < untilUs) {
+            nowUs = std::max(nowUs, nextWake);
+            waker->wake(*this, nowUs);
+            continue;
+        }
+        if (nextTx >= untilUs) {
+            nowUs = untilUs;
+            return;
+        }
+
+        // One frame occupies the wire; anything else starting before it ends collides
+        Transmission tx = pending[txIndex];
+        pending.erase(pending.begin() + txIndex);
+        uint64_t endUs = tx.startUs + kSimFrameTimeUs;
+        std::vector<FujiSimNode *> senders{tx.from};
+        for (size_t i = 0; i < pending.size();) {
+            if (pending[i].startUs < endUs) {
+                // Idle line is high, so the dominant low level wins
+                for (size_t b = 0; b < kFrameSize; b++) {
+                    tx.wire[b] &= pending[i].wire[b];
+                }
+                senders.push_back(pending[i].from);
+                endUs = std::max(endUs, pending[i].startUs + kSimFrameTimeUs);
+                pending.erase(pending.begin() + i);
+                collisions++;
+            } else {
+                i++;
+            }
+        }
+
+        if (noiseProbability > 0 && std::uniform_real_distribution<double>()(rng) < noiseProbability) {
+            tx.wire[0] = 0;
+            for (size_t b = 1; b < kFrameSize; b++) {
+                tx.wire[b] &= static_cast<byte>(rng() | rng());
+            }
+            collisions++;
+        }
+
+        nowUs = endUs;
+        framesDelivered++;
+        if (onWire) {
+            onWire(tx.wire, endUs);
+        }
+        for (auto node : nodes) {
+            if (echo || std::find(senders.begin(), senders.end(), node) == senders.end()) {
+                node->onFrame(*this, tx.wire, endUs);
+            }
+        }
+    }
+}
+
+bool FujiBusSimulator::runUntil(uint64_t untilUs, uint64_t stepUs,
+                                const std::function<bool(uint64_t)> &probe) {
+    while (nowUs < untilUs) {
+        runUntil(std::min(untilUs, nowUs + stepUs));
+        if (probe(nowUs)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -0,0 +1,185 @@
+// Host-side model of a Fujitsu indoor unit and its single-wire bus, running
+// in virtual time so whole sessions can be simulated in milliseconds.
+#pragma once
+
+#include <functional>
+#include <random>
+#include <stdint.h>
+#include <vector>
+
+#include "FujiFrame.h"
+#include "FujiHeatPump.h"
+#include "FujiTransport.h"
+
+namespace esphome {
+namespace fujitsu {
+
+const uint64_t kSimFrameTimeUs = kFujiFrameTimeUs;
+
+class FujiBusSimulator;
+
+// Anything attached to the bus. Frames are handed over in wire (inverted) form.
+class FujiSimNode {
+   public:
+    virtual ~FujiSimNode() {}
+    // A frame finished arriving at endUs
+    virtual void onFrame(FujiBusSimulator &bus, const byte *wire, uint64_t endUs) = 0;
+    // Next time this node wants wake() called; UINT64_MAX if never
+    virtual uint64_t nextWakeUs() { return UINT64_MAX; }
+    virtual void wake(FujiBusSimulator &, uint64_t) {}
+};
+
+// The indoor unit: polls its controllers, runs the login handshake, applies
+// write-bit frames to its own state and answers error detail requests.
+class FujiSimIndoorUnit : public FujiSimNode {
+   public:
+    FujiSimIndoorUnit();
+
+    void onFrame(FujiBusSimulator &bus, const byte *wire, uint64_t endUs) override;
+    uint64_t nextWakeUs() override;
+    void wake(FujiBusSimulator &bus, uint64_t nowUs) override;
+
+    // Also poll a secondary controller at address 33
+    void setSecondaryPresent(bool present) { this->secondaryPresent = present; }
+    // Drops off the bus (and forgets every login) until powerOn()
+    void powerOff();
+    void powerOn(uint64_t nowUs);
+    bool isPowered() const { return this->powered; }
+    void setError(byte code) { this->errorCode = code; }
+
+    bool isLoggedIn(byte address);
+    FujiFrame state;
+    byte errorCode = 0;
+
+    // Gap the unit leaves after the bus goes quiet before its next poll
+    uint64_t turnaroundUs = 60000;
+    // How long the unit waits for a reply before moving on
+    uint64_t replyTimeoutUs = 250000;
+    // Unanswered polls before a controller is considered gone
+    int missedPollLimit = 5;
+
+    // Chance the unit ignores a write-bit frame, as if it never heard it
+    double writeDropProbability = 0;
+
+    uint32_t writesApplied = 0;
+    uint32_t writesDropped = 0;
+
+   private:
+    struct Peer {
+        byte address;
+        bool loggedIn = false;
+        bool loginReplied = false;
+        int missedPolls = 0;
+    };
+
+    Peer *peer(byte address);
+    void send(FujiBusSimulator &bus, FujiFrame ff, uint64_t nowUs);
+    void sendPoll(FujiBusSimulator &bus, uint64_t nowUs);
+
+    std::vector<Peer> peers;
+    bool secondaryPresent = false;
+    bool powered = true;
+    size_t nextPeer = 0;
+    Peer *awaiting = nullptr;
+    bool answered = false;
+    uint64_t wakeUs = 0;
+    bool pendingLoginReply = false;
+    byte pendingLoginDest = 0;
+    bool pendingErrorReply = false;
+    byte pendingErrorDest = 0;
+    std::mt19937 rng{2};
+};
+
+// Runs one of our FujiHeatPump controllers on the simulated bus, as its
+// transport: frames arrive through received() and replies go out when the
+// simulator wakes the controller at their slot, as the UART service does
+class FujiSimController : public FujiSimNode, public FujiTransport {
+   public:
+    FujiSimController(FujiHeatPump &heatPump) : FujiTransport(&heatPump), heatPump(heatPump) {
+        heatPump.transport = this;
+    }
+
+    void onFrame(FujiBusSimulator &bus, const byte *wire, uint64_t endUs) override;
+    // Reply slots and link timeouts
+    uint64_t nextWakeUs() override;
+    void wake(FujiBusSimulator &bus, uint64_t nowUs) override;
+    const char *name() const override { return "simulated bus"; }
+
+    FujiHeatPump &heatPump;
+    // Scheduling jitter added to every reply (slot timing itself comes from heatPump.txScheduler)
+    std::uniform_int_distribution<uint32_t> replyJitterUs{0, 0};
+    // Chance of a stray byte on the line just before a frame
+    double glitchProbability = 0;
+    // Report the gap after each frame to the framer, like the UART RX timeout does
+    bool idleGaps = true;
+
+   protected:
+    bool write(const byte *frame) override;
+    void flushInput() override {}
+
+   private:
+    // Picks up responses queued since the last look
+    void schedule();
+
+    std::mt19937 rng{1};
+    FujiBusSimulator *bus = nullptr;
+    // Slot of the next response, and when it goes out with jitter added
+    uint64_t slotUs = UINT64_MAX;
+    uint64_t sendUs = UINT64_MAX;
+};
+
+// Scripted stand-in for a factory wired remote acting as secondary (address 33).
+// It only ever answers the unit's polls, reporting its room temperature.
+class FujiSimRemote : public FujiSimNode {
+   public:
+    void onFrame(FujiBusSimulator &bus, const byte *wire, uint64_t endUs) override;
+
+    byte address = static_cast<byte>(FujiAddress::SECONDARY);
+    byte roomTemperature = 23;
+    uint64_t replyDelayUs = 50000;
+};
+
+class FujiBusSimulator {
+   public:
+    FujiBusSimulator();
+    ~FujiBusSimulator();
+
+    void attach(FujiSimNode *node) { this->nodes.push_back(node); }
+    // Queues a frame (wire form) to start at startUs
+    void transmit(FujiSimNode *from, uint64_t startUs, const byte *wire);
+
+    // Advances virtual time to untilUs, delivering frames and wake-ups
+    void runUntil(uint64_t untilUs);
+    // Advances in steps, calling probe after each; stops early if probe returns true
+    bool runUntil(uint64_t untilUs, uint64_t stepUs, const std::function<bool(uint64_t)> &probe);
+
+    uint64_t now() const { return this->nowUs; }
+    // When runUntil() next has something to do (a frame or a wake-up), UINT64_MAX if never
+    uint64_t nextEventUs() const;
+
+    // Senders hear their own frames too, as on the real single-wire bus
+    bool echo = false;
+    // Chance a stray talker starts along with a frame and drives over it,
+    // garbling its address so nobody takes it for a frame of theirs
+    double noiseProbability = 0;
+
+    uint32_t framesDelivered = 0;
+    uint32_t collisions = 0;
+    // Observer for every frame that went over the wire (after collisions)
+    std::function<void(const byte *wire, uint64_t endUs)> onWire;
+
+   private:
+    struct Transmission {
+        FujiSimNode *from;
+        uint64_t startUs;
+        byte wire[kFrameSize];
+    };
+
+    std::vector<FujiSimNode *> nodes;
+    std::vector<Transmission> pending;
+    uint64_t nowUs = 0;
+    std::mt19937 rng{3};
+};
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -0,0 +1,70 @@
+// Loading bus captures on a host
+
+#include "FujiCaptureFile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace esphome {
+namespace fujitsu {
+
+static bool parseHex(const char *hex, byte *out, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned value;
+        if (sscanf(hex + 2 * i, "%2x", &value) != 1) {
+            return false;
+        }
+        out[i] = value;
+    }
+    return true;
+}
+
+bool fujiLoadCaptureFile(const char *path, byte &address, std::vector<FujiCaptureRecord> &records) {
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr) {
+        perror(path);
+        return false;
+    }
+    byte buf[kCaptureRecordSize];
+    if (fread(buf, 1, kCaptureHeaderSize, f) != kCaptureHeaderSize || !FujiCapture::decodeHeader(buf, address)) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        fclose(f);
+        return false;
+    }
+    while (fread(buf, 1, kCaptureRecordSize, f) == kCaptureRecordSize) {
+        FujiCaptureRecord rec;
+        FujiCapture::decodeRecord(buf, rec);
+        records.push_back(rec);
+    }
+    fclose(f);
+    return true;
+}
+
+bool fujiLoadCaptureLog(const char *path, byte &address, std::vector<FujiCaptureRecord> &records) {
+    FILE *f = fopen(path, "r");
+    if (f == nullptr) {
+        perror(path);
+        return false;
+    }
+    char line[512];
+    byte buf[kCaptureRecordSize];
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        const char *p;
+        if ((p = strstr(line, "FCAPH ")) != nullptr) {
+            if (parseHex(p + 6, buf, kCaptureHeaderSize)) {
+                FujiCapture::decodeHeader(buf, address);
+            }
+        } else if ((p = strstr(line, "FCAP ")) != nullptr) {
+            if (parseHex(p + 5, buf, kCaptureRecordSize)) {
+                FujiCaptureRecord rec;
+                FujiCapture::decodeRecord(buf, rec);
+                records.push_back(rec);
+            }
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+}  // namespace fujitsu
+}  // namespace esphome
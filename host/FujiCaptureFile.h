@@ -0,0 +1,18 @@
+// Loading bus captures on a host: binary capture files as written by
+// fuji_sim_run --capture, or ESPHome logs with the climate's log_capture lines.
+#pragma once
+
+#include <vector>
+
+#include "FujiCapture.h"
+
+namespace esphome {
+namespace fujitsu {
+
+// Appends the records of a binary capture; address comes from its header
+bool fujiLoadCaptureFile(const char *path, byte &address, std::vector<FujiCaptureRecord> &records);
+// Appends the FCAP records found in a log; address is only changed by an FCAPH header line
+bool fujiLoadCaptureLog(const char *path, byte &address, std::vector<FujiCaptureRecord> &records);
+
+}  // namespace fujitsu
+}  // namespace esphome
@@ -0,0 +1,248 @@
+// Host microbenchmark: the packed FujiFrame codec vs. the original unpacked
+// struct with its hand-written decodeFrame()/encodeFrame(). Reports ns/frame
+// for each direction and for a state snapshot through a FujiSeqLock, the size
+// of both representations, and checks that both codecs agree on every frame
+// in the pool.
+
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+
+#include "FujiFrame.h"
+#include "FujiSeqLock.h"
+
+using namespace esphome::fujitsu;
+
+namespace legacy {
+
+// Verbatim copy of the frame struct and codec before the descriptor table,
+// kept for comparison
+struct FujiFrame {
+    byte onOff = 0;
+    byte temperature = 16;
+    byte acMode = 0;
+    byte fanMode = 0;
+    byte acError = 0;
+    byte economyMode = 0;
+    byte swingMode = 0;
+    byte swingStep = 0;
+    byte controllerPresent = 0;
+    byte updateMagic = 0;
+    byte controllerTemp = 16;
+
+    bool writeBit = false;
+    bool loginBit = false;
+    bool errorBit = false;
+    bool unknownBit = false;
+
+    byte messageType = 0;
+    byte messageSource = 0;
+    byte messageDest = 0;
+};
+
+const byte kModeIndex = 3;
+const byte kModeMask = 0b00001110;
+const byte kModeOffset = 1;
+const byte kFanIndex = 3;
+const byte kFanMask = 0b01110000;
+const byte kFanOffset = 4;
+const byte kEnabledIndex = 3;
+const byte kEnabledMask = 0b00000001;
+const byte kEnabledOffset = 0;
+const byte kErrorIndex = 3;
+const byte kErrorMask = 0b10000000;
+const byte kErrorOffset = 7;
+const byte kEconomyIndex = 4;
+const byte kEconomyMask = 0b10000000;
+const byte kEconomyOffset = 7;
+const byte kTemperatureIndex = 4;
+const byte kTemperatureMask = 0b01111111;
+const byte kTemperatureOffset = 0;
+const byte kUpdateMagicIndex = 5;
+const byte kUpdateMagicMask = 0b11110000;
+const byte kUpdateMagicOffset = 4;
+const byte kSwingIndex = 5;
+const byte kSwingMask = 0b00000100;
+const byte kSwingOffset = 2;
+const byte kSwingStepIndex = 5;
+const byte kSwingStepMask = 0b00000010;
+const byte kSwingStepOffset = 1;
+const byte kControllerPresentIndex = 6;
+const byte kControllerPresentMask = 0b00000001;
+const byte kControllerPresentOffset = 0;
+const byte kControllerTempIndex = 6;
+const byte kControllerTempMask = 0b00111110;
+const byte kControllerTempOffset = 1;
+
+FujiFrame decodeFrame(const byte *readBuf, byte controllerAddress) {
+    FujiFrame ff;
+
+    ff.messageSource = readBuf[0] & 0b01111111;
+    if (readBuf[0] & 0b10000000) {
+        ff.messageDest = controllerAddress;
+    } else {
+        ff.messageDest = readBuf[1] & 0b01111111;
+    }
+    ff.messageType = (readBuf[2] & 0b00110000) >> 4;
+
+    ff.acError = (readBuf[kErrorIndex] & kErrorMask) >> kErrorOffset;
+    ff.temperature = (readBuf[kTemperatureIndex] & kTemperatureMask) >> kTemperatureOffset;
+    ff.acMode = (readBuf[kModeIndex] & kModeMask) >> kModeOffset;
+    ff.fanMode = (readBuf[kFanIndex] & kFanMask) >> kFanOffset;
+    ff.economyMode = (readBuf[kEconomyIndex] & kEconomyMask) >> kEconomyOffset;
+    ff.swingMode = (readBuf[kSwingIndex] & kSwingMask) >> kSwingOffset;
+    ff.swingStep = (readBuf[kSwingStepIndex] & kSwingStepMask) >> kSwingStepOffset;
+    ff.controllerPresent =
+        (readBuf[kControllerPresentIndex] & kControllerPresentMask) >> kControllerPresentOffset;
+    ff.updateMagic = (readBuf[kUpdateMagicIndex] & kUpdateMagicMask) >> kUpdateMagicOffset;
+    ff.onOff = (readBuf[kEnabledIndex] & kEnabledMask) >> kEnabledOffset;
+    ff.controllerTemp = (readBuf[kControllerTempIndex] & kControllerTempMask) >> kControllerTempOffset;
+
+    ff.writeBit = (readBuf[2] & 0b00001000) != 0;
+    ff.loginBit = (readBuf[1] & 0b00100000) != 0;
+    ff.unknownBit = (readBuf[1] & 0b10000000) > 0;
+
+    return ff;
+}
+
+void encodeFrame(FujiFrame ff, byte *writeBuf) {
+    memset(writeBuf, 0, kFrameSize);
+
+    writeBuf[0] = ff.messageSource;
+
+    writeBuf[1] &= 0b10000000;
+    writeBuf[1] |= ff.messageDest & 0b01111111;
+
+    writeBuf[2] &= 0b11001111;
+    writeBuf[2] |= ff.messageType << 4;
+
+    if (ff.writeBit) {
+        writeBuf[2] |= 0b00001000;
+    } else {
+        writeBuf[2] &= 0b11110111;
+    }
+
+    writeBuf[1] &= 0b01111111;
+    if (ff.unknownBit) {
+        writeBuf[1] |= 0b10000000;
+    }
+
+    if (ff.loginBit) {
+        writeBuf[1] |= 0b00100000;
+    } else {
+        writeBuf[1] &= 0b11011111;
+    }
+
+    writeBuf[kModeIndex] = (writeBuf[kModeIndex] & ~kModeMask) | (ff.acMode << kModeOffset);
+    writeBuf[kModeIndex] = (writeBuf[kEnabledIndex] & ~kEnabledMask) | (ff.onOff << kEnabledOffset);
+    writeBuf[kFanIndex] = (writeBuf[kFanIndex] & ~kFanMask) | (ff.fanMode << kFanOffset);
+    writeBuf[kErrorIndex] = (writeBuf[kErrorIndex] & ~kErrorMask) | (ff.acError << kErrorOffset);
+    writeBuf[kEconomyIndex] = (writeBuf[kEconomyIndex] & ~kEconomyMask) | (ff.economyMode << kEconomyOffset);
+    writeBuf[kTemperatureIndex] =
+        (writeBuf[kTemperatureIndex] & ~kTemperatureMask) | (ff.temperature << kTemperatureOffset);
+    writeBuf[kSwingIndex] = (writeBuf[kSwingIndex] & ~kSwingMask) | (ff.swingMode << kSwingOffset);
+    writeBuf[kSwingStepIndex] = (writeBuf[kSwingStepIndex] & ~kSwingStepMask) | (ff.swingStep << kSwingStepOffset);
+    writeBuf[kControllerPresentIndex] = (writeBuf[kControllerPresentIndex] & ~kControllerPresentMask) |
+                                        (ff.controllerPresent << kControllerPresentOffset);
+    writeBuf[kUpdateMagicIndex] =
+        (writeBuf[kUpdateMagicIndex] & ~kUpdateMagicMask) | (ff.updateMagic << kUpdateMagicOffset);
+    writeBuf[kControllerTempIndex] =
+        (writeBuf[kControllerTempIndex] & ~kControllerTempMask) | (ff.controllerTemp << kControllerTempOffset);
+}
+
+}  // namespace legacy
+
+static const size_t kPoolSize = 4096;
+static const size_t kIterations = 20000000;
+
+static bool sameFields(const FujiFrame &a, const legacy::FujiFrame &b) {
+    return a.onOff() == b.onOff && a.temperature() == b.temperature && a.acMode() == b.acMode &&
+           a.fanMode() == b.fanMode && a.acError() == b.acError && a.economyMode() == b.economyMode &&
+           a.swingMode() == b.swingMode && a.swingStep() == b.swingStep &&
+           a.controllerPresent() == b.controllerPresent && a.updateMagic() == b.updateMagic &&
+           a.controllerTemp() == b.controllerTemp && a.writeBit() == b.writeBit && a.loginBit() == b.loginBit &&
+           a.unknownBit() == b.unknownBit && a.messageType() == b.messageType &&
+           a.messageSource() == b.messageSource && a.messageDest() == b.messageDest;
+}
+
+template <typename F>
+static double nsPerFrame(F body) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kIterations; i++) {
+        body(i % kPoolSize);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / kIterations;
+}
+
+int main() {
+    static byte frames[kPoolSize][kFrameSize];
+    static FujiFrame decoded[kPoolSize];
+    static legacy::FujiFrame legacyDecoded[kPoolSize];
+    std::mt19937 rng(1234);
+    for (auto &frame : frames) {
+        for (auto &b : frame) {
+            b = rng();
+        }
+    }
+
+    // Both codecs must agree before timing means anything. The legacy encoder
+    // zeroes the bits it doesn't model, ours carries them over.
+    for (size_t i = 0; i < kPoolSize; i++) {
+        FujiFrame ours;
+        fujiDecodeFrame(frames[i], 32, ours);
+        legacy::FujiFrame theirs = legacy::decodeFrame(frames[i], 32);
+        byte ourBuf[kFrameSize], theirBuf[kFrameSize];
+        fujiEncodeFrame(ours, ourBuf);
+        legacy::encodeFrame(theirs, theirBuf);
+        bool same = sameFields(ours, theirs);
+        for (size_t b = 0; b < kFrameSize; b++) {
+            same = same && (ourBuf[b] & FujiModelledFields::masks[b]) == theirBuf[b];
+        }
+        if (!same) {
+            fprintf(stderr, "codec mismatch on frame %zu\n", i);
+            return 1;
+        }
+        decoded[i] = ours;
+        legacyDecoded[i] = theirs;
+    }
+
+    volatile byte sink = 0;
+    double legacyDecode = nsPerFrame([&](size_t i) { sink = sink + legacy::decodeFrame(frames[i], 32).temperature; });
+    double tableDecode = nsPerFrame([&](size_t i) {
+        FujiFrame ff;
+        fujiDecodeFrame(frames[i], 32, ff);
+        sink = sink + ff.temperature();
+    });
+    double legacyEncode = nsPerFrame([&](size_t i) {
+        byte buf[kFrameSize];
+        legacy::encodeFrame(legacyDecoded[i], buf);
+        sink = sink + buf[4];
+    });
+    double tableEncode = nsPerFrame([&](size_t i) {
+        byte buf[kFrameSize];
+        fujiEncodeFrame(decoded[i], buf);
+        sink = sink + buf[4];
+    });
+
+    // What the UART task pays to publish a state and the climate to take it
+    static FujiSeqLock<legacy::FujiFrame> legacySnapshot;
+    static FujiSeqLock<FujiFrame> packedSnapshot;
+    double legacyCopy = nsPerFrame([&](size_t i) {
+        legacySnapshot.write(legacyDecoded[i]);
+        sink = sink + legacySnapshot.read().temperature;
+    });
+    double packedCopy = nsPerFrame([&](size_t i) {
+        packedSnapshot.write(decoded[i]);
+        sink = sink + packedSnapshot.read().temperature();
+    });
+
+    printf("%-8s %12s %12s\n", "", "legacy", "packed");
+    printf("%-8s %9.2f ns %9.2f ns\n", "decode", legacyDecode, tableDecode);
+    printf("%-8s %9.2f ns %9.2f ns\n", "encode", legacyEncode, tableEncode);
+    printf("%-8s %9.2f ns %9.2f ns\n", "snapshot", legacyCopy, packedCopy);
+    printf("%-8s %10zu B %10zu B\n", "frame", sizeof(legacy::FujiFrame), sizeof(FujiFrame));
+    printf("%-8s %10zu B %10zu B\n", "seqlock", sizeof(legacySnapshot), sizeof(packedSnapshot));
+    return 0;
+}
@@ -0,0 +1,130 @@
+// Cost of running several heat pumps from one service thread, as the shared
+// UART task does on the ESP32. Each unit gets its own simulated bus; all of
+// them are stepped in lockstep from a single thread whose stack is painted
+// beforehand so the high-water mark can be read back afterwards.
+//
+//   fuji_bench_units [--units N] [--seconds S]
+//
+// Reports thread CPU per unit per simulated second, the deepest stack use and
+// the per-unit object sizes.
+
+#include <memory>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include "FujiBusSimulator.h"
+
+using namespace esphome::fujitsu;
+
+static const size_t kStackSize = 256 * 1024;
+static const byte kStackPaint = 0xA5;
+static const uint64_t kStepUs = 10000;
+
+struct Unit {
+    FujiBusSimulator bus;
+    FujiSimIndoorUnit indoor;
+    FujiHeatPump heatPump;
+    FujiSimController node{heatPump};
+};
+
+struct Bench {
+    int units = 1;
+    int seconds = 60;
+    uint64_t cpuNs = 0;
+    uint32_t frames = 0;
+    uint32_t sent = 0;
+    int bound = 0;
+};
+
+static uint64_t threadCpuNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *service(void *arg) {
+    Bench &bench = *static_cast<Bench *>(arg);
+    std::vector<std::unique_ptr<Unit>> units;
+    for (int i = 0; i < bench.units; i++) {
+        units.emplace_back(new Unit());
+        Unit &u = *units.back();
+        u.heatPump.begin(false);
+        u.heatPump.capture.enabled = false;
+        u.bus.attach(&u.indoor);
+        u.bus.attach(&u.node);
+    }
+
+    uint64_t startNs = threadCpuNs();
+    uint64_t endUs = (uint64_t) bench.seconds * 1000000;
+    int step = 0;
+    for (uint64_t t = kStepUs; t <= endUs; t += kStepUs, step++) {
+        for (auto &u : units) {
+            u->bus.runUntil(t);
+        }
+        // Poke a setting now and then so the write path is exercised too
+        if (step % 500 == 250) {
+            for (auto &u : units) {
+                FujiFrame ff = u->heatPump.getCurrentState();
+                ff.setTemperature(ff.temperature() == 22 ? 23 : 22);
+                u->heatPump.setState(&ff, kTempUpdateMask);
+            }
+        }
+    }
+    bench.cpuNs = threadCpuNs() - startNs;
+
+    for (auto &u : units) {
+        bench.frames += u->heatPump.health.get(FujiBusCounter::FRAMES_RECEIVED);
+        bench.sent += u->heatPump.health.get(FujiBusCounter::FRAMES_SENT);
+        bench.bound += u->heatPump.isBound();
+    }
+    return nullptr;
+}
+
+int main(int argc, char **argv) {
+    Bench bench;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--units") && i + 1 < argc) {
+            bench.units = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+            bench.seconds = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--units N] [--seconds S]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (bench.units < 1 || bench.seconds < 1) {
+        fprintf(stderr, "--units and --seconds must be positive\n");
+        return 2;
+    }
+
+    // Paint the whole stack, run, then find the lowest byte that changed
+    std::vector<byte> stack(kStackSize, kStackPaint);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack.data(), stack.size());
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, service, &bench) != 0) {
+        perror("pthread_create");
+        return 1;
+    }
+    pthread_join(thread, nullptr);
+    pthread_attr_destroy(&attr);
+
+    size_t untouched = 0;
+    while (untouched < stack.size() && stack[untouched] == kStackPaint) {
+        untouched++;
+    }
+
+    double perUnitSecondUs = bench.cpuNs / 1000.0 / bench.units / bench.seconds;
+    printf("%d units, %d simulated s, %d bound\n", bench.units, bench.seconds, bench.bound);
+    printf("frames: %u received, %u sent\n", bench.frames, bench.sent);
+    printf("cpu: %.1f us per unit per second (%.4f%% of one core)\n", perUnitSecondUs, perUnitSecondUs / 1e4);
+    printf("stack: %zu bytes high-water on the service thread\n", stack.size() - untouched);
+    printf("sizeof: FujiHeatPump %zu, FujiTrace %zu, FujiCapture %zu, FujiCommandLatency %zu\n",
+           sizeof(FujiHeatPump), sizeof(FujiTrace), sizeof(FujiCapture), sizeof(FujiCommandLatency));
+    return bench.bound == bench.units ? 0 : 1;
+}
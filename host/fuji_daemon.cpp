@@ -0,0 +1,241 @@
+// Runs the controller on a real line from Linux: as a gateway on a Pi-class
+// box with a USB-RS485 adapter, or as a test peer for fuji_sim_pty over a
+// pty. The serial service thread owns the line; this thread plays the part
+// of the climate's loop(), printing the state whenever it changes and taking
+// commands on stdin (it prints loop timing and bus totals at exit):
+//
+//   on | off | temp N | mode auto|cool|dry|fan|heat | fan auto|quiet|low|medium|high | eco 0|1 | swing 0|1 | status
+//
+//   fuji_daemon (--device PATH | --pty) [--secondary] [--listen] [--capture FILE] [--duration S] [--verbose]
+
+#include <algorithm>
+#include <atomic>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+
+#include "FujiHeatPump.h"
+#include "FujiSerial.h"
+
+using namespace esphome::fujitsu;
+
+// How often the loop looks at the published state, like ESPHome's loop()
+static const int kLoopMs = 16;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) { stopRequested = 1; }
+
+static int lookup(const char *name, const char *const *names, int count) {
+    for (int i = 0; i < count; i++) {
+        if (!strcasecmp(name, names[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static const char *const kModeNames[] = {"unknown", "fan", "dry", "cool", "heat", "auto"};
+static const char *const kFanNames[] = {"auto", "quiet", "low", "medium", "high"};
+
+static void printState(uint64_t nowUs, FujiLinkState link, const FujiFrame &s) {
+    printf("%10.3f s  %-17s  power %-3s mode %-7s set %2d  fan %-6s eco %d swing %d step %d  room %2d  error %d\n",
+           nowUs / 1e6, FujiLink::name(link), s.onOff() ? "on" : "off", kModeNames[s.acMode() % 6], s.temperature(),
+           kFanNames[s.fanMode() % 5], s.economyMode(), s.swingMode(), s.swingStep(), s.controllerTemp(), s.acError());
+    fflush(stdout);
+}
+
+// One stdin line into a setState(); false if it isn't a command
+static bool command(FujiHeatPump &hp, char *line) {
+    char *verb = strtok(line, " \t\r\n");
+    char *arg = strtok(nullptr, " \t\r\n");
+    if (verb == nullptr) {
+        return true;
+    }
+    FujiFrame desired = hp.getCurrentState();
+    byte mask;
+    if (!strcmp(verb, "on") || !strcmp(verb, "off")) {
+        mask = kOnOffUpdateMask;
+        desired.setOnOff(!strcmp(verb, "on"));
+    } else if (!strcmp(verb, "temp") && arg != nullptr) {
+        mask = kTempUpdateMask;
+        desired.setTemperature(atoi(arg));
+    } else if (!strcmp(verb, "mode") && arg != nullptr && lookup(arg, kModeNames, 6) > 0) {
+        mask = kModeUpdateMask;
+        desired.setAcMode(lookup(arg, kModeNames, 6));
+    } else if (!strcmp(verb, "fan") && arg != nullptr && lookup(arg, kFanNames, 5) >= 0) {
+        mask = kFanModeUpdateMask;
+        desired.setFanMode(lookup(arg, kFanNames, 5));
+    } else if (!strcmp(verb, "eco") && arg != nullptr) {
+        mask = kEconomyModeUpdateMask;
+        desired.setEconomyMode(atoi(arg) != 0);
+    } else if (!strcmp(verb, "swing") && arg != nullptr) {
+        mask = kSwingModeUpdateMask;
+        desired.setSwingMode(atoi(arg) != 0);
+    } else if (!strcmp(verb, "status")) {
+        printState(fujiMicros(), hp.link.getStats().state, hp.getCurrentState());
+        return true;
+    } else {
+        return false;
+    }
+    hp.setState(&desired, mask);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const char *device = nullptr;
+    bool pty = false;
+    bool secondary = false;
+    bool listen = false;
+    const char *capturePath = nullptr;
+    double durationS = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--device") && i + 1 < argc) {
+            device = argv[++i];
+        } else if (!strcmp(argv[i], "--pty")) {
+            pty = true;
+        } else if (!strcmp(argv[i], "--secondary")) {
+            secondary = true;
+        } else if (!strcmp(argv[i], "--listen")) {
+            listen = true;
+        } else if (!strcmp(argv[i], "--capture") && i + 1 < argc) {
+            capturePath = argv[++i];
+        } else if (!strcmp(argv[i], "--duration") && i + 1 < argc) {
+            durationS = strtod(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--verbose")) {
+            fujiHostLogLevel = FUJI_LOG_DEBUG;
+        } else {
+            device = nullptr;
+            pty = false;
+            break;
+        }
+    }
+    if ((device == nullptr) == !pty) {
+        fprintf(stderr,
+                "usage: %s (--device PATH | --pty) [--secondary] [--listen] [--capture FILE] [--duration S] "
+                "[--verbose]\n",
+                argv[0]);
+        return 2;
+    }
+
+    FujiHeatPump hp;
+    hp.listenOnly = listen;
+    hp.begin(secondary);
+    FujiSerialTransport line(&hp);
+    char peer[64];
+    if (pty) {
+        if (!line.openPty(peer, sizeof(peer))) {
+            return 1;
+        }
+        printf("pty %s\n", peer);
+        fflush(stdout);
+    } else if (!line.open(device)) {
+        return 1;
+    }
+    FujiSerialService service;
+    if (!service.attach(&line)) {
+        return 1;
+    }
+
+    FILE *captureFile = nullptr;
+    FujiRingCursor captureCursor;
+    if (capturePath != nullptr) {
+        captureFile = fopen(capturePath, "wb");
+        if (captureFile == nullptr) {
+            perror(capturePath);
+            return 1;
+        }
+        byte header[kCaptureHeaderSize];
+        FujiCapture::encodeHeader(hp.getControllerAddress(), header);
+        fwrite(header, 1, sizeof(header), captureFile);
+    } else {
+        hp.capture.enabled = false;
+    }
+
+    struct sigaction sa = {};
+    sa.sa_handler = onSignal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    std::atomic<bool> lost{false};
+    std::thread serviceThread([&] { lost = !service.run(); });
+
+    uint64_t endUs = durationS > 0 ? fujiMicros() + (uint64_t)(durationS * 1e6) : UINT64_MAX;
+    bool haveStdin = true;
+    uint32_t stateVersion = 0;
+    uint32_t faultsVersion = 0;
+    FujiLinkState link = FujiLinkState::COUNT;
+    char input[128];
+    uint32_t loopPasses = 0;
+    uint64_t loopTotalUs = 0;
+    uint64_t loopMaxUs = 0;
+    while (!stopRequested && !lost && fujiMicros() < endUs) {
+        pollfd in = {STDIN_FILENO, POLLIN, 0};
+        if (haveStdin && poll(&in, 1, kLoopMs) > 0) {
+            if (fgets(input, sizeof(input), stdin) == nullptr) {
+                // Without a terminal (e.g. under systemd) just keep serving
+                haveStdin = false;
+            } else if (!command(hp, input)) {
+                fprintf(stderr, "unknown command\n");
+            }
+        } else if (!haveStdin) {
+            usleep(kLoopMs * 1000);
+        }
+        // Timed like the climate's loop(): everything but the wait between passes
+        uint64_t passStartUs = fujiMicros();
+
+        FujiLinkState nowLink = hp.link.getStats().state;
+        if (hp.getStateVersion() != stateVersion || nowLink != link) {
+            stateVersion = hp.getStateVersion();
+            link = nowLink;
+            printState(fujiMicros(), link, hp.getPublishedState());
+        }
+        if (hp.faults.version() != faultsVersion) {
+            faultsVersion = hp.faults.version();
+            char faults[128];
+            FujiFaults::format(hp.faults.read(), faults, sizeof(faults));
+            printf("%10.3f s  faults: %s\n", fujiMicros() / 1e6, faults);
+            fflush(stdout);
+        }
+        FujiCaptureRecord rec;
+        byte buf[kCaptureRecordSize];
+        while (captureFile != nullptr && hp.capture.read(captureCursor, rec)) {
+            FujiCapture::encodeRecord(rec, buf);
+            fwrite(buf, 1, sizeof(buf), captureFile);
+        }
+        uint64_t passUs = fujiMicros() - passStartUs;
+        loopPasses++;
+        loopTotalUs += passUs;
+        loopMaxUs = std::max(loopMaxUs, passUs);
+    }
+    service.stop();
+    serviceThread.join();
+    if (captureFile != nullptr) {
+        fclose(captureFile);
+    }
+
+    printf("loop: %u passes, mean %u us, max %u us\n", (unsigned) loopPasses,
+           (unsigned) (loopPasses ? loopTotalUs / loopPasses : 0), (unsigned) loopMaxUs);
+    const FujiSlotStats &slots = hp.txScheduler.getStats();
+    printf("%s: %u frames received, %u sent, reply slots %u missed, error min %d max %d mean |%u| us\n", line.name(),
+           hp.health.get(FujiBusCounter::FRAMES_RECEIVED), hp.health.get(FujiBusCounter::FRAMES_SENT),
+           (unsigned) slots.missed, (int) slots.minErrorUs, (int) slots.maxErrorUs, (unsigned) slots.meanAbsErrorUs());
+    const FujiRxDelayStats &rx = hp.txScheduler.getRxDelayStats();
+    printf("rx delay: read() to handling mean %u max %u us, %u of %u frames too late for their slot\n",
+           (unsigned) rx.meanUs(), (unsigned) rx.maxUs, rx.late, rx.frames);
+    const FujiResponseStats &responses = hp.responses.getStats();
+    printf("responses: %u queued, %u superseded, %u dropped, peak depth %u\n", responses.queued,
+           responses.superseded, responses.dropped, (unsigned) hp.responses.takePeakDepth());
+    const FujiEchoStats &echo = hp.echo.getStats();
+    if (hp.echo.lineEchoes()) {
+        printf("echo: %u verified, %u collisions, %u bit errors, %u missing; %u retransmits\n", echo.verified,
+               echo.collisions, echo.bitErrors, echo.missing, hp.health.get(FujiBusCounter::RETRANSMITS));
+    } else {
+        printf("echo: the line does not echo, %u frames unchecked\n", echo.unchecked);
+    }
+    return lost ? 1 : 0;
+}
@@ -0,0 +1,275 @@
+// Replays a bus capture through the framer and protocol core and prints the
+// resulting state timeline. Responses the core produces are checked against
+// the ones captured on the device, so a clean replay ends with no mismatches.
+// With --listen the core runs listen-only instead: every frame on the wire,
+// the device's own included, goes into the sniffer, whose per-address table
+// is printed at the end.
+//
+//   fuji_replay [--log] [--secondary] [--quiet] [--no-cache] [--listen] CAPTURE
+//
+// CAPTURE is a binary capture file, or with --log an ESPHome log containing
+// the climate's log_capture lines ("FCAPH <hex>" header, "FCAP <hex>" records).
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "FujiCaptureFile.h"
+#include "FujiHeatPump.h"
+
+using namespace esphome::fujitsu;
+
+static uint64_t replayNowUs = 0;
+
+static uint64_t replayClock() { return replayNowUs; }
+
+static const char *modeName(byte mode) {
+    static const char *const names[] = {"UNKNOWN", "FAN", "DRY", "COOL", "HEAT", "AUTO"};
+    return mode < sizeof(names) / sizeof(names[0]) ? names[mode] : "?";
+}
+
+static const char *fanName(byte fan) {
+    static const char *const names[] = {"AUTO", "QUIET", "LOW", "MEDIUM", "HIGH"};
+    return fan < sizeof(names) / sizeof(names[0]) ? names[fan] : "?";
+}
+
+struct Replay {
+    FujiHeatPump heatPump;
+    bool quiet = false;
+    uint64_t startUs = 0;
+
+    bool held = false;
+    byte heldFrame[kFrameSize];
+    uint64_t heldEndUs = 0;
+    std::deque<FujiRawFrame> produced;
+
+    uint32_t frames = 0;
+    uint32_t uartEvents = 0;
+    uint32_t matched = 0;
+    uint32_t mismatched = 0;
+    uint32_t missing = 0;
+    uint32_t timelineEntries = 0;
+    double handleNs = 0;
+
+    bool haveState = false;
+    FujiFrame lastState;
+    FujiLinkState lastLink = FujiLinkState::UNBOUND;
+
+    void timeline(uint64_t nowUs) {
+        FujiFrame s = heatPump.getCurrentState();
+        FujiLinkState link = heatPump.link.state();
+        if (haveState && link == lastLink && fujiSameState(s, lastState)) {
+            return;
+        }
+        haveState = true;
+        lastState = s;
+        lastLink = link;
+        timelineEntries++;
+        if (!quiet) {
+            printf("%10.3f s  %-17s  power %-3s mode %-7s set %2d  fan %-6s eco %d swing %d step %d  room %2d  "
+                   "error %d\n",
+                   (nowUs - startUs) / 1e6, FujiLink::name(link), s.onOff() ? "on" : "off", modeName(s.acMode()), s.temperature(),
+                   fanName(s.fanMode()), s.economyMode(), s.swingMode(), s.swingStep(), s.controllerTemp(), s.acError());
+        }
+    }
+
+    void handleHeld() {
+        if (!held) {
+            return;
+        }
+        held = false;
+        frames++;
+        replayNowUs = heldEndUs;
+        heatPump.txScheduler.frameEnded(heldEndUs);
+        auto start = std::chrono::steady_clock::now();
+        heatPump.handleFrame(heldFrame);
+        handleNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        FujiRawFrame response;
+        while (heatPump.nextResponse(response.data)) {
+            produced.push_back(response);
+        }
+        timeline(heldEndUs);
+    }
+
+    void compareTx(const FujiCaptureRecord &rec, uint64_t nowUs) {
+        if (produced.empty()) {
+            missing++;
+            if (!quiet) {
+                printf("%10.3f s  device sent a response the replay did not produce\n", (nowUs - startUs) / 1e6);
+            }
+            return;
+        }
+        FujiRawFrame ours = produced.front();
+        produced.pop_front();
+        if (memcmp(ours.data, rec.data, kFrameSize) == 0) {
+            matched++;
+            return;
+        }
+        mismatched++;
+        if (!quiet) {
+            const byte *a = rec.data;
+            const byte *b = ours.data;
+            printf("%10.3f s  response differs: device %02X %02X %02X %02X %02X %02X %02X %02X, "
+                   "replay %02X %02X %02X %02X %02X %02X %02X %02X\n",
+                   (nowUs - startUs) / 1e6, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], b[0], b[1], b[2],
+                   b[3], b[4], b[5], b[6], b[7]);
+        }
+    }
+
+    void run(const std::vector<FujiCaptureRecord> &records) {
+        uint64_t nowUs = 0;
+        uint32_t lastLow = 0;
+        for (size_t r = 0; r < records.size(); r++) {
+            const FujiCaptureRecord &rec = records[r];
+            // Timestamps are the low 32 bits of the device clock; unwrap them. They
+            // are not strictly ordered (a reply is stamped with its slot, ahead of
+            // the idle that follows it), so steps are signed.
+            if (r == 0) {
+                nowUs = startUs = rec.timeUs;
+            } else {
+                nowUs += (int32_t)(rec.timeUs - lastLow);
+            }
+            lastLow = rec.timeUs;
+            replayNowUs = std::max(replayNowUs, nowUs);
+
+            // The pending writes for a frame are recorded right after its bytes
+            if (rec.kind == FujiCaptureKind::PENDING) {
+                heatPump.setPending(rec.arg, rec.data);
+                continue;
+            }
+            handleHeld();
+
+            switch (rec.kind) {
+                case FujiCaptureKind::RX: {
+                    byte frame[kFrameSize];
+                    for (size_t i = 0; i < rec.arg && i < kFrameSize; i++) {
+                        uint64_t byteEndUs = nowUs - (rec.arg - 1 - i) * kFujiByteTimeUs;
+                        // The device's echo check took its own bytes out too
+                        if (heatPump.echo.push(rec.data[i], byteEndUs)) {
+                            continue;
+                        }
+                        if (heatPump.framer.push(rec.data[i], frame)) {
+                            handleHeld();
+                            heatPump.echoChecked();
+                            held = true;
+                            memcpy(heldFrame, frame, kFrameSize);
+                            heldEndUs = byteEndUs;
+                        }
+                    }
+                    heatPump.echoChecked();
+                    break;
+                }
+                case FujiCaptureKind::TX:
+                    heatPump.echo.sent(rec.data, nowUs);
+                    if (heatPump.listenOnly) {
+                        // Stamped with its start, heard when it ends
+                        replayNowUs = std::max(replayNowUs, nowUs + kFujiFrameTimeUs);
+                        heatPump.handleFrame(rec.data);
+                        timeline(replayNowUs);
+                        break;
+                    }
+                    heatPump.txScheduler.sent(nowUs);
+                    compareTx(rec, nowUs);
+                    break;
+                case FujiCaptureKind::IDLE:
+                    heatPump.framer.idle();
+                    heatPump.echo.expire(nowUs);
+                    heatPump.echoChecked();
+                    break;
+                case FujiCaptureKind::UART_EVENT:
+                    uartEvents++;
+                    if (!quiet) {
+                        printf("%10.3f s  uart event %d\n", (nowUs - startUs) / 1e6, rec.arg);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        handleHeld();
+    }
+};
+
+int main(int argc, char **argv) {
+    bool fromLog = false;
+    bool secondary = false;
+    bool quiet = false;
+    bool cache = true;
+    bool listen = false;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--log")) {
+            fromLog = true;
+        } else if (!strcmp(argv[i], "--secondary")) {
+            secondary = true;
+        } else if (!strcmp(argv[i], "--quiet")) {
+            quiet = true;
+        } else if (!strcmp(argv[i], "--no-cache")) {
+            cache = false;
+        } else if (!strcmp(argv[i], "--listen")) {
+            listen = true;
+        } else if (argv[i][0] != '-' && path == nullptr) {
+            path = argv[i];
+        } else {
+            path = nullptr;
+            break;
+        }
+    }
+    if (path == nullptr) {
+        fprintf(stderr, "usage: %s [--log] [--secondary] [--quiet] [--no-cache] [--listen] CAPTURE\n", argv[0]);
+        return 2;
+    }
+
+    // Logs may start mid-session without a header; --secondary covers that case
+    byte address = static_cast<byte>(secondary ? FujiAddress::SECONDARY : FujiAddress::PRIMARY);
+    std::vector<FujiCaptureRecord> records;
+    if (!(fromLog ? fujiLoadCaptureLog(path, address, records) : fujiLoadCaptureFile(path, address, records))) {
+        return 1;
+    }
+
+    fujiSetHostClock(replayClock);
+    Replay replay;
+    replay.quiet = quiet;
+    replay.heatPump.begin(address == static_cast<byte>(FujiAddress::SECONDARY));
+    replay.heatPump.capture.enabled = false;
+    replay.heatPump.useFrameCache = cache;
+    replay.heatPump.listenOnly = listen;
+    replay.run(records);
+    fujiSetHostClock(nullptr);
+
+    const FujiFramerStats &framing = replay.heatPump.framer.getStats();
+    printf("\n%zu records, %u frames, %u uart events, %u state changes\n", records.size(), replay.frames,
+           replay.uartEvents, replay.timelineEntries);
+    printf("framer: %u frames, %u bytes dropped, %u frames dropped\n", framing.frames, framing.bytesDropped,
+           framing.framesDropped);
+    const FujiEchoStats &echo = replay.heatPump.echo.getStats();
+    if (replay.heatPump.echo.lineEchoes() || echo.collisions || echo.bitErrors) {
+        printf("echo: %u verified, %u collisions, %u bit errors, %u missing; %u retransmits\n", echo.verified,
+               echo.collisions, echo.bitErrors, echo.missing,
+               replay.heatPump.health.get(FujiBusCounter::RETRANSMITS));
+    }
+    if (listen) {
+        char line[256];
+        for (size_t i = 0; i < FujiSniffer::kMaxStations; i++) {
+            FujiSnifferStation station = replay.heatPump.sniffer.read(i);
+            if (station.frames != 0) {
+                FujiSniffer::format(station, line, sizeof(line));
+                printf("  %s\n", line);
+            }
+        }
+        printf("sniffer: %u frames from addresses beyond the table, handleFrame() %.0f ns mean\n",
+               replay.heatPump.sniffer.dropped(), replay.frames ? replay.handleNs / replay.frames : 0.0);
+        return 0;
+    }
+    uint32_t hits = replay.heatPump.health.get(FujiBusCounter::FRAME_CACHE_HITS);
+    printf("frame cache: %u hits of %u frames (%.1f%%), handleFrame() %.0f ns mean\n", hits, replay.frames,
+           replay.frames ? 100.0 * hits / replay.frames : 0.0, replay.frames ? replay.handleNs / replay.frames : 0.0);
+    printf("responses: %u match, %u differ, %u only on device, %zu only in replay\n", replay.matched,
+           replay.mismatched, replay.missing, replay.produced.size());
+    return replay.mismatched || replay.missing || !replay.produced.empty() ? 1 : 0;
+}
@@ -0,0 +1,319 @@
+// Closed-loop run of our controller against the simulated indoor unit, with an
+// optional scripted secondary remote at address 33.
+// Reports handshake time, bound/unbound transitions around a unit power cycle
+// and how long a setState() takes to land, all in virtual time. Then a burst
+// of random commands fills the same latency histograms the climate publishes.
+// The unit then raises a fault and clears it again. With a secondary, the
+// remote finally drops off the bus and the controller has to notice.
+// A listen-only controller sits on the bus throughout and reports what it heard.
+//
+//   fuji_sim_run [--secondary] [--reply-delay-ms N] [--reply-jitter-us N] [--glitch-rate P] [--drop-writes P] [--echo] [--collision-rate P] [--no-idle-gaps] [--verbose] [--trace] [--capture FILE] [--commands N]
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FujiBusSimulator.h"
+
+using namespace esphome::fujitsu;
+
+static const uint64_t kStepUs = 10000;
+static const uint64_t kGiveUpUs = 60ULL * 1000000;
+
+static void reportLatency(const char *what, const FujiHistogram &h) {
+    printf("  %-26s %6.0f %6.0f %6.0f ms  (%u)\n", what, h.percentileUs(0.5f) / 1000.0,
+           h.percentileUs(0.95f) / 1000.0, h.maxUs() / 1000.0, h.count());
+}
+
+static void report(const char *what, bool ok, uint64_t fromUs, uint64_t toUs) {
+    if (ok) {
+        printf("%-32s %8.0f ms\n", what, (toUs - fromUs) / 1000.0);
+    } else {
+        printf("%-32s   (none within %llu s)\n", what, (unsigned long long)(kGiveUpUs / 1000000));
+    }
+}
+
+int main(int argc, char **argv) {
+    bool withSecondary = false;
+    uint64_t replyDelayUs = 50000;
+    uint32_t replyJitterUs = 0;
+    double glitchRate = 0;
+    bool echo = false;
+    double collisionRate = 0;
+    double dropWrites = 0;
+    bool idleGaps = true;
+    bool trace = false;
+    const char *capturePath = nullptr;
+    int commands = 20;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--secondary")) {
+            withSecondary = true;
+        } else if (!strcmp(argv[i], "--reply-delay-ms") && i + 1 < argc) {
+            replyDelayUs = strtoull(argv[++i], nullptr, 10) * 1000;
+        } else if (!strcmp(argv[i], "--reply-jitter-us") && i + 1 < argc) {
+            replyJitterUs = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--glitch-rate") && i + 1 < argc) {
+            glitchRate = strtod(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--drop-writes") && i + 1 < argc) {
+            dropWrites = strtod(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--echo")) {
+            echo = true;
+        } else if (!strcmp(argv[i], "--collision-rate") && i + 1 < argc) {
+            collisionRate = strtod(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--no-idle-gaps")) {
+            idleGaps = false;
+        } else if (!strcmp(argv[i], "--verbose")) {
+            fujiHostLogLevel = FUJI_LOG_DEBUG;
+        } else if (!strcmp(argv[i], "--trace")) {
+            trace = true;
+        } else if (!strcmp(argv[i], "--capture") && i + 1 < argc) {
+            capturePath = argv[++i];
+        } else if (!strcmp(argv[i], "--commands") && i + 1 < argc) {
+            commands = atoi(argv[++i]);
+        } else {
+            fprintf(stderr,
+                    "usage: %s [--secondary] [--reply-delay-ms N] [--reply-jitter-us N] [--glitch-rate P] [--drop-writes P] [--echo] [--collision-rate P] [--no-idle-gaps] [--verbose] [--trace] [--capture FILE] [--commands N]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    auto wallStart = std::chrono::steady_clock::now();
+
+    FujiBusSimulator bus;
+    FujiSimIndoorUnit unit;
+    FujiHeatPump primary;
+    FujiSimController primaryNode(primary);
+    FujiSimRemote remote;
+    FujiHeatPump listener;
+    FujiSimController listenerNode(listener);
+
+    primary.begin(false);
+    primary.txScheduler.replyDelayUs = replyDelayUs;
+    primaryNode.replyJitterUs = std::uniform_int_distribution<uint32_t>(0, replyJitterUs);
+    primaryNode.glitchProbability = glitchRate;
+    unit.writeDropProbability = dropWrites;
+    primaryNode.idleGaps = idleGaps;
+    bus.echo = echo;
+    bus.noiseProbability = collisionRate;
+    bus.attach(&unit);
+    bus.attach(&primaryNode);
+    listener.listenOnly = true;
+    listener.begin(false);
+    bus.attach(&listenerNode);
+    if (withSecondary) {
+        unit.setSecondaryPresent(true);
+        bus.attach(&remote);
+    }
+
+    const byte primaryAddress = static_cast<byte>(FujiAddress::PRIMARY);
+    // With --trace, the controller's bus trace is printed as it goes, the way
+    // the component's log_trace option does from loop(). With --capture its
+    // bus capture is written out for fuji_replay.
+    FujiTraceCursor traceCursor;
+    FujiRingCursor captureCursor;
+    FILE *captureFile = nullptr;
+    if (capturePath != nullptr) {
+        captureFile = fopen(capturePath, "wb");
+        if (captureFile == nullptr) {
+            perror(capturePath);
+            return 1;
+        }
+        byte header[kCaptureHeaderSize];
+        FujiCapture::encodeHeader(primaryAddress, header);
+        fwrite(header, 1, sizeof(header), captureFile);
+    }
+    auto drainTrace = [&] {
+        FujiTraceRecord rec;
+        char line[256];
+        while (trace && primary.trace.read(traceCursor, rec)) {
+            FujiTrace::format(rec, primaryAddress, line, sizeof(line));
+            printf("  %s\n", line);
+        }
+        FujiCaptureRecord capRec;
+        byte buf[kCaptureRecordSize];
+        while (captureFile != nullptr && primary.capture.read(captureCursor, capRec)) {
+            FujiCapture::encodeRecord(capRec, buf);
+            fwrite(buf, 1, sizeof(buf), captureFile);
+        }
+    };
+    auto settle = [&](uint64_t untilUs) {
+        bus.runUntil(untilUs, kStepUs, [&](uint64_t) {
+            drainTrace();
+            return false;
+        });
+    };
+    auto bound = [&](uint64_t) {
+        drainTrace();
+        return unit.isLoggedIn(primaryAddress) && primary.isBound();
+    };
+
+    // Cold start handshake
+    uint64_t t0 = bus.now();
+    bool ok = bus.runUntil(t0 + kGiveUpUs, kStepUs, bound);
+    report("handshake", ok, t0, bus.now());
+
+    // Let it settle, then change the set point from Home Assistant's side
+    settle(bus.now() + 5000000);
+    FujiFrame desired;
+    desired.setOnOff(1);
+    desired.setTemperature(unit.state.temperature() == 25 ? 24 : 25);
+    desired.setAcMode(primary.getMode());
+    desired.setFanMode(primary.getFanMode());
+    desired.setEconomyMode(primary.getEconomyMode());
+    desired.setSwingMode(primary.getSwingMode());
+    desired.setSwingStep(primary.getSwingStep());
+    t0 = bus.now();
+    primary.setState(&desired);
+    ok = bus.runUntil(t0 + kGiveUpUs, kStepUs, [&](uint64_t) {
+        drainTrace();
+        return unit.state.onOff() == 1 && unit.state.temperature() == desired.temperature();
+    });
+    report("setState() applied by unit", ok, t0, bus.now());
+
+    // Unit power cycle: 10 s off
+    settle(bus.now() + 5000000);
+    t0 = bus.now();
+    unit.powerOff();
+    ok = bus.runUntil(t0 + kGiveUpUs, kStepUs, [&](uint64_t) {
+        drainTrace();
+        return !primary.isBound();
+    });
+    report("unbound after unit power off", ok, t0, bus.now());
+    settle(t0 + 10000000);
+    t0 = bus.now();
+    unit.powerOn(t0);
+    ok = bus.runUntil(t0 + kGiveUpUs, kStepUs, bound);
+    report("re-bound after unit power on", ok, t0, bus.now());
+
+    // Command burst: one random field change every 0.5 to 5 s, like someone
+    // poking at the thermostat card
+    std::mt19937 rng(7);
+    for (int i = 0; i < commands; i++) {
+        settle(bus.now() + std::uniform_int_distribution<uint64_t>(500000, 5000000)(rng));
+        FujiFrame change = primary.getCurrentState();
+        byte field;
+        switch (rng() % 4) {
+            case 0:
+                field = kTempUpdateMask;
+                change.setTemperature(16 + rng() % 15);
+                break;
+            case 1:
+                field = kModeUpdateMask;
+                change.setAcMode(1 + rng() % 5);
+                break;
+            case 2:
+                field = kFanModeUpdateMask;
+                change.setFanMode(rng() % 5);
+                break;
+            default:
+                field = kOnOffUpdateMask;
+                change.setOnOff(!change.onOff());
+                break;
+        }
+        primary.setState(&change, field);
+    }
+    settle(bus.now() + 10000000);
+
+    // Fault: the error bit rises, the controller asks for the details once
+    t0 = bus.now();
+    unit.setError(0x12);
+    ok = bus.runUntil(t0 + kGiveUpUs, kStepUs, [&](uint64_t) {
+        drainTrace();
+        FujiFaultTable faults = primary.faults.read();
+        return faults.count > 0 && faults.faults[0].active && faults.faults[0].code == 0x12;
+    });
+    report("fault code reported", ok, t0, bus.now());
+    settle(bus.now() + 5000000);
+    t0 = bus.now();
+    unit.setError(0);
+    ok = bus.runUntil(t0 + kGiveUpUs, kStepUs, [&](uint64_t) {
+        drainTrace();
+        return !primary.faults.read().errorBit;
+    });
+    report("fault cleared", ok, t0, bus.now());
+    settle(bus.now() + 2000000);
+
+    if (withSecondary) {
+        t0 = bus.now();
+        unit.setSecondaryPresent(false);
+        ok = bus.runUntil(t0 + kGiveUpUs, kStepUs, [&](uint64_t) {
+            drainTrace();
+            return primary.link.getStats().state == FujiLinkState::BOUND;
+        });
+        report("vanished secondary forgotten", ok, t0, bus.now());
+        settle(bus.now() + 2000000);
+    }
+
+    printf("\ncommand latency, %d commands:   p50    p95    max\n", commands);
+    reportLatency("setState() -> write frame", primary.latency.toWire);
+    reportLatency("write frame -> unit echo", primary.latency.unitApply);
+    reportLatency("setState() -> unit echo", primary.latency.endToEnd);
+    if (primary.latency.unconfirmed.load() != 0) {
+        printf("  %u changes never echoed\n", primary.latency.unconfirmed.load());
+    }
+
+    auto wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+    printf("\nsimulated %.1f s in %.1f ms wall, %u frames, %u collisions, %u writes applied, %u dropped\n",
+           bus.now() / 1e6, wall, bus.framesDelivered, bus.collisions, unit.writesApplied, unit.writesDropped);
+    const FujiCommandStats &commandStats = primary.commands.getStats();
+    printf("commands: %u confirmed, %u retries, %u abandoned, %u still pending\n", commandStats.confirmed,
+           commandStats.retries, commandStats.abandoned, __builtin_popcount(primary.commands.pending()));
+    const FujiFramerStats &framing = primary.framer.getStats();
+    const FujiSlotStats &slots = primary.txScheduler.getStats();
+    printf("reply slots: %u sent, %u missed, error min %d max %d mean |%u| us\n", slots.sent, slots.missed,
+           slots.minErrorUs, slots.maxErrorUs, slots.meanAbsErrorUs());
+    printf("framer: %u frames, %u bytes dropped, %u frames dropped\n", framing.frames, framing.bytesDropped,
+           framing.framesDropped);
+    const FujiResponseStats &responseStats = primary.responses.getStats();
+    printf("responses: %u queued, %u superseded, %u dropped, peak depth %u\n", responseStats.queued,
+           responseStats.superseded, responseStats.dropped, (unsigned) primary.responses.takePeakDepth());
+    const FujiEchoStats &echoStats = primary.echo.getStats();
+    printf("echo: %u verified, %u collisions, %u bit errors, %u missing, %u unchecked; %u retransmits\n",
+           echoStats.verified, echoStats.collisions, echoStats.bitErrors, echoStats.missing, echoStats.unchecked,
+           primary.health.get(FujiBusCounter::RETRANSMITS));
+    char faultText[128];
+    FujiFaultTable faults = primary.faults.read();
+    FujiFaults::format(faults, faultText, sizeof(faultText));
+    printf("faults: %u error detail requests, %u codes seen, now %s\n", faults.queries, faults.count, faultText);
+    FujiLinkStats link = primary.link.getStats();
+    printf("link: %u transitions, now %s;", link.transitions, FujiLink::name(link.state));
+    for (size_t i = 0; i < static_cast<size_t>(FujiLinkState::COUNT); i++) {
+        FujiLinkState state = static_cast<FujiLinkState>(i);
+        printf("%s %s %.1f s", i ? "," : "", FujiLink::name(state),
+               FujiLink::timeInStateMs(link, state, fujiMillis()) / 1000.0);
+    }
+    printf("\n");
+    printf("bus health:");
+    for (size_t i = 0; i < FujiBusHealth::kCount; i++) {
+        FujiBusCounter counter = static_cast<FujiBusCounter>(i);
+        printf("%s %s %u", i ? "," : "", FujiBusHealth::name(counter), primary.health.get(counter));
+    }
+    printf("\n");
+    char line[256];
+    printf("listener: %u frames heard, %u sent, state %s the unit's\n",
+           listener.health.get(FujiBusCounter::FRAMES_RECEIVED), listener.health.get(FujiBusCounter::FRAMES_SENT),
+           fujiSameState(listener.getPublishedState(), unit.state) ? "matches" : "differs from");
+    for (size_t i = 0; i < FujiSniffer::kMaxStations; i++) {
+        FujiSnifferStation station = listener.sniffer.read(i);
+        if (station.frames != 0) {
+            FujiSniffer::format(station, line, sizeof(line));
+            printf("  %s\n", line);
+        }
+    }
+    // The climate's loop() copies the state only when this version moves;
+    // it used to take every received frame
+    printf("published state: %u changes over %u frames\n", primary.getStateVersion() - 1,
+           primary.health.get(FujiBusCounter::FRAMES_RECEIVED));
+    if (trace) {
+        printf("trace: %u records, %u lost\n", primary.trace.recorded(), traceCursor.lost);
+    }
+    if (captureFile != nullptr) {
+        drainTrace();
+        fclose(captureFile);
+        printf("capture: %u records, %u lost, written to %s\n", primary.capture.recorded(), captureCursor.lost,
+               capturePath);
+    }
+    return 0;
+}
@@ -0,0 +1,204 @@
+// The simulated indoor unit (and optionally the scripted secondary remote),
+// run in real time on the master side of a pty. A controller opens the slave
+// as if it were the bus, e.g. fuji_daemon --device /dev/pts/N, and the unit
+// logs it in, polls it and applies its writes as fuji_sim_run's unit does.
+// The slave's name is printed first; the unit's view of the session follows.
+// With --echo the controller hears its own frames back, as on the real bus.
+//
+//   fuji_sim_pty [--secondary] [--echo] [--error-at S CODE] [--duration S] [--verbose]
+
+#include <chrono>
+#include <deque>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "FujiBusSimulator.h"
+#include "FujiSerial.h"
+
+using namespace esphome::fujitsu;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) { stopRequested = 1; }
+
+static uint64_t wallUs() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The controller at the other end of the pty, as a node on the simulated bus
+class FujiSimPtyNode : public FujiSimNode {
+   public:
+    explicit FujiSimPtyNode(int fd) : fd(fd) {}
+
+    // Frames reach the pty when they have finished on the simulated wire in
+    // real time; the simulator may have run a frame ahead of the clock
+    void onFrame(FujiBusSimulator &, const byte *wire, uint64_t endUs) override {
+        Out out;
+        out.endUs = endUs;
+        memcpy(out.wire, wire, kFrameSize);
+        this->outbox.push_back(out);
+    }
+
+    uint64_t nextFlushUs() const { return this->outbox.empty() ? UINT64_MAX : this->outbox.front().endUs; }
+
+    void flush(uint64_t nowUs) {
+        while (!this->outbox.empty() && this->outbox.front().endUs <= nowUs) {
+            if (write(this->fd, this->outbox.front().wire, kFrameSize) != (ssize_t) kFrameSize) {
+                this->writeErrors++;
+            }
+            this->outbox.pop_front();
+        }
+    }
+
+    // The controller wrote all its bytes at once when its slot came; on a
+    // real line the frame would take a frame time from there
+    bool readReady(FujiBusSimulator &bus, uint64_t nowUs) {
+        byte buf[64];
+        ssize_t n;
+        while ((n = read(this->fd, buf, sizeof(buf))) > 0) {
+            if (this->count != 0 && nowUs - this->lastUs > 3 * kFujiByteTimeUs) {
+                this->count = 0;
+            }
+            this->lastUs = nowUs;
+            for (ssize_t i = 0; i < n; i++) {
+                this->frame[this->count++] = buf[i];
+                if (this->count == kFrameSize) {
+                    bus.transmit(this, nowUs, this->frame);
+                    this->count = 0;
+                    this->framesIn++;
+                }
+            }
+        }
+        return n < 0 && errno == EAGAIN;
+    }
+
+    uint32_t framesIn = 0;
+    uint32_t writeErrors = 0;
+
+   private:
+    struct Out {
+        uint64_t endUs;
+        byte wire[kFrameSize];
+    };
+
+    int fd;
+    std::deque<Out> outbox;
+    byte frame[kFrameSize];
+    size_t count = 0;
+    uint64_t lastUs = 0;
+};
+
+int main(int argc, char **argv) {
+    bool withSecondary = false;
+    bool echo = false;
+    double errorAtS = -1;
+    byte errorCode = 0;
+    double durationS = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--secondary")) {
+            withSecondary = true;
+        } else if (!strcmp(argv[i], "--echo")) {
+            echo = true;
+        } else if (!strcmp(argv[i], "--error-at") && i + 2 < argc) {
+            errorAtS = strtod(argv[++i], nullptr);
+            errorCode = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--duration") && i + 1 < argc) {
+            durationS = strtod(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--verbose")) {
+            fujiHostLogLevel = FUJI_LOG_DEBUG;
+        } else {
+            fprintf(stderr, "usage: %s [--secondary] [--echo] [--error-at S CODE] [--duration S] [--verbose]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    char peer[64];
+    int slaveFd;
+    int fd = fujiSerialOpenPty(peer, sizeof(peer), &slaveFd);
+    if (fd < 0) {
+        return 1;
+    }
+    printf("pty %s\n", peer);
+    fflush(stdout);
+
+    struct sigaction sa = {};
+    sa.sa_handler = onSignal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    // Virtual time follows the wall clock from here on
+    wallUs();
+    FujiBusSimulator bus;
+    FujiSimIndoorUnit unit;
+    FujiSimPtyNode controller(fd);
+    FujiSimRemote remote;
+    bus.echo = echo;
+    bus.attach(&unit);
+    bus.attach(&controller);
+    if (withSecondary) {
+        unit.setSecondaryPresent(true);
+        bus.attach(&remote);
+    }
+
+    const byte addresses[] = {static_cast<byte>(FujiAddress::PRIMARY), static_cast<byte>(FujiAddress::SECONDARY)};
+    bool loggedIn[2] = {};
+    uint32_t writes = 0;
+    uint64_t endUs = durationS > 0 ? (uint64_t)(durationS * 1e6) : UINT64_MAX;
+    while (!stopRequested) {
+        uint64_t nowUs = wallUs();
+        if (nowUs >= endUs) {
+            break;
+        }
+        if (errorAtS >= 0 && nowUs >= errorAtS * 1e6) {
+            errorAtS = -1;
+            unit.setError(errorCode);
+            printf("%10.3f s  unit raises error 0x%02X\n", nowUs / 1e6, errorCode);
+        }
+        bus.runUntil(nowUs);
+        controller.flush(nowUs);
+
+        for (size_t i = 0; i < 2; i++) {
+            if (unit.isLoggedIn(addresses[i]) != loggedIn[i]) {
+                loggedIn[i] = !loggedIn[i];
+                printf("%10.3f s  %u %s\n", nowUs / 1e6, addresses[i], loggedIn[i] ? "logged in" : "logged out");
+            }
+        }
+        if (unit.writesApplied != writes) {
+            writes = unit.writesApplied;
+            const FujiFrame &s = unit.state;
+            printf("%10.3f s  write applied: power %s mode %u set %u fan %u eco %u swing %u step %u\n", nowUs / 1e6,
+                   s.onOff() ? "on" : "off", s.acMode(), s.temperature(), s.fanMode(), s.economyMode(), s.swingMode(),
+                   s.swingStep());
+        }
+        fflush(stdout);
+
+        uint64_t deadlineUs = std::min(std::min(bus.nextEventUs(), controller.nextFlushUs()), endUs);
+        timespec timeout = {};
+        if (deadlineUs > nowUs) {
+            uint64_t waitUs = std::min<uint64_t>(deadlineUs - nowUs, 1000000);
+            timeout.tv_sec = waitUs / 1000000;
+            timeout.tv_nsec = waitUs % 1000000 * 1000;
+        }
+        pollfd in = {fd, POLLIN, 0};
+        int n = ppoll(&in, 1, &timeout, nullptr);
+        if (n < 0 && errno != EINTR) {
+            perror("ppoll");
+            return 1;
+        }
+        if (n > 0 && !controller.readReady(bus, wallUs())) {
+            fprintf(stderr, "pty went away\n");
+            return 1;
+        }
+    }
+    printf("%u frames on the bus, %u from the controller, %u writes applied, %u collisions\n", bus.framesDelivered,
+           controller.framesIn, unit.writesApplied, bus.collisions);
+    close(slaveFd);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,492 @@
+// Long soak of the controller against the simulated indoor unit, in virtual
+// time: by default 24 simulated hours in a few seconds of wall time. Someone
+// changes a setting every few minutes, and every few hours the unit is power
+// cycled, raises a fault or (with --secondary) loses its remote for a while.
+// Throughout, the run checks that
+//   - every change reaches the unit within a minute, unless the unit lost
+//     power meanwhile or the pipeline gave up on it (only with --drop-writes)
+//   - the published state of the controller and of a listen-only controller
+//     agrees with the unit's whenever nothing is in flight
+//   - the controller is bound again soon after the unit comes back, and
+//     reports a fault soon after the unit raises it
+//   - no reply misses its slot
+// and ends with the figures for CI: violations, frames processed per second
+// of CPU and a digest of every frame on the wire. The session is a pure
+// function of the seed, so --runs N repeats it and insists on the same digest.
+//
+//   fuji_soak [--hours H] [--seed N] [--runs N] [--secondary] [--glitch-rate P] [--drop-writes P] [--echo]
+//             [--collision-rate P] [--verbose]
+
+#include <chrono>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "FujiBusSimulator.h"
+
+using namespace esphome::fujitsu;
+
+static const uint64_t kSecondUs = 1000000;
+static const uint64_t kMinuteUs = 60 * kSecondUs;
+static const uint64_t kHourUs = 60 * kMinuteUs;
+
+// Invariants are checked this often
+static const uint64_t kProbeUs = kSecondUs;
+// How long a change may take to reach the unit
+static const uint64_t kCommandDeadlineUs = kMinuteUs;
+// How long the published state may disagree with the unit's with nothing in flight
+static const uint64_t kMismatchGraceUs = 10 * kSecondUs;
+static const uint64_t kRebindDeadlineUs = 30 * kSecondUs;
+static const uint64_t kFaultDeadlineUs = 10 * kSecondUs;
+
+struct SoakOptions {
+    double hours = 24;
+    uint32_t seed = 1;
+    bool secondary = false;
+    double glitchRate = 0;
+    double dropWrites = 0;
+    bool echo = false;
+    double collisionRate = 0;
+};
+
+struct SoakResult {
+    uint64_t digest = 0;
+    uint32_t violations = 0;
+    double cpuS = 0;
+    double wallS = 0;
+    uint32_t framesHandled = 0;
+};
+
+static double cpuSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The settings setState() can change, as (mask, value) pairs
+static byte setting(const FujiFrame &f, byte mask) {
+    switch (mask) {
+        case kOnOffUpdateMask:
+            return f.onOff();
+        case kTempUpdateMask:
+            return f.temperature();
+        case kModeUpdateMask:
+            return f.acMode();
+        case kFanModeUpdateMask:
+            return f.fanMode();
+        case kEconomyModeUpdateMask:
+            return f.economyMode();
+        case kSwingModeUpdateMask:
+            return f.swingMode();
+        default:
+            return f.swingStep();
+    }
+}
+
+static bool sameSettings(const FujiFrame &a, const FujiFrame &b) {
+    for (byte mask = kOnOffUpdateMask; mask >= kSwingStepUpdateMask; mask >>= 1) {
+        if (setting(a, mask) != setting(b, mask)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+class Soak {
+   public:
+    explicit Soak(const SoakOptions &options) : options(options), rng(options.seed) {}
+
+    SoakResult run();
+
+   private:
+    enum class Disruption { NONE, POWER_OFF, FAULT, SECONDARY_GONE };
+
+    // A condition that has to clear up within a grace period; reported once
+    struct Watch {
+        uint64_t sinceUs = UINT64_MAX;
+        bool reported = false;
+    };
+
+    struct Check {
+        bool active = false;
+        byte value = 0;
+        uint64_t issuedUs = 0;
+        uint32_t powerEpoch = 0;
+        uint32_t abandoned = 0;
+    };
+
+    void violation(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    void command();
+    void disrupt();
+    void restore();
+    bool probe(uint64_t nowUs);
+    // Watches a controller's published state against the unit's
+    void checkState(const char *who, FujiHeatPump &hp, bool quiet, Watch &mismatch, uint64_t nowUs);
+    void checkDisruption(uint64_t nowUs);
+    uint64_t uniform(uint64_t fromUs, uint64_t toUs) {
+        return std::uniform_int_distribution<uint64_t>(fromUs, toUs)(this->rng);
+    }
+
+    const SoakOptions options;
+    std::mt19937 rng;
+    SoakResult result;
+
+    FujiBusSimulator bus;
+    FujiSimIndoorUnit unit;
+    FujiHeatPump primary;
+    FujiSimController primaryNode{primary};
+    FujiSimRemote remote;
+    FujiHeatPump listener;
+    FujiSimController listenerNode{listener};
+
+    Check checks[8];
+    uint32_t powerEpoch = 0;
+    uint32_t commandsIssued = 0;
+    uint32_t commandsApplied = 0;
+    uint32_t commandsLost = 0;
+    uint64_t commandMaxUs = 0;
+
+    Disruption disruption = Disruption::NONE;
+    // Whether it is over, and whether the controller has caught up with
+    // the latest turn (going wrong or coming right) since startUs
+    bool restored = false;
+    bool caughtUp = false;
+    uint64_t disruptionStartUs = 0;
+    uint32_t powerCycles = 0;
+    uint32_t faultsRaised = 0;
+    uint32_t secondaryGone = 0;
+    uint64_t rebindMaxUs = 0;
+    uint64_t faultMaxUs = 0;
+    // When the unit last changed its settings or came back; state checks wait for it to settle
+    uint64_t unitChangedUs = 0;
+    uint32_t lastWrites = 0;
+    Watch primaryMismatch;
+    Watch listenerMismatch;
+};
+
+void Soak::violation(const char *format, ...) {
+    this->result.violations++;
+    va_list args;
+    va_start(args, format);
+    printf("%9.3f h  VIOLATION: ", this->bus.now() / (double) kHourUs);
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+}
+
+void Soak::command() {
+    FujiFrame change = this->primary.getCurrentState();
+    byte mask;
+    switch (this->rng() % 6) {
+        case 0:
+            mask = kTempUpdateMask;
+            change.setTemperature(16 + this->rng() % 15);
+            break;
+        case 1:
+            mask = kModeUpdateMask;
+            change.setAcMode(1 + this->rng() % 5);
+            break;
+        case 2:
+            mask = kFanModeUpdateMask;
+            change.setFanMode(this->rng() % 5);
+            break;
+        case 3:
+            mask = kEconomyModeUpdateMask;
+            change.setEconomyMode(this->rng() % 2);
+            break;
+        case 4:
+            mask = kSwingModeUpdateMask;
+            change.setSwingMode(this->rng() % 2);
+            break;
+        default:
+            mask = kOnOffUpdateMask;
+            change.setOnOff(!change.onOff());
+            break;
+    }
+    this->primary.setState(&change, mask);
+    Check &c = this->checks[fujiMaskOffset(mask)];
+    c.active = true;
+    c.value = setting(change, mask);
+    c.issuedUs = this->bus.now();
+    c.powerEpoch = this->powerEpoch;
+    c.abandoned = this->primary.commands.getStats().abandoned;
+    this->commandsIssued++;
+}
+
+void Soak::disrupt() {
+    uint32_t pick = this->rng() % (this->options.secondary ? 3 : 2);
+    this->disruptionStartUs = this->bus.now();
+    this->restored = false;
+    this->caughtUp = false;
+    if (pick == 0) {
+        this->disruption = Disruption::POWER_OFF;
+        this->unit.powerOff();
+        this->powerEpoch++;
+        this->powerCycles++;
+    } else if (pick == 1) {
+        this->disruption = Disruption::FAULT;
+        this->unit.setError(1 + this->rng() % 0xFE);
+        this->faultsRaised++;
+    } else {
+        this->disruption = Disruption::SECONDARY_GONE;
+        this->unit.setSecondaryPresent(false);
+        this->secondaryGone++;
+    }
+}
+
+void Soak::restore() {
+    if (this->disruption == Disruption::POWER_OFF) {
+        this->unit.powerOn(this->bus.now());
+        this->unitChangedUs = this->bus.now();
+    } else if (this->disruption == Disruption::FAULT) {
+        this->unit.setError(0);
+    } else if (this->disruption == Disruption::SECONDARY_GONE) {
+        this->unit.setSecondaryPresent(true);
+    }
+    // Coming back is watched like going away, from the time of the restore
+    this->disruptionStartUs = this->bus.now();
+    this->restored = true;
+    this->caughtUp = false;
+}
+
+void Soak::checkState(const char *who, FujiHeatPump &hp, bool quiet, Watch &mismatch, uint64_t nowUs) {
+    if (!quiet || sameSettings(hp.getPublishedState(), this->unit.state)) {
+        mismatch = Watch();
+        return;
+    }
+    if (mismatch.sinceUs == UINT64_MAX) {
+        mismatch.sinceUs = nowUs;
+    } else if (nowUs - mismatch.sinceUs > kMismatchGraceUs && !mismatch.reported) {
+        mismatch.reported = true;
+        this->violation("%s state differs from the unit's for %llu s", who,
+                        (unsigned long long) (kMismatchGraceUs / kSecondUs));
+    }
+}
+
+void Soak::checkDisruption(uint64_t nowUs) {
+    if (this->disruption == Disruption::NONE || this->caughtUp) {
+        return;
+    }
+    uint64_t tookUs = nowUs - this->disruptionStartUs;
+    uint64_t deadlineUs = kFaultDeadlineUs;
+    uint64_t *slowestUs = &this->faultMaxUs;
+    const char *what = this->restored ? "cleared fault" : "fault";
+    bool done;
+    if (this->disruption == Disruption::POWER_OFF) {
+        // Nothing to catch up with while the unit is off
+        done = !this->restored ||
+               (this->unit.isLoggedIn(static_cast<byte>(FujiAddress::PRIMARY)) && this->primary.isBound());
+        deadlineUs = kRebindDeadlineUs;
+        slowestUs = &this->rebindMaxUs;
+        what = "unit power on";
+    } else if (this->disruption == Disruption::FAULT) {
+        FujiFaultTable faults = this->primary.faults.read();
+        if (this->restored) {
+            done = !faults.errorBit;
+        } else {
+            done = false;
+            for (size_t i = 0; i < faults.count; i++) {
+                done |= faults.faults[i].active && faults.faults[i].code == this->unit.errorCode;
+            }
+        }
+    } else {
+        // The remote's comings and goings are only reported
+        done = true;
+    }
+    if (done) {
+        *slowestUs = std::max(*slowestUs, tookUs);
+    } else if (tookUs > deadlineUs) {
+        this->violation("%s not handled within %llu s", what, (unsigned long long) (deadlineUs / kSecondUs));
+        done = true;
+    }
+    if (done) {
+        this->caughtUp = true;
+        if (this->restored) {
+            this->disruption = Disruption::NONE;
+        }
+    }
+}
+
+bool Soak::probe(uint64_t nowUs) {
+    if (this->unit.writesApplied != this->lastWrites) {
+        this->lastWrites = this->unit.writesApplied;
+        this->unitChangedUs = nowUs;
+    }
+
+    for (size_t bit = 1; bit < 8; bit++) {
+        Check &c = this->checks[bit];
+        if (!c.active) {
+            continue;
+        }
+        if (setting(this->unit.state, 1 << bit) == c.value) {
+            c.active = false;
+            this->commandsApplied++;
+            this->commandMaxUs = std::max(this->commandMaxUs, nowUs - c.issuedUs);
+        } else if (nowUs - c.issuedUs > kCommandDeadlineUs) {
+            c.active = false;
+            if (c.powerEpoch != this->powerEpoch || this->primary.commands.getStats().abandoned != c.abandoned) {
+                this->commandsLost++;
+            } else {
+                this->violation("change to field %u not applied within %llu s", (unsigned) bit,
+                                (unsigned long long) (kCommandDeadlineUs / kSecondUs));
+            }
+        }
+    }
+
+    bool settled = this->unit.isPowered() && nowUs - this->unitChangedUs > 3 * kSecondUs;
+    this->checkState("controller", this->primary,
+                     settled && this->primary.isBound() && !this->primary.updatePending(), this->primaryMismatch,
+                     nowUs);
+    this->checkState("listener", this->listener, settled, this->listenerMismatch, nowUs);
+    this->checkDisruption(nowUs);
+    return false;
+}
+
+SoakResult Soak::run() {
+    double cpuStart = cpuSeconds();
+    auto wallStart = std::chrono::steady_clock::now();
+
+    this->primary.begin(false);
+    this->primaryNode.glitchProbability = this->options.glitchRate;
+    this->unit.writeDropProbability = this->options.dropWrites;
+    this->bus.echo = this->options.echo;
+    this->bus.noiseProbability = this->options.collisionRate;
+    this->listener.listenOnly = true;
+    this->listener.begin(false);
+    this->bus.attach(&this->unit);
+    this->bus.attach(&this->primaryNode);
+    this->bus.attach(&this->listenerNode);
+    if (this->options.secondary) {
+        this->unit.setSecondaryPresent(true);
+        this->bus.attach(&this->remote);
+    }
+    // Every frame on the wire, with its time, goes into the digest (FNV-1a)
+    this->result.digest = 14695981039346656037ULL;
+    this->bus.onWire = [this](const byte *wire, uint64_t endUs) {
+        uint64_t &h = this->result.digest;
+        for (size_t i = 0; i < kFrameSize; i++) {
+            h = (h ^ wire[i]) * 1099511628211ULL;
+        }
+        for (size_t i = 0; i < 8; i++) {
+            h = (h ^ (byte)(endUs >> (8 * i))) * 1099511628211ULL;
+        }
+    };
+
+    const uint64_t endUs = (uint64_t)(this->options.hours * kHourUs);
+    uint64_t nextCommandUs = this->uniform(kMinuteUs, 20 * kMinuteUs);
+    uint64_t nextDisruptionUs = this->uniform(kHourUs, 4 * kHourUs);
+    uint64_t restoreUs = UINT64_MAX;
+    auto probe = [this](uint64_t nowUs) { return this->probe(nowUs); };
+    while (this->bus.now() < endUs) {
+        uint64_t untilUs = std::min(std::min(nextCommandUs, nextDisruptionUs), std::min(restoreUs, endUs));
+        this->bus.runUntil(untilUs, kProbeUs, probe);
+        uint64_t nowUs = this->bus.now();
+        if (nowUs >= nextCommandUs) {
+            this->command();
+            nextCommandUs = nowUs + this->uniform(kMinuteUs, 20 * kMinuteUs);
+        }
+        if (nowUs >= restoreUs) {
+            this->restore();
+            restoreUs = UINT64_MAX;
+            nextDisruptionUs = nowUs + this->uniform(kHourUs, 4 * kHourUs);
+        } else if (nowUs >= nextDisruptionUs) {
+            this->disrupt();
+            nextDisruptionUs = UINT64_MAX;
+            restoreUs = nowUs + this->uniform(10 * kSecondUs, 5 * kMinuteUs);
+        }
+    }
+
+    const FujiSlotStats &slots = this->primary.txScheduler.getStats();
+    if (slots.missed != 0) {
+        this->violation("%u replies missed their slot", (unsigned) slots.missed);
+    }
+    this->result.cpuS = cpuSeconds() - cpuStart;
+    this->result.wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    this->result.framesHandled = this->primary.health.get(FujiBusCounter::FRAMES_RECEIVED) +
+                                 this->listener.health.get(FujiBusCounter::FRAMES_RECEIVED);
+
+    printf("%.1f h simulated in %.2f s wall (%.0fx), %.2f s CPU\n", this->bus.now() / (double) kHourUs,
+           this->result.wallS, this->bus.now() / 1e6 / this->result.wallS, this->result.cpuS);
+    printf("frames: %u on the wire, %u collisions, %u handled by the two controllers (%.0f per CPU second)\n",
+           this->bus.framesDelivered, this->bus.collisions, this->result.framesHandled,
+           this->result.framesHandled / this->result.cpuS);
+    const FujiCommandStats &commandStats = this->primary.commands.getStats();
+    printf("changes: %u issued, %u applied (slowest %.1f s), %u lost to power cuts or given up; "
+           "pipeline %u retries, %u abandoned\n",
+           this->commandsIssued, this->commandsApplied, this->commandMaxUs / 1e6, this->commandsLost,
+           commandStats.retries, commandStats.abandoned);
+    const FujiHistogram &latency = this->primary.latency.endToEnd;
+    printf("setState() -> unit echo: p50 %.0f p95 %.0f max %.0f ms over %u changes, %u never echoed\n",
+           latency.percentileUs(0.5f) / 1000.0, latency.percentileUs(0.95f) / 1000.0, latency.maxUs() / 1000.0,
+           latency.count(), this->primary.latency.unconfirmed.load());
+    printf("disruptions: %u power cycles (rebound within %.1f s), %u faults (handled within %.1f s), "
+           "%u secondary outages\n",
+           this->powerCycles, this->rebindMaxUs / 1e6, this->faultsRaised, this->faultMaxUs / 1e6,
+           this->secondaryGone);
+    FujiLinkStats link = this->primary.link.getStats();
+    printf("link: %u transitions;", link.transitions);
+    for (size_t i = 0; i < static_cast<size_t>(FujiLinkState::COUNT); i++) {
+        FujiLinkState state = static_cast<FujiLinkState>(i);
+        printf("%s %s %.1f%%", i ? "," : "", FujiLink::name(state),
+               100.0 * FujiLink::timeInStateMs(link, state, fujiMillis()) / fujiMillis());
+    }
+    printf("\nreply slots: %u sent, %u missed; framer: %u bytes dropped\n", slots.sent, slots.missed,
+           this->primary.framer.getStats().bytesDropped);
+    if (this->options.echo) {
+        const FujiEchoStats &echo = this->primary.echo.getStats();
+        printf("echo: %u verified, %u collisions, %u bit errors, %u missing; %u retransmits\n", echo.verified,
+               echo.collisions, echo.bitErrors, echo.missing, this->primary.health.get(FujiBusCounter::RETRANSMITS));
+    }
+    printf("violations: %u\ndigest: %016llx\n", this->result.violations, (unsigned long long) this->result.digest);
+    return this->result;
+}
+
+int main(int argc, char **argv) {
+    SoakOptions options;
+    int runs = 1;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--hours") && i + 1 < argc) {
+            options.hours = strtod(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            options.seed = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--runs") && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--secondary")) {
+            options.secondary = true;
+        } else if (!strcmp(argv[i], "--glitch-rate") && i + 1 < argc) {
+            options.glitchRate = strtod(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--drop-writes") && i + 1 < argc) {
+            options.dropWrites = strtod(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--echo")) {
+            options.echo = true;
+        } else if (!strcmp(argv[i], "--collision-rate") && i + 1 < argc) {
+            options.collisionRate = strtod(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--verbose")) {
+            fujiHostLogLevel = FUJI_LOG_DEBUG;
+        } else {
+            fprintf(stderr,
+                    "usage: %s [--hours H] [--seed N] [--runs N] [--secondary] [--glitch-rate P] [--drop-writes P] "
+                    "[--echo] [--collision-rate P] [--verbose]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    uint64_t digest = 0;
+    bool failed = false;
+    for (int i = 0; i < runs; i++) {
+        if (runs > 1) {
+            printf("%srun %d of %d\n", i ? "\n" : "", i + 1, runs);
+        }
+        SoakResult result = Soak(options).run();
+        if (i > 0 && result.digest != digest) {
+            printf("NOT DETERMINISTIC: digest differs from the first run's\n");
+            failed = true;
+        }
+        digest = result.digest;
+        failed |= result.violations != 0;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,41 @@
+// Shared bits of the fuzz targets. Each target defines LLVMFuzzerTestOneInput;
+// with clang it links against libFuzzer, otherwise FuzzMain.cpp drives it.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Invariant check that stays on in every build type
+#define FUJI_FUZZ_CHECK(cond, ...)                                             \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            fprintf(stderr, "%s:%d: invariant failed: %s: ", __FILE__, __LINE__, #cond); \
+            fprintf(stderr, __VA_ARGS__);                                      \
+            fprintf(stderr, "\n");                                             \
+            abort();                                                           \
+        }                                                                      \
+    } while (0)
+
+// Protocol target input: one options byte, then a stream of ops, each led by
+// a header byte.
+//   00iLLLLL  L+1 (1..32) bytes off the wire follow; i: the line goes idle after them
+//   01xxxxxx  setState(): a mask byte and a value byte follow; the value goes
+//             into every field the mask selects
+//   10TTTTTT  nothing on the line for T * 100 ms
+//   11xxxxxx  toggle enable_communication
+const uint8_t kFuzzOptSecondary = 0x01;
+const uint8_t kFuzzOptNoCache = 0x02;
+const uint8_t kFuzzOptListen = 0x04;
+
+const uint8_t kFuzzOpMask = 0xC0;
+const uint8_t kFuzzOpRx = 0x00;
+const uint8_t kFuzzOpSetState = 0x40;
+const uint8_t kFuzzOpWait = 0x80;
+const uint8_t kFuzzOpComms = 0xC0;
+const uint8_t kFuzzRxIdle = 0x20;
+const size_t kFuzzRxMax = 32;
+const uint32_t kFuzzWaitStepUs = 100000;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
@@ -0,0 +1,200 @@
+// Stand-in for libFuzzer when the compiler does not ship it (gcc). Runs every
+// input of the given corpus files/directories, then mutates them at random
+// for a number of runs. There is no coverage feedback, so it finds less than
+// libFuzzer would, but the targets and invariants are the same.
+//
+//   fuji_fuzz_<target> [-runs=N] [-seed=S] [-max_len=N] [CORPUS...]
+//
+// The input that trips an invariant or a sanitizer is written to crash-input
+// in the working directory and can be rerun by passing it as the corpus.
+
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <random>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "FujiFuzz.h"
+
+#if defined(__has_include)
+#if __has_include(<sanitizer/common_interface_defs.h>)
+#include <sanitizer/common_interface_defs.h>
+#define FUJI_HAVE_SANITIZER_HOOKS 1
+#endif
+#endif
+
+typedef std::vector<uint8_t> Input;
+
+static const Input *currentInput = nullptr;
+
+static void saveCurrentInput() {
+    if (currentInput == nullptr) {
+        return;
+    }
+    // Only async-signal-safe calls from here on
+    int fd = open("crash-input", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        ssize_t ignored = write(fd, currentInput->data(), currentInput->size());
+        (void) ignored;
+        close(fd);
+    }
+    const char msg[] = "input written to crash-input\n";
+    ssize_t ignored = write(2, msg, sizeof(msg) - 1);
+    (void) ignored;
+    currentInput = nullptr;
+}
+
+static void onSignal(int sig) {
+    saveCurrentInput();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static bool readFile(const std::string &path, Input &out) {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == nullptr) {
+        perror(path.c_str());
+        return false;
+    }
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        out.insert(out.end(), buf, buf + n);
+    }
+    fclose(f);
+    return true;
+}
+
+static void loadCorpus(const std::string &path, std::vector<Input> &corpus) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        perror(path.c_str());
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        Input input;
+        if (readFile(path, input)) {
+            corpus.push_back(input);
+        }
+        return;
+    }
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        perror(path.c_str());
+        return;
+    }
+    while (struct dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            loadCorpus(path + "/" + entry->d_name, corpus);
+        }
+    }
+    closedir(dir);
+}
+
+static void runOne(const Input &input) {
+    currentInput = &input;
+    LLVMFuzzerTestOneInput(input.data(), input.size());
+    currentInput = nullptr;
+}
+
+static void mutate(Input &input, const std::vector<Input> &corpus, std::mt19937 &rng, size_t maxLen) {
+    int count = 1 + rng() % 4;
+    for (int m = 0; m < count; m++) {
+        size_t size = input.size();
+        switch (rng() % 6) {
+            case 0:  // flip a bit
+                if (size) {
+                    input[rng() % size] ^= 1 << (rng() % 8);
+                }
+                break;
+            case 1:  // random byte
+                if (size) {
+                    input[rng() % size] = rng();
+                }
+                break;
+            case 2:  // insert a byte
+                if (size < maxLen) {
+                    input.insert(input.begin() + (size ? rng() % (size + 1) : 0), (uint8_t) rng());
+                }
+                break;
+            case 3:  // drop a run
+                if (size > 1) {
+                    size_t at = rng() % size;
+                    size_t len = 1 + rng() % std::min<size_t>(8, size - at);
+                    input.erase(input.begin() + at, input.begin() + at + len);
+                }
+                break;
+            case 4:  // repeat a run
+                if (size && size < maxLen) {
+                    size_t at = rng() % size;
+                    size_t len = 1 + rng() % std::min<size_t>(16, size - at);
+                    Input run(input.begin() + at, input.begin() + at + len);
+                    input.insert(input.begin() + rng() % (size + 1), run.begin(), run.end());
+                }
+                break;
+            case 5:  // splice in part of another input
+                if (!corpus.empty()) {
+                    const Input &other = corpus[rng() % corpus.size()];
+                    if (!other.empty()) {
+                        size_t at = rng() % other.size();
+                        size_t len = 1 + rng() % std::min<size_t>(64, other.size() - at);
+                        input.insert(input.begin() + (size ? rng() % (size + 1) : 0), other.begin() + at,
+                                     other.begin() + at + len);
+                    }
+                }
+                break;
+        }
+        if (input.size() > maxLen) {
+            input.resize(maxLen);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    long runs = 100000;
+    unsigned seed = 1;
+    size_t maxLen = 4096;
+    std::vector<Input> corpus;
+    for (int i = 1; i < argc; i++) {
+        if (!strncmp(argv[i], "-runs=", 6)) {
+            runs = atol(argv[i] + 6);
+        } else if (!strncmp(argv[i], "-seed=", 6)) {
+            seed = strtoul(argv[i] + 6, nullptr, 10);
+        } else if (!strncmp(argv[i], "-max_len=", 9)) {
+            maxLen = strtoul(argv[i] + 9, nullptr, 10);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [-runs=N] [-seed=S] [-max_len=N] [CORPUS...]\n", argv[0]);
+            return 2;
+        } else {
+            loadCorpus(argv[i], corpus);
+        }
+    }
+
+    signal(SIGABRT, onSignal);
+    signal(SIGSEGV, onSignal);
+    signal(SIGFPE, onSignal);
+#ifdef FUJI_HAVE_SANITIZER_HOOKS
+    __sanitizer_set_death_callback(saveCurrentInput);
+#endif
+
+    for (const Input &input : corpus) {
+        runOne(input);
+    }
+    printf("%zu corpus inputs ok\n", corpus.size());
+
+    std::mt19937 rng(seed);
+    for (long run = 0; run < runs; run++) {
+        Input input = corpus.empty() ? Input() : corpus[rng() % corpus.size()];
+        mutate(input, corpus, rng, maxLen);
+        runOne(input);
+    }
+    printf("%ld mutated runs ok (seed %u)\n", runs, seed);
+    return 0;
+}
@@ -0,0 +1,128 @@
+// Fuzz target: a byte stream from the wire through the framer and the
+// protocol, with setState() calls and quiet periods mixed in (see FujiFuzz.h
+// for the input format). After every frame the state must hold only modes
+// and fan speeds that exist, whatever setState() queued must be a valid
+// setting, a frame may not produce more responses than a login does
+// (none at all when listening only), and every response must come from our
+// own address.
+
+#include <string.h>
+
+#include "FujiFuzz.h"
+#include "FujiHeatPump.h"
+
+using namespace esphome::fujitsu;
+
+static uint64_t fuzzNowUs = 0;
+
+static uint64_t fuzzClock() { return fuzzNowUs; }
+
+static void checkState(const FujiFrame &s) {
+    FUJI_FUZZ_CHECK(s.acMode() <= static_cast<byte>(FujiMode::AUTO), "acMode %d", s.acMode());
+    FUJI_FUZZ_CHECK(s.fanMode() <= static_cast<byte>(FujiFanMode::FAN_HIGH), "fanMode %d", s.fanMode());
+}
+
+// Whatever came in through setState() and is still on its way to the unit
+// must be a setting the unit understands
+static void checkCommands(FujiHeatPump &heatPump) {
+    byte pending = heatPump.commands.pending();
+    for (size_t bit = 1; bit < 8; bit++) {
+        byte mask = 1 << bit;
+        if (!(pending & mask)) {
+            continue;
+        }
+        byte value = heatPump.commands.pendingOr(pending, mask, 0);
+        FUJI_FUZZ_CHECK(fujiUpdateValueValid(mask, value), "value %d pending for mask 0x%02X", value, mask);
+        byte inFlight = heatPump.commands.inFlightOr(mask, value);
+        FUJI_FUZZ_CHECK(fujiUpdateValueValid(mask, inFlight), "value %d in flight for mask 0x%02X", inFlight, mask);
+    }
+}
+
+static void frameReceived(FujiHeatPump &heatPump, const byte *frame) {
+    heatPump.txScheduler.frameEnded(fuzzNowUs);
+    heatPump.handleFrame(frame);
+
+    size_t responses = 0;
+    byte response[kFrameSize];
+    while (heatPump.nextResponse(response)) {
+        responses++;
+        byte plain[kFrameSize];
+        for (size_t i = 0; i < kFrameSize; i++) {
+            plain[i] = response[i] ^ 0xFF;
+        }
+        FujiFrame ff;
+        fujiDecodeFrame(plain, 0, ff);
+        FUJI_FUZZ_CHECK(ff.messageSource() == heatPump.getControllerAddress(), "response from address %d",
+                        ff.messageSource());
+        heatPump.txScheduler.sent(heatPump.txScheduler.nextSlotUs());
+    }
+    FUJI_FUZZ_CHECK(responses <= FujiFrameCache::kMaxResponses, "%zu responses to one frame", responses);
+    FUJI_FUZZ_CHECK(!heatPump.listenOnly || responses == 0, "%zu responses while listening only", responses);
+
+    checkState(heatPump.getCurrentState());
+    checkState(heatPump.getPublishedState());
+    checkCommands(heatPump);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    fuzzNowUs = 1000000;
+    fujiSetHostClock(fuzzClock);
+    fujiHostLogLevel = FUJI_LOG_NONE;
+
+    FujiHeatPump heatPump;
+    heatPump.begin(data[0] & kFuzzOptSecondary);
+    heatPump.useFrameCache = !(data[0] & kFuzzOptNoCache);
+    heatPump.listenOnly = data[0] & kFuzzOptListen;
+
+    size_t pos = 1;
+    while (pos < size) {
+        uint8_t op = data[pos++];
+        switch (op & kFuzzOpMask) {
+            case kFuzzOpRx: {
+                size_t len = (op & (kFuzzRxMax - 1)) + 1;
+                for (size_t i = 0; i < len && pos < size; i++) {
+                    fuzzNowUs += kFujiByteTimeUs;
+                    byte frame[kFrameSize];
+                    if (heatPump.framer.push(data[pos++], frame)) {
+                        frameReceived(heatPump, frame);
+                    }
+                }
+                if (op & kFuzzRxIdle) {
+                    heatPump.framer.idle();
+                }
+                break;
+            }
+            case kFuzzOpSetState: {
+                if (pos + 2 > size) {
+                    pos = size;
+                    break;
+                }
+                byte mask = data[pos];
+                byte value = data[pos + 1];
+                pos += 2;
+                FujiFrame request = heatPump.getCurrentState();
+                for (size_t bit = 1; bit < 8; bit++) {
+                    if (mask & (1 << bit)) {
+                        kUpdateFields[bit].put(request, value);
+                    }
+                }
+                heatPump.setState(&request, mask);
+                checkCommands(heatPump);
+                break;
+            }
+            case kFuzzOpWait:
+                fuzzNowUs += (op & ~kFuzzOpMask) * kFuzzWaitStepUs;
+                heatPump.framer.idle();
+                break;
+            case kFuzzOpComms:
+                heatPump.comms_is_enabled = !heatPump.comms_is_enabled;
+                break;
+        }
+    }
+
+    fujiSetHostClock(nullptr);
+    return 0;
+}
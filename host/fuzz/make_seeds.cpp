@@ -0,0 +1,123 @@
+// Turns bus captures into seed inputs for the fuzz targets, so fuzzing starts
+// from real sessions (handshakes, polls, writes) instead of random bytes.
+//
+//   fuji_fuzz_seeds [--log] OUTDIR CAPTURE...
+//
+// Writes OUTDIR/protocol/<name> and OUTDIR/decode/<name> for every capture.
+
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "FujiCaptureFile.h"
+#include "FujiFuzz.h"
+#include "FujiTxScheduler.h"
+
+using namespace esphome::fujitsu;
+
+static bool writeFile(const std::string &path, const std::vector<uint8_t> &data) {
+    FILE *f = fopen(path.c_str(), "wb");
+    if (f == nullptr) {
+        perror(path.c_str());
+        return false;
+    }
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+    return true;
+}
+
+static void wait(std::vector<uint8_t> &out, uint32_t us) {
+    uint32_t steps = us / kFuzzWaitStepUs;
+    while (steps > 0) {
+        uint32_t n = steps < 0x3F ? steps : 0x3F;
+        out.push_back(kFuzzOpWait | n);
+        steps -= n;
+    }
+}
+
+int main(int argc, char **argv) {
+    bool fromLog = false;
+    int first = 1;
+    if (first < argc && !strcmp(argv[first], "--log")) {
+        fromLog = true;
+        first++;
+    }
+    if (argc - first < 2) {
+        fprintf(stderr, "usage: %s [--log] OUTDIR CAPTURE...\n", argv[0]);
+        return 2;
+    }
+    std::string outDir = argv[first];
+    mkdir(outDir.c_str(), 0755);
+    mkdir((outDir + "/protocol").c_str(), 0755);
+    mkdir((outDir + "/decode").c_str(), 0755);
+
+    int failed = 0;
+    for (int i = first + 1; i < argc; i++) {
+        byte address = static_cast<byte>(FujiAddress::PRIMARY);
+        std::vector<FujiCaptureRecord> records;
+        bool ok = fromLog ? fujiLoadCaptureLog(argv[i], address, records)
+                          : fujiLoadCaptureFile(argv[i], address, records);
+        if (!ok) {
+            failed++;
+            continue;
+        }
+
+        std::vector<uint8_t> protocol{
+            static_cast<uint8_t>(address == static_cast<byte>(FujiAddress::SECONDARY) ? kFuzzOptSecondary : 0)};
+        std::vector<uint8_t> decode;
+        size_t lastRx = 0;  // header of the last Rx op, 0 when a wait followed it
+        uint32_t lastUs = records.empty() ? 0 : records[0].timeUs;
+        for (const FujiCaptureRecord &rec : records) {
+            switch (rec.kind) {
+                case FujiCaptureKind::RX: {
+                    // The bytes themselves account for their time on the line
+                    uint32_t gapUs = rec.timeUs - lastUs;
+                    uint32_t lineUs = rec.arg * kFujiByteTimeUs;
+                    if (gapUs > lineUs && gapUs - lineUs >= kFuzzWaitStepUs) {
+                        wait(protocol, gapUs - lineUs);
+                    }
+                    lastUs = rec.timeUs;
+                    lastRx = protocol.size();
+                    protocol.push_back(kFuzzOpRx | (rec.arg - 1));
+                    protocol.insert(protocol.end(), rec.data, rec.data + rec.arg);
+                    // Frames as the decoder sees them, not inverted
+                    for (size_t b = 0; b < rec.arg; b++) {
+                        decode.push_back(rec.data[b] ^ 0xFF);
+                    }
+                    break;
+                }
+                case FujiCaptureKind::IDLE:
+                    if (lastRx != 0) {
+                        protocol[lastRx] |= kFuzzRxIdle;
+                        lastRx = 0;
+                    }
+                    break;
+                case FujiCaptureKind::PENDING:
+                    for (size_t bit = 1; bit < 8; bit++) {
+                        if (rec.arg & (1 << bit)) {
+                            protocol.push_back(kFuzzOpSetState);
+                            protocol.push_back(1 << bit);
+                            protocol.push_back(rec.data[bit]);
+                        }
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        std::string name = argv[i];
+        size_t slash = name.rfind('/');
+        if (slash != std::string::npos) {
+            name = name.substr(slash + 1);
+        }
+        if (!writeFile(outDir + "/protocol/" + name, protocol) || !writeFile(outDir + "/decode/" + name, decode)) {
+            failed++;
+            continue;
+        }
+        printf("%s: %zu records -> %zu protocol bytes, %zu decode bytes\n", argv[i], records.size(),
+               protocol.size(), decode.size());
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,176 @@
+// Host stress run of the state handoff between setState() callers and the
+// UART task. Writer threads hammer setState() on their own field while a
+// UART thread answers a simulated unit and reader threads take snapshots.
+// At the end every field must hold the last value its writer asked for, and
+// no snapshot may ever have been torn.
+//
+//   fuji_stress_handoff [iterations per writer]
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#include "FujiHeatPump.h"
+
+using namespace esphome::fujitsu;
+
+struct FieldWriter {
+    const char *name;
+    byte mask;
+    FujiFieldRef field;
+    byte minValue;
+    byte maxValue;
+    std::atomic<int> last{-1};
+};
+
+static void toWire(const FujiFrame &ff, byte *wire) {
+    fujiEncodeFrame(ff, wire);
+    for (size_t i = 0; i < kFrameSize; i++) {
+        wire[i] ^= 0xFF;
+    }
+}
+
+static FujiFrame fromWire(const byte *wire) {
+    byte buf[kFrameSize];
+    for (size_t i = 0; i < kFrameSize; i++) {
+        buf[i] = wire[i] ^ 0xFF;
+    }
+    FujiFrame ff;
+    fujiDecodeFrame(buf, 0, ff);
+    return ff;
+}
+
+// A pair that is only ever written together; a torn read breaks the invariant
+struct Checked {
+    uint32_t value;
+    uint32_t inverse;
+    uint32_t filler[6];
+};
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+
+    FujiHeatPump heatPump;
+    heatPump.begin(false);
+
+    FieldWriter writers[] = {
+        {"temperature", kTempUpdateMask, fujiFieldRef<FujiTemperatureField>(), 16, 30},
+        {"mode", kModeUpdateMask, fujiFieldRef<FujiModeField>(), 1, 5},
+        {"fan", kFanModeUpdateMask, fujiFieldRef<FujiFanField>(), 0, 4},
+        {"economy", kEconomyModeUpdateMask, fujiFieldRef<FujiEconomyField>(), 0, 1},
+        {"swing", kSwingModeUpdateMask, fujiFieldRef<FujiSwingField>(), 0, 1},
+        {"swing step", kSwingStepUpdateMask, fujiFieldRef<FujiSwingStepField>(), 0, 1},
+        {"on/off", kOnOffUpdateMask, fujiFieldRef<FujiEnabledField>(), 0, 1},
+    };
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> snapshots{0};
+    std::atomic<uint64_t> torn{0};
+    std::atomic<uint64_t> worstFrameNs{0};
+    FujiFrame unit;
+    unit.setTemperature(22);
+    unit.setAcMode(static_cast<byte>(FujiMode::COOL));
+    FujiSeqLock<Checked> checked;
+
+    // The UART task: poll as the unit, apply any write-bit reply to the unit
+    std::thread uart([&] {
+        uint32_t n = 0;
+        while (!stop.load()) {
+            FujiFrame poll = unit;
+            poll.setMessageSource(static_cast<byte>(FujiAddress::UNIT));
+            poll.setMessageDest(0);
+            poll.setMessageType(static_cast<byte>(FujiMessageType::STATUS));
+            poll.setLoginBit(false);
+            poll.setWriteBit(false);
+            byte wire[kFrameSize];
+            toWire(poll, wire);
+            wire[0] ^= FujiBroadcastField::mask;
+
+            auto start = std::chrono::steady_clock::now();
+            heatPump.handleFrame(wire);
+            uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+            if (ns > worstFrameNs.load()) {
+                worstFrameNs.store(ns);
+            }
+
+            byte response[kFrameSize];
+            while (heatPump.nextResponse(response)) {
+                FujiFrame reply = fromWire(response);
+                if (reply.writeBit()) {
+                    for (auto &w : writers) {
+                        w.field.put(unit, w.field.get(reply));
+                    }
+                }
+            }
+            n++;
+            checked.write(Checked{n, ~n, {}});
+            frames++;
+        }
+    });
+
+    std::vector<std::thread> threads;
+    for (auto &w : writers) {
+        threads.emplace_back([&w, iterations, &heatPump] {
+            std::mt19937 rng(w.mask);
+            for (int i = 0; i < iterations; i++) {
+                FujiFrame request;
+                byte value = w.minValue + rng() % (w.maxValue - w.minValue + 1);
+                w.field.put(request, value);
+                w.last.store(value);
+                heatPump.setState(&request, w.mask);
+                if (rng() % 8 == 0) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 2; r++) {
+        readers.emplace_back([&] {
+            while (!stop.load()) {
+                FujiFrame snapshot = heatPump.getCurrentState();
+                Checked c = checked.read();
+                if (c.inverse != ~c.value || snapshot.temperature() > 127) {
+                    torn++;
+                }
+                snapshots++;
+            }
+        });
+    }
+
+    for (auto &t : threads) {
+        t.join();
+    }
+    // Give the UART side a few frames to deliver the final values
+    uint64_t settle = frames.load() + 100;
+    while (frames.load() < settle) {
+        std::this_thread::yield();
+    }
+    stop.store(true);
+    uart.join();
+    for (auto &t : readers) {
+        t.join();
+    }
+
+    int lost = 0;
+    for (auto &w : writers) {
+        int got = w.field.get(unit);
+        if (got != w.last.load()) {
+            printf("LOST %-12s wanted %d, unit has %d\n", w.name, w.last.load(), got);
+            lost++;
+        }
+    }
+    printf("%d writers x %d setState() calls, %llu frames, %llu snapshots\n",
+           (int)(sizeof(writers) / sizeof(writers[0])), iterations, (unsigned long long)frames.load(),
+           (unsigned long long)snapshots.load());
+    printf("lost field updates: %d, torn snapshots: %llu, worst handleFrame(): %.1f us\n", lost,
+           (unsigned long long)torn.load(), worstFrameNs.load() / 1000.0);
+    return lost || torn.load() ? 1 : 0;
+}